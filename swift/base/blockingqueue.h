@@ -16,6 +16,10 @@
 
 #include <deque>
 #include <mutex>
+#include <chrono>
+#include <vector>
+#include <stdexcept>
+#include <functional>
 #include <assert.h>
 #include <condition_variable>
 
@@ -23,12 +27,21 @@
 
 namespace swift {
 
+// Unbounded FIFO queue guarded by one mutex.
+//
+// The batch operations (PutAll, TakeAll, TakeUpTo) move many elements per
+// lock acquisition and wake up. Close () rejects further puts and wakes up
+// every waiter, the consumers then drain what is left and see the end of
+// the queue (false / empty batch / exception from T Take ()).
+//
+// Consumers that must not block a thread (coroutines) use TakeOrNotify: a
+// callback left on an empty queue is called by the next Put or Close.
 template <typename T>
 class BlockingQueue : swift::noncopyable
 {
     typedef std::lock_guard<std::mutex> LockGuard;
 public:
-    BlockingQueue () : mutex_ (), cond_ (), queue_ ()
+    BlockingQueue () : mutex_ (), cond_ (), queue_ (), notifiers_ (), closed_ (false)
     {
 
     }
@@ -38,31 +51,199 @@ public:
 
     }
 
-    void Put (const T& task)
+    // returns false and drops task if the queue is closed
+    bool Put (const T& task)
     {
-        LockGuard lock (mutex_);
-        queue_.push_back (task);
-        cond_.notify_one ();
+        Notifier notifier;
+        {
+            LockGuard lock (mutex_);
+            if (closed_) {
+                return false;
+            }
+
+            queue_.push_back (task);
+            cond_.notify_one ();
+            notifier = PopNotifier ();
+        }
+
+        if (notifier) {
+            notifier ();
+        }
+        return true;
     }
 
-    void Put (T&& task)
+    bool Put (T&& task)
     {
-        LockGuard lock (mutex_);
-        queue_.push_back (std::move (task));
-        cond_.notify_one ();
+        Notifier notifier;
+        {
+            LockGuard lock (mutex_);
+            if (closed_) {
+                return false;
+            }
+
+            queue_.push_back (std::move (task));
+            cond_.notify_one ();
+            notifier = PopNotifier ();
+        }
+
+        if (notifier) {
+            notifier ();
+        }
+        return true;
+    }
+
+    // puts [first, last) under one lock
+    template <typename InputIt>
+    bool PutAll (InputIt first, InputIt last)
+    {
+        std::vector<Notifier> notifiers;
+        {
+            LockGuard lock (mutex_);
+            if (closed_) {
+                return false;
+            }
+
+            size_t size = queue_.size ();
+            queue_.insert (queue_.end (), first, last);
+            size = queue_.size () - size;
+            if (1 == size) {
+                cond_.notify_one ();
+            }
+            else if (size > 1) {
+                cond_.notify_all ();
+            }
+
+            // one waiting consumer per new element
+            while (notifiers.size () < size && !notifiers_.empty ()) {
+                notifiers.push_back (PopNotifier ());
+            }
+        }
+
+        for (size_t i = 0; i < notifiers.size (); ++i) {
+            notifiers[i] ();
+        }
+        return true;
     }
 
+    // blocks until an element is available,
+    // throws std::runtime_error if the queue is closed and drained
     T Take ()
     {
         std::unique_lock<std::mutex> lock (mutex_);
-        cond_.wait (lock, [this]{return !queue_.empty ();});
-        assert (!queue_.empty ());
+        cond_.wait (lock, [this]{return !queue_.empty () || closed_;});
+        if (queue_.empty ()) {
+            throw std::runtime_error ("BlockingQueue closed");
+        }
+
         T front (std::move (queue_.front ()));
         queue_.pop_front ();
 
         return front;
     }
 
+    // returns false if the queue is closed and drained
+    bool Take (T& out)
+    {
+        std::unique_lock<std::mutex> lock (mutex_);
+        cond_.wait (lock, [this]{return !queue_.empty () || closed_;});
+        return PopFront (out);
+    }
+
+    // returns false on timeout or if the queue is closed and drained
+    template <typename Rep, typename Period>
+    bool TakeFor (T& out, const std::chrono::duration<Rep, Period>& timeout)
+    {
+        std::unique_lock<std::mutex> lock (mutex_);
+        cond_.wait_for (lock, timeout, [this]{return !queue_.empty () || closed_;});
+        return PopFront (out);
+    }
+
+    bool TryTake (T& out)
+    {
+        LockGuard lock (mutex_);
+        return PopFront (out);
+    }
+
+    // Never blocks. Takes an element and returns true, or returns true with
+    // *drained set if the queue is closed and drained. Otherwise returns
+    // false and notifier is called once, outside the lock, by the next Put,
+    // PutAll or Close, which does not reserve the element for it: it should
+    // just schedule another TakeOrNotify.
+    bool TakeOrNotify (T& out, bool* drained, const std::function<void ()>& notifier)
+    {
+        LockGuard lock (mutex_);
+        *drained = false;
+        if (PopFront (out)) {
+            return true;
+        }
+
+        if (closed_) {
+            *drained = true;
+            return true;
+        }
+
+        notifiers_.push_back (notifier);
+        return false;
+    }
+
+    // blocks until the queue is not empty and takes every element at once,
+    // the result is empty only if the queue is closed and drained
+    std::deque<T> TakeAll ()
+    {
+        std::deque<T> all;
+        std::unique_lock<std::mutex> lock (mutex_);
+        cond_.wait (lock, [this]{return !queue_.empty () || closed_;});
+        all.swap (queue_);
+
+        return all;
+    }
+
+    // like TakeAll () but takes at most n elements, n == 0 returns at once
+    std::deque<T> TakeUpTo (size_t n)
+    {
+        std::deque<T> some;
+        if (0 == n) {
+            return some;
+        }
+
+        std::unique_lock<std::mutex> lock (mutex_);
+        cond_.wait (lock, [this]{return !queue_.empty () || closed_;});
+        if (queue_.size () <= n) {
+            some.swap (queue_);
+        }
+        else {
+            for (size_t i = 0; i < n; ++i) {
+                some.push_back (std::move (queue_.front ()));
+                queue_.pop_front ();
+            }
+        }
+
+        return some;
+    }
+
+    // Rejects further puts and wakes up every thread blocked in a take.
+    // The elements already queued can still be taken.
+    void Close ()
+    {
+        std::deque<Notifier> notifiers;
+        {
+            LockGuard lock (mutex_);
+            closed_ = true;
+            cond_.notify_all ();
+            notifiers.swap (notifiers_);
+        }
+
+        for (size_t i = 0; i < notifiers.size (); ++i) {
+            notifiers[i] ();
+        }
+    }
+
+    bool IsClosed () const
+    {
+        LockGuard lock (mutex_);
+        return closed_;
+    }
+
     size_t Size () const
     {
         LockGuard lock (mutex_);
@@ -81,10 +262,39 @@ public:
         queue_.clear ();
     }
 
+private:
+    typedef std::function<void ()> Notifier;
+
+    // must hold mutex_
+    Notifier PopNotifier ()
+    {
+        Notifier notifier;
+        if (!notifiers_.empty ()) {
+            notifier.swap (notifiers_.front ());
+            notifiers_.pop_front ();
+        }
+
+        return notifier;
+    }
+
+    // must hold mutex_
+    bool PopFront (T& out)
+    {
+        if (queue_.empty ()) {
+            return false;
+        }
+
+        out = std::move (queue_.front ());
+        queue_.pop_front ();
+        return true;
+    }
+
 private:
     mutable std::mutex mutex_;
     std::condition_variable cond_;
     std::deque<T> queue_;
+    std::deque<Notifier> notifiers_;    // of TakeOrNotify, in arrival order
+    bool closed_;
 };
 
 } // namespace swift
@@ -0,0 +1,371 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SWIFT_BASE_CACHE_METRICS_HPP__
+#define __SWIFT_BASE_CACHE_METRICS_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "swift/base/metrics.h"
+#include "swift/base/murmurhash3.h"
+
+namespace swift {
+
+// Online estimate of the miss ratio curve of an access stream: the miss ratio
+// an LRU cache would have at any size, from one pass over the accesses.
+//
+// It follows SHARDS: a key is sampled when the spatial hash of the key falls
+// under a threshold, so either every access of a key is seen or none is. The
+// reuse distance of a sampled access, the number of distinct sampled keys
+// since the previous access of the same key, is counted with a Fenwick tree
+// over access times and scaled by 1 / rate, which estimates the distance in
+// the full stream. An LRU cache of size c hits exactly the accesses of
+// distance below c.
+//
+// At most max_keys keys are tracked: beyond that the threshold is lowered to
+// drop the keys of the largest hash, and the weight of later samples grows to
+// match the lower rate. Distances go to log buckets, 16 per power of 2.
+//
+// A few hot keys in or out of the sample skew it a lot, so like SHARDS_adj
+// the curve is normalized by the accesses a sample of exactly the rate would
+// have seen, instead of the sampled ones: the difference is taken as hits of
+// distance 0.
+//
+// Accesses of keys outside the sample cost a hash and a per thread counter,
+// sampled ones take a mutex.
+template<typename KeyType, typename Hash = std::hash<KeyType> >
+class MissRatioCurve {
+ private:
+  struct Entry {
+    uint64_t time;
+    uint64_t sample;
+  };
+
+ public:
+  explicit MissRatioCurve(double rate = 0.01, size_t max_keys = 8192);
+
+  void Access(const KeyType& key);
+
+  // estimated miss ratio of an LRU cache of size entries, 0 before any
+  // sampled access
+  double MissRatio(size_t size) const;
+
+  // the fraction of the keys currently sampled
+  double Rate() const;
+
+ private:
+  MissRatioCurve(const MissRatioCurve&);
+  MissRatioCurve& operator=(const MissRatioCurve&);
+
+  static const uint64_t kModulus = 1 << 24;
+  static const size_t kSubBuckets = 16;
+
+  static uint64_t SampleOf(const KeyType& key) {
+    // the offset keeps key 0, hashed to 0 by std::hash, out of every sample
+    return fmix64(static_cast<uint64_t>(Hash()(key)) + 0x9e3779b97f4a7c15ULL) & (kModulus - 1);
+  }
+
+  // the bucket of a distance: exact below kSubBuckets, then kSubBuckets
+  // buckets per power of 2
+  static size_t BucketOf(uint64_t distance) {
+    if (distance < kSubBuckets) {
+      return static_cast<size_t>(distance);
+    }
+    int shift = 64 - __builtin_clzll(distance) - 5;
+    return kSubBuckets * (shift + 1) + static_cast<size_t>((distance >> shift) & (kSubBuckets - 1));
+  }
+
+  // the smallest distance of a bucket
+  static uint64_t LowerBound(size_t bucket) {
+    if (bucket < kSubBuckets) {
+      return bucket;
+    }
+    size_t shift = bucket / kSubBuckets - 1;
+    return static_cast<uint64_t>(kSubBuckets + bucket % kSubBuckets) << shift;
+  }
+
+  // the Fenwick tree over access times, one for each key's last access
+  void Add(uint64_t time, int64_t delta);
+  int64_t Prefix(uint64_t time) const;
+
+  // renumbers the last accesses from 0 when the times run out
+  void Compact();
+  void Shrink();
+
+  Counter accesses_;
+  mutable std::mutex mutex_;
+  const size_t max_keys_;
+  const double rate_;
+  std::atomic<uint64_t> threshold_;
+  double weight_;   // of the next sample, 1 / rate relative to the start
+  double cold_;     // first accesses
+  double total_;    // every sampled access
+  uint64_t clock_;
+  std::vector<int64_t> tree_;
+  std::vector<double> buckets_;
+  std::unordered_map<KeyType, Entry, Hash> keys_;
+  std::multimap<uint64_t, KeyType> samples_;
+};
+
+// Hit, miss and eviction counters of a cache, plus an optional
+// MissRatioCurve fed by every lookup.
+//
+// The counters are striped over kStripes cache lines rather than kept per
+// thread, so a cache takes no ThreadLocalPtr id and the threads using it need
+// not outlive it: a thread always writes the stripe picked for it at its
+// first count, threads beyond kStripes share stripes. Only the curve, once
+// enabled, takes an id, see Counter.
+template<typename KeyType, typename Hash = std::hash<KeyType> >
+class CacheMetrics {
+ public:
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+
+    double HitRatio() const {
+      return 0 == hits + misses ? 0 : static_cast<double>(hits) / (hits + misses);
+    }
+  };
+
+ public:
+  CacheMetrics() : curve_(nullptr) {
+    for (size_t i = 0; i < kStripes; ++i) {
+      stripes_[i].hits.store(0, std::memory_order_relaxed);
+      stripes_[i].misses.store(0, std::memory_order_relaxed);
+      stripes_[i].evictions.store(0, std::memory_order_relaxed);
+    }
+  }
+  ~CacheMetrics() { delete curve_.load(std::memory_order_acquire); }
+
+  void Hit(const KeyType& key) {
+    Local().hits.fetch_add(1, std::memory_order_relaxed);
+    Track(key);
+  }
+
+  void Miss(const KeyType& key) {
+    Local().misses.fetch_add(1, std::memory_order_relaxed);
+    Track(key);
+  }
+
+  void Evict(int64_t n = 1) {
+    Local().evictions.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+  }
+
+  Stats GetStats() const {
+    Stats stats = { 0, 0, 0 };
+    for (size_t i = 0; i < kStripes; ++i) {
+      stats.hits += stripes_[i].hits.load(std::memory_order_relaxed);
+      stats.misses += stripes_[i].misses.load(std::memory_order_relaxed);
+      stats.evictions += stripes_[i].evictions.load(std::memory_order_relaxed);
+    }
+    return stats;
+  }
+
+  // Starts estimating the miss ratio curve of the lookups, once: later calls
+  // keep the first curve
+  void EnableMissRatioCurve(double rate = 0.01, size_t max_keys = 8192) {
+    MissRatioCurve<KeyType, Hash>* expected = nullptr;
+    MissRatioCurve<KeyType, Hash>* curve = new MissRatioCurve<KeyType, Hash>(rate, max_keys);
+    if (!curve_.compare_exchange_strong(expected, curve, std::memory_order_acq_rel)) {
+      delete curve;
+    }
+  }
+
+  // nullptr unless enabled
+  const MissRatioCurve<KeyType, Hash>* Curve() const {
+    return curve_.load(std::memory_order_acquire);
+  }
+
+ private:
+  CacheMetrics(const CacheMetrics&);
+  CacheMetrics& operator=(const CacheMetrics&);
+
+  static const size_t kStripes = 16;
+
+  // a whole cache line of padding keeps the counters of two stripes off a
+  // common line wherever the array starts
+  struct Stripe {
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> evictions;
+    char pad[64];
+  };
+
+  // the stripe of the calling thread, picked round robin at its first count
+  Stripe& Local() {
+    static std::atomic<uint32_t> next(0);
+    static __thread uint32_t stripe = 0;
+    if (0 == stripe) {
+      stripe = next.fetch_add(1, std::memory_order_relaxed) % kStripes + 1;
+    }
+    return stripes_[stripe - 1];
+  }
+
+  void Track(const KeyType& key) {
+    MissRatioCurve<KeyType, Hash>* curve = curve_.load(std::memory_order_acquire);
+    if (nullptr != curve) {
+      curve->Access(key);
+    }
+  }
+
+  Stripe stripes_[kStripes];
+  std::atomic<MissRatioCurve<KeyType, Hash>*> curve_;
+};
+
+template<typename KeyType, typename Hash>
+swift::MissRatioCurve<KeyType, Hash>::MissRatioCurve(double rate, size_t max_keys)
+  : max_keys_(max_keys > 0 ? max_keys : 1)
+  , rate_(std::min(std::max(rate, 1.0 / kModulus), 1.0))
+  , threshold_(static_cast<uint64_t>(rate_ * kModulus))
+  , weight_(1)
+  , cold_(0)
+  , total_(0)
+  , clock_(0)
+  , tree_(2 * max_keys_ + 2, 0)
+  , buckets_(kSubBuckets * 64, 0) {
+}
+
+template<typename KeyType, typename Hash>
+void swift::MissRatioCurve<KeyType, Hash>::Access(const KeyType& key) {
+  accesses_.Increment();
+  uint64_t sample = SampleOf(key);
+  if (sample >= threshold_.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (sample >= threshold_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  if (clock_ + 1 >= tree_.size()) {
+    Compact();
+  }
+
+  uint64_t now = clock_++;
+  total_ += weight_;
+  auto it = keys_.find(key);
+  if (it == keys_.end()) {
+    cold_ += weight_;
+    Entry entry = { now, sample };
+    keys_.insert(std::make_pair(key, entry));
+    samples_.insert(std::make_pair(sample, key));
+    Add(now, 1);
+    if (keys_.size() > max_keys_) {
+      Shrink();
+    }
+    return;
+  }
+
+  // the distinct keys accessed since the last access of key
+  uint64_t time = it->second.time;
+  int64_t distance = Prefix(now) - Prefix(time + 1);
+  double rate = static_cast<double>(threshold_.load(std::memory_order_relaxed)) / kModulus;
+  buckets_[BucketOf(static_cast<uint64_t>(distance / rate))] += weight_;
+
+  Add(time, -1);
+  Add(now, 1);
+  it->second.time = now;
+}
+
+template<typename KeyType, typename Hash>
+double swift::MissRatioCurve<KeyType, Hash>::MissRatio(size_t size) const {
+  double expected = accesses_.Value() * rate_;
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (0 == total_) {
+    return 0;
+  }
+
+  // the buckets from size on miss, the one holding size partly
+  double misses = cold_;
+  for (size_t i = 0; i < buckets_.size(); ++i) {
+    uint64_t lower = LowerBound(i);
+    uint64_t upper = i + 1 < buckets_.size() ? LowerBound(i + 1) : lower + 1;
+    if (lower >= size) {
+      misses += buckets_[i];
+    } else if (upper > size) {
+      misses += buckets_[i] * (upper - size) / (upper - lower);
+    }
+  }
+  return std::min(misses / expected, 1.0);
+}
+
+template<typename KeyType, typename Hash>
+double swift::MissRatioCurve<KeyType, Hash>::Rate() const {
+  return static_cast<double>(threshold_.load(std::memory_order_relaxed)) / kModulus;
+}
+
+template<typename KeyType, typename Hash>
+void swift::MissRatioCurve<KeyType, Hash>::Add(uint64_t time, int64_t delta) {
+  for (size_t i = static_cast<size_t>(time) + 1; i < tree_.size(); i += i & (~i + 1)) {
+    tree_[i] += delta;
+  }
+}
+
+template<typename KeyType, typename Hash>
+int64_t swift::MissRatioCurve<KeyType, Hash>::Prefix(uint64_t time) const {
+  int64_t sum = 0;
+  for (size_t i = static_cast<size_t>(time); i > 0; i -= i & (~i + 1)) {
+    sum += tree_[i];
+  }
+  return sum;
+}
+
+template<typename KeyType, typename Hash>
+void swift::MissRatioCurve<KeyType, Hash>::Compact() {
+  std::vector<std::pair<uint64_t, Entry*> > times;
+  times.reserve(keys_.size());
+  for (auto& key : keys_) {
+    times.push_back(std::make_pair(key.second.time, &key.second));
+  }
+  std::sort(times.begin(), times.end());
+
+  std::fill(tree_.begin(), tree_.end(), 0);
+  for (size_t i = 0; i < times.size(); ++i) {
+    times[i].second->time = i;
+    Add(i, 1);
+  }
+  clock_ = times.size();
+}
+
+template<typename KeyType, typename Hash>
+void swift::MissRatioCurve<KeyType, Hash>::Shrink() {
+  // the keys of the largest sample leave, the threshold becomes that sample
+  uint64_t threshold = threshold_.load(std::memory_order_relaxed);
+  uint64_t sample = samples_.rbegin()->first;
+  while (!samples_.empty() && samples_.rbegin()->first >= sample) {
+    auto last = --samples_.end();
+    auto it = keys_.find(last->second);
+    Add(it->second.time, -1);
+    keys_.erase(it);
+    samples_.erase(last);
+  }
+
+  if (sample > 0) {
+    weight_ *= static_cast<double>(threshold) / sample;
+  }
+  threshold_.store(sample, std::memory_order_relaxed);
+}
+
+} // namespace swift
+
+#endif // __SWIFT_BASE_CACHE_METRICS_HPP__
@@ -0,0 +1,287 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SWIFT_BASE_CLOCK_CACHE_HPP__
+#define __SWIFT_BASE_CLOCK_CACHE_HPP__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <stdint.h>
+
+#include "swift/base/cache_metrics.hpp"
+#include "swift/base/murmurhash3.h"
+#include "swift/base/reclamation.h"
+
+namespace swift {
+
+// Read mostly cache with CLOCK replacement. Get takes no lock: it probes an
+// open addressing table of node pointers inside an epoch critical section,
+// and a hit only sets the reference bit of the node with a relaxed store,
+// instead of moving it to the front of a list. The probe is bounded by the
+// table size, so Get is wait free.
+//
+// Set, Erase and eviction serialize on one mutex. Eviction sweeps the clock
+// hand over the table, clearing reference bits until it finds a node that was
+// not used since the last sweep. Nodes are immutable once published, a Set of
+// an existing key publishes a new node, replaced and evicted nodes are freed
+// by the epoch domain once no Get can see them.
+template<typename KeyType, typename ValueType, typename Hash = std::hash<KeyType> >
+class ClockCache {
+ private:
+  struct Node {
+    Node(const KeyType& k, const ValueType& v, size_t h)
+      : key(k), value(v), hash(h), referenced(false) {}
+
+    const KeyType key;
+    const ValueType value;
+    const size_t hash;
+    std::atomic<bool> referenced;
+  };
+
+  struct Table {
+    explicit Table(size_t size) : mask(size - 1), slots(new std::atomic<Node*>[size]) {
+      for (size_t i = 0; i < size; ++i) {
+        slots[i].store(nullptr, std::memory_order_relaxed);
+      }
+    }
+
+    const size_t mask;
+    std::unique_ptr<std::atomic<Node*>[]> slots;
+  };
+
+ public:
+  explicit ClockCache(size_t capacity);
+  ~ClockCache();
+
+  void Set(const KeyType& key, const ValueType& value);
+  bool Get(const KeyType& key, ValueType& value);
+  bool Erase(const KeyType& key);
+  size_t Size();
+
+  // hit, miss and eviction counts, and the optional miss ratio curve; the
+  // counts are striped atomics and take no ThreadLocalPtr id, the curve takes
+  // one once enabled
+  CacheMetrics<KeyType, Hash>& Metrics() { return metrics_; }
+
+ private:
+  ClockCache(const ClockCache&);
+  ClockCache& operator=(const ClockCache&);
+
+  static Node* Tombstone() {
+    return reinterpret_cast<Node*>(1);
+  }
+
+  static bool IsNode(Node* node) {
+    return nullptr != node && Tombstone() != node;
+  }
+
+  static size_t HashOf(const KeyType& key) {
+    return static_cast<size_t>(fmix64(static_cast<uint64_t>(Hash()(key))));
+  }
+
+  // slot holding key, or nullptr
+  static std::atomic<Node*>* Find(Table* table, const KeyType& key, size_t hash) {
+    for (size_t i = 0; i <= table->mask; ++i) {
+      std::atomic<Node*>& slot = table->slots[(hash + i) & table->mask];
+      Node* node = slot.load(std::memory_order_acquire);
+      if (nullptr == node) {
+        return nullptr;
+      }
+      if (Tombstone() != node && node->hash == hash && node->key == key) {
+        return &slot;
+      }
+    }
+    return nullptr;
+  }
+
+  void Evict();
+  void Rebuild();
+
+  const size_t capacity_;
+  EpochDomain domain_;
+  std::mutex mutex_;
+  std::atomic<Table*> table_;
+  size_t size_;
+  size_t tombstones_;
+  size_t hand_;
+  CacheMetrics<KeyType, Hash> metrics_;
+};
+
+template<typename KeyType, typename ValueType, typename Hash>
+swift::ClockCache<KeyType, ValueType, Hash>::ClockCache(size_t capacity)
+  : capacity_(capacity > 0 ? capacity : 1)
+  , table_(nullptr)
+  , size_(0)
+  , tombstones_(0)
+  , hand_(0) {
+  // at most half full with live nodes
+  size_t size = 8;
+  while (size < capacity_ * 2) {
+    size <<= 1;
+  }
+  table_.store(new Table(size), std::memory_order_release);
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+swift::ClockCache<KeyType, ValueType, Hash>::~ClockCache() {
+  Table* table = table_.load(std::memory_order_acquire);
+  for (size_t i = 0; i <= table->mask; ++i) {
+    Node* node = table->slots[i].load(std::memory_order_relaxed);
+    if (IsNode(node)) {
+      delete node;
+    }
+  }
+  delete table;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+void swift::ClockCache<KeyType, ValueType, Hash>::Set(const KeyType& key, const ValueType& value) {
+  size_t hash = HashOf(key);
+  Node* node = new Node(key, value, hash);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  Table* table = table_.load(std::memory_order_relaxed);
+  std::atomic<Node*>* slot = Find(table, key, hash);
+  if (nullptr != slot) {
+    node->referenced.store(true, std::memory_order_relaxed);
+    domain_.Retire(slot->exchange(node, std::memory_order_acq_rel));
+    return;
+  }
+
+  if (size_ >= capacity_) {
+    Evict();
+  }
+  if (size_ + tombstones_ + 1 > (table->mask + 1) * 3 / 4) {
+    Rebuild();
+    table = table_.load(std::memory_order_relaxed);
+  }
+
+  for (size_t i = hash; ; ++i) {
+    std::atomic<Node*>& free_slot = table->slots[i & table->mask];
+    Node* old = free_slot.load(std::memory_order_relaxed);
+    if (!IsNode(old)) {
+      if (Tombstone() == old) {
+        --tombstones_;
+      }
+      free_slot.store(node, std::memory_order_release);
+      ++size_;
+      return;
+    }
+  }
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+bool swift::ClockCache<KeyType, ValueType, Hash>::Get(const KeyType& key, ValueType& value) {
+  size_t hash = HashOf(key);
+  EpochDomain::Guard guard(domain_);
+
+  std::atomic<Node*>* slot = Find(table_.load(std::memory_order_acquire), key, hash);
+  if (nullptr == slot) {
+    metrics_.Miss(key);
+    return false;
+  }
+
+  Node* node = slot->load(std::memory_order_acquire);
+  if (!IsNode(node) || node->hash != hash || !(node->key == key)) {
+    // evicted or replaced since Find
+    metrics_.Miss(key);
+    return false;
+  }
+
+  metrics_.Hit(key);
+  // a plain load first keeps hot nodes' cache lines shared between readers
+  if (!node->referenced.load(std::memory_order_relaxed)) {
+    node->referenced.store(true, std::memory_order_relaxed);
+  }
+  value = node->value;
+  return true;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+bool swift::ClockCache<KeyType, ValueType, Hash>::Erase(const KeyType& key) {
+  size_t hash = HashOf(key);
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::atomic<Node*>* slot = Find(table_.load(std::memory_order_relaxed), key, hash);
+  if (nullptr == slot) {
+    return false;
+  }
+
+  domain_.Retire(slot->exchange(Tombstone(), std::memory_order_acq_rel));
+  --size_;
+  ++tombstones_;
+  return true;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+size_t swift::ClockCache<KeyType, ValueType, Hash>::Size() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return size_;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+void swift::ClockCache<KeyType, ValueType, Hash>::Evict() {
+  // every node is passed at most twice: once to clear its bit, once to evict
+  Table* table = table_.load(std::memory_order_relaxed);
+  for (;;) {
+    std::atomic<Node*>& slot = table->slots[hand_];
+    hand_ = (hand_ + 1) & table->mask;
+
+    Node* node = slot.load(std::memory_order_relaxed);
+    if (!IsNode(node)) {
+      continue;
+    }
+    if (node->referenced.load(std::memory_order_relaxed)) {
+      node->referenced.store(false, std::memory_order_relaxed);
+      continue;
+    }
+
+    slot.store(Tombstone(), std::memory_order_release);
+    domain_.Retire(node);
+    metrics_.Evict();
+    --size_;
+    ++tombstones_;
+    return;
+  }
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+void swift::ClockCache<KeyType, ValueType, Hash>::Rebuild() {
+  // readers may still probe the old table, it is retired, not freed
+  Table* old = table_.load(std::memory_order_relaxed);
+  Table* table = new Table(old->mask + 1);
+  for (size_t i = 0; i <= old->mask; ++i) {
+    Node* node = old->slots[i].load(std::memory_order_relaxed);
+    if (!IsNode(node)) {
+      continue;
+    }
+    for (size_t j = node->hash; ; ++j) {
+      std::atomic<Node*>& slot = table->slots[j & table->mask];
+      if (nullptr == slot.load(std::memory_order_relaxed)) {
+        slot.store(node, std::memory_order_relaxed);
+        break;
+      }
+    }
+  }
+
+  table_.store(table, std::memory_order_release);
+  domain_.Retire(old);
+  tombstones_ = 0;
+  hand_ = 0;
+}
+
+} // namespace swift
+
+#endif // __SWIFT_BASE_CLOCK_CACHE_HPP__
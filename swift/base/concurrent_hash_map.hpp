@@ -0,0 +1,301 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SWIFT_BASE_CONCURRENT_HASH_MAP_HPP__
+#define __SWIFT_BASE_CONCURRENT_HASH_MAP_HPP__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+#include "swift/base/murmurhash3.h"
+#include "swift/base/reclamation.h"
+
+namespace swift {
+
+// Hash map shared by many threads, with lock striped writes and lock free
+// reads. The buckets are chains of immutable nodes. A writer locks the stripe
+// of its bucket, so writers of different stripes never meet, and publishes
+// its change with a single pointer store: Upsert links a new node in place of
+// the old one, Erase unlinks the node. Find and ForEach take no lock, they
+// walk the chains inside an epoch critical section, and unlinked nodes are
+// freed by the epoch domain once no reader can reach them.
+//
+// The table doubles when it holds more entries than buckets. Growing locks
+// every stripe, copies the nodes into the new table and retires the old one,
+// readers still walking the old table keep seeing a consistent map.
+template<typename KeyType, typename ValueType, typename Hash = std::hash<KeyType> >
+class ConcurrentHashMap {
+ private:
+  struct Node {
+    Node(const KeyType& k, const ValueType& v, size_t h, Node* n)
+      : key(k), value(v), hash(h), next(n) {}
+
+    const KeyType key;
+    const ValueType value;
+    const size_t hash;
+    std::atomic<Node*> next;
+  };
+
+  struct Table {
+    explicit Table(size_t size) : mask(size - 1), buckets(new std::atomic<Node*>[size]) {
+      for (size_t i = 0; i < size; ++i) {
+        buckets[i].store(nullptr, std::memory_order_relaxed);
+      }
+    }
+
+    // frees the nodes still linked, the unlinked ones were retired apart
+    ~Table() {
+      for (size_t i = 0; i <= mask; ++i) {
+        Node* node = buckets[i].load(std::memory_order_relaxed);
+        while (nullptr != node) {
+          Node* next = node->next.load(std::memory_order_relaxed);
+          delete node;
+          node = next;
+        }
+      }
+    }
+
+    const size_t mask;
+    std::unique_ptr<std::atomic<Node*>[]> buckets;
+  };
+
+  // a stripe lock on its own cache line
+  struct Stripe {
+    std::mutex mutex;
+    char padding[64];
+  };
+
+ public:
+  // bucket_num is rounded up to a power of two, and to at least stripe_num
+  explicit ConcurrentHashMap(size_t bucket_num = 1024, size_t stripe_num = 64);
+  ~ConcurrentHashMap();
+
+  bool Find(const KeyType& key, ValueType& value);
+  // false if the key exists, the map is left unchanged
+  bool Insert(const KeyType& key, const ValueType& value);
+  // inserts or replaces, true if the key was inserted
+  bool Upsert(const KeyType& key, const ValueType& value);
+  bool Erase(const KeyType& key);
+  void Clear();
+  size_t Size() const;
+
+  // Calls func(key, value) for every entry, without blocking writers. An
+  // entry present during the whole walk is visited exactly once, entries
+  // changed meanwhile may or may not be.
+  void ForEach(const std::function<void(const KeyType&, const ValueType&)>& func);
+
+ private:
+  ConcurrentHashMap(const ConcurrentHashMap&);
+  ConcurrentHashMap& operator=(const ConcurrentHashMap&);
+
+  // the first power of two from size on that is at least num
+  static size_t RoundUp(size_t num, size_t size) {
+    while (size < num) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  static size_t HashOf(const KeyType& key) {
+    return static_cast<size_t>(fmix64(static_cast<uint64_t>(Hash()(key))));
+  }
+
+  // The table only changes with every stripe locked, so it is stable while
+  // one is held. Buckets outnumber stripes, so a bucket always maps to the
+  // same stripe, whatever the table.
+  std::mutex& StripeOf(size_t hash) {
+    return stripes_[hash & stripe_mask_].mutex;
+  }
+
+  // the link pointing to the node of key, or to the end of its chain
+  static std::atomic<Node*>* Locate(Table* table, const KeyType& key, size_t hash) {
+    std::atomic<Node*>* link = &table->buckets[hash & table->mask];
+    for (;;) {
+      Node* node = link->load(std::memory_order_acquire);
+      if (nullptr == node || (node->hash == hash && node->key == key)) {
+        return link;
+      }
+      link = &node->next;
+    }
+  }
+
+  // 0 inserted, 1 replaced, 2 left unchanged
+  int Store(const KeyType& key, const ValueType& value, bool replace);
+  void Grow(size_t bucket_num);
+
+  const size_t stripe_mask_;
+  std::unique_ptr<Stripe[]> stripes_;
+  EpochDomain domain_;
+  std::atomic<Table*> table_;
+  std::atomic<size_t> size_;
+};
+
+template<typename KeyType, typename ValueType, typename Hash>
+swift::ConcurrentHashMap<KeyType, ValueType, Hash>::ConcurrentHashMap(size_t bucket_num, size_t stripe_num)
+  : stripe_mask_(RoundUp(stripe_num, 1) - 1)
+  , stripes_(new Stripe[stripe_mask_ + 1])
+  , table_(nullptr)
+  , size_(0) {
+  table_.store(new Table(RoundUp(bucket_num, stripe_mask_ + 1)), std::memory_order_release);
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+swift::ConcurrentHashMap<KeyType, ValueType, Hash>::~ConcurrentHashMap() {
+  delete table_.load(std::memory_order_acquire);
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+bool swift::ConcurrentHashMap<KeyType, ValueType, Hash>::Find(const KeyType& key, ValueType& value) {
+  size_t hash = HashOf(key);
+  EpochDomain::Guard guard(domain_);
+
+  Node* node = Locate(table_.load(std::memory_order_acquire), key, hash)->load(std::memory_order_acquire);
+  if (nullptr == node || node->hash != hash || !(node->key == key)) {
+    // replaced or erased since Locate
+    return false;
+  }
+
+  value = node->value;
+  return true;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+bool swift::ConcurrentHashMap<KeyType, ValueType, Hash>::Insert(const KeyType& key, const ValueType& value) {
+  return 0 == Store(key, value, false);
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+bool swift::ConcurrentHashMap<KeyType, ValueType, Hash>::Upsert(const KeyType& key, const ValueType& value) {
+  return 0 == Store(key, value, true);
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+bool swift::ConcurrentHashMap<KeyType, ValueType, Hash>::Erase(const KeyType& key) {
+  size_t hash = HashOf(key);
+  std::unique_lock<std::mutex> lock(StripeOf(hash));
+
+  std::atomic<Node*>* link = Locate(table_.load(std::memory_order_relaxed), key, hash);
+  Node* node = link->load(std::memory_order_relaxed);
+  if (nullptr == node) {
+    return false;
+  }
+
+  // readers standing on node still follow its next to the rest of the chain
+  link->store(node->next.load(std::memory_order_relaxed), std::memory_order_release);
+  size_.fetch_sub(1, std::memory_order_relaxed);
+  domain_.Retire(node);
+  return true;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+void swift::ConcurrentHashMap<KeyType, ValueType, Hash>::Clear() {
+  std::vector<std::unique_lock<std::mutex> > locks;
+  for (size_t i = 0; i <= stripe_mask_; ++i) {
+    locks.push_back(std::unique_lock<std::mutex>(stripes_[i].mutex));
+  }
+
+  Table* old = table_.load(std::memory_order_relaxed);
+  table_.store(new Table(old->mask + 1), std::memory_order_release);
+  size_.store(0, std::memory_order_relaxed);
+  domain_.Retire(old);
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+size_t swift::ConcurrentHashMap<KeyType, ValueType, Hash>::Size() const {
+  return size_.load(std::memory_order_relaxed);
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+void swift::ConcurrentHashMap<KeyType, ValueType, Hash>::ForEach(
+    const std::function<void(const KeyType&, const ValueType&)>& func) {
+  EpochDomain::Guard guard(domain_);
+
+  Table* table = table_.load(std::memory_order_acquire);
+  for (size_t i = 0; i <= table->mask; ++i) {
+    Node* node = table->buckets[i].load(std::memory_order_acquire);
+    while (nullptr != node) {
+      func(node->key, node->value);
+      node = node->next.load(std::memory_order_acquire);
+    }
+  }
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+int swift::ConcurrentHashMap<KeyType, ValueType, Hash>::Store(const KeyType& key, const ValueType& value, bool replace) {
+  size_t hash = HashOf(key);
+  size_t bucket_num = 0;
+  {
+    std::unique_lock<std::mutex> lock(StripeOf(hash));
+    Table* table = table_.load(std::memory_order_relaxed);
+    std::atomic<Node*>* link = Locate(table, key, hash);
+    Node* node = link->load(std::memory_order_relaxed);
+    if (nullptr != node) {
+      if (!replace) {
+        return 2;
+      }
+      link->store(new Node(key, value, hash, node->next.load(std::memory_order_relaxed)),
+                  std::memory_order_release);
+      domain_.Retire(node);
+      return 1;
+    }
+
+    // appended at the end of the chain, readers see it or the old end
+    link->store(new Node(key, value, hash, nullptr), std::memory_order_release);
+    if (size_.fetch_add(1, std::memory_order_relaxed) + 1 > table->mask + 1) {
+      bucket_num = (table->mask + 1) * 2;
+    }
+  }
+
+  if (0 != bucket_num) {
+    Grow(bucket_num);
+  }
+  return 0;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+void swift::ConcurrentHashMap<KeyType, ValueType, Hash>::Grow(size_t bucket_num) {
+  // stripes are always locked in order, so two growers can not deadlock
+  std::vector<std::unique_lock<std::mutex> > locks;
+  for (size_t i = 0; i <= stripe_mask_; ++i) {
+    locks.push_back(std::unique_lock<std::mutex>(stripes_[i].mutex));
+  }
+
+  Table* old = table_.load(std::memory_order_relaxed);
+  if (old->mask + 1 >= bucket_num) {
+    // another thread grew it first
+    return;
+  }
+
+  // readers may still walk the old chains, so the nodes are copied, not moved
+  Table* table = new Table(bucket_num);
+  for (size_t i = 0; i <= old->mask; ++i) {
+    for (Node* node = old->buckets[i].load(std::memory_order_relaxed); nullptr != node;
+         node = node->next.load(std::memory_order_relaxed)) {
+      std::atomic<Node*>& bucket = table->buckets[node->hash & table->mask];
+      bucket.store(new Node(node->key, node->value, node->hash, bucket.load(std::memory_order_relaxed)),
+                   std::memory_order_relaxed);
+    }
+  }
+
+  table_.store(table, std::memory_order_release);
+  domain_.Retire(old);
+}
+
+} // namespace swift
+
+#endif // __SWIFT_BASE_CONCURRENT_HASH_MAP_HPP__
@@ -0,0 +1,597 @@
+/*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef __SWIFT_BASE_COROUTINE_H__
+#define __SWIFT_BASE_COROUTINE_H__
+
+// C++20 coroutines on top of ThreadPool. The rest of the library is C++11,
+// so everything here is only available to translation units compiled with
+// -std=c++20 (or later).
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define SWIFT_HAS_COROUTINE 1
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <utility>
+#include <optional>
+#include <exception>
+#include <coroutine>
+#include <functional>
+#include <type_traits>
+#include <condition_variable>
+
+#include "swift/base/logging.h"
+#include "swift/base/threadpool.h"
+#include "swift/base/blockingqueue.h"
+#include "swift/base/noncopyable.hpp"
+
+namespace swift {
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+class TaskPromiseBase
+{
+public:
+    // resumes whoever co_awaited the task, by symmetric transfer so long
+    // chains of tasks do not grow the stack
+    struct FinalAwaiter
+    {
+        bool await_ready () noexcept
+        {
+            return false;
+        }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend (std::coroutine_handle<Promise> h) noexcept
+        {
+            std::coroutine_handle<> continuation = h.promise ().continuation_;
+            if (continuation) {
+                return continuation;
+            }
+
+            return std::noop_coroutine ();
+        }
+
+        void await_resume () noexcept {}
+    };
+
+    std::suspend_always initial_suspend () noexcept
+    {
+        return {};
+    }
+
+    FinalAwaiter final_suspend () noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception ()
+    {
+        exception_ = std::current_exception ();
+    }
+
+    void SetContinuation (std::coroutine_handle<> continuation)
+    {
+        continuation_ = continuation;
+    }
+
+protected:
+    void CheckException () const
+    {
+        if (exception_) {
+            std::rethrow_exception (exception_);
+        }
+    }
+
+private:
+    std::coroutine_handle<> continuation_;
+    std::exception_ptr exception_;
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase
+{
+public:
+    Task<T> get_return_object ();
+
+    template <typename U>
+    void return_value (U&& value)
+    {
+        value_.emplace (std::forward<U> (value));
+    }
+
+    T Result ()
+    {
+        CheckException ();
+        return std::move (*value_);
+    }
+
+private:
+    std::optional<T> value_;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase
+{
+public:
+    Task<void> get_return_object ();
+
+    void return_void () {}
+
+    void Result ()
+    {
+        CheckException ();
+    }
+};
+
+} // namespace detail
+
+// A lazily started coroutine returning T. It starts running when it is
+// co_awaited and resumes the awaiting coroutine when it finishes, on
+// whatever thread it finished on.
+template <typename T>
+class Task : swift::noncopyable
+{
+public:
+    typedef detail::TaskPromise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    explicit Task (Handle handle) : handle_ (handle) {}
+
+    Task (Task&& other) noexcept : handle_ (std::exchange (other.handle_, nullptr)) {}
+
+    Task& operator= (Task&& other) noexcept
+    {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy ();
+            }
+            handle_ = std::exchange (other.handle_, nullptr);
+        }
+
+        return *this;
+    }
+
+    ~Task ()
+    {
+        if (handle_) {
+            handle_.destroy ();
+        }
+    }
+
+    bool await_ready () const noexcept
+    {
+        return !handle_ || handle_.done ();
+    }
+
+    std::coroutine_handle<> await_suspend (std::coroutine_handle<> awaiting) noexcept
+    {
+        handle_.promise ().SetContinuation (awaiting);
+        return handle_;
+    }
+
+    T await_resume ()
+    {
+        return handle_.promise ().Result ();
+    }
+
+private:
+    Handle handle_;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object ()
+{
+    return Task<T> (std::coroutine_handle<TaskPromise<T> >::from_promise (*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object ()
+{
+    return Task<void> (std::coroutine_handle<TaskPromise<void> >::from_promise (*this));
+}
+
+// An eagerly started coroutine that frees itself when done,
+// used to drive a Task from non coroutine code.
+struct Detached
+{
+    struct promise_type
+    {
+        Detached get_return_object () noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never initial_suspend () noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never final_suspend () noexcept
+        {
+            return {};
+        }
+
+        void return_void () noexcept {}
+
+        void unhandled_exception () noexcept
+        {
+            std::terminate ();
+        }
+    };
+};
+
+template <typename T>
+class SyncState : swift::noncopyable
+{
+public:
+    SyncState () : done_ (false) {}
+
+    template <typename F>
+    void Complete (F&& f)
+    {
+        try {
+            if constexpr (std::is_void<T>::value) {
+                f ();
+            }
+            else {
+                value_.emplace (f ());
+            }
+        }
+        catch (...) {
+            exception_ = std::current_exception ();
+        }
+
+        std::lock_guard<std::mutex> lock (mutex_);
+        done_ = true;
+        cond_.notify_all ();
+    }
+
+    T Wait ()
+    {
+        std::unique_lock<std::mutex> lock (mutex_);
+        cond_.wait (lock, [this] { return done_; });
+        if (exception_) {
+            std::rethrow_exception (exception_);
+        }
+
+        if constexpr (!std::is_void<T>::value) {
+            return std::move (*value_);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool done_;
+    std::exception_ptr exception_;
+    std::conditional_t<std::is_void<T>::value, char, std::optional<T> > value_;
+};
+
+template <typename T>
+Detached RunSync (Task<T>& task, SyncState<T>& state)
+{
+    std::exception_ptr ex;
+    if constexpr (std::is_void<T>::value) {
+        try {
+            co_await task;
+        }
+        catch (...) {
+            ex = std::current_exception ();
+        }
+        state.Complete ([&ex] { if (ex) std::rethrow_exception (ex); });
+    }
+    else {
+        std::optional<T> value;
+        try {
+            value.emplace (co_await task);
+        }
+        catch (...) {
+            ex = std::current_exception ();
+        }
+        state.Complete ([&] () -> T {
+            if (ex) {
+                std::rethrow_exception (ex);
+            }
+            return std::move (*value);
+        });
+    }
+}
+
+// One background thread firing callbacks at their deadline,
+// the callbacks only hand work over to a pool and must be short.
+class TimerQueue : swift::noncopyable
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static TimerQueue& Instance ()
+    {
+        static TimerQueue kTimer;
+        return kTimer;
+    }
+
+    void Add (Clock::time_point deadline, std::function<void ()> callback)
+    {
+        std::lock_guard<std::mutex> lock (mutex_);
+        bool earliest = timers_.empty () || deadline < timers_.begin ()->first;
+        timers_.emplace (deadline, std::move (callback));
+        if (earliest) {
+            cond_.notify_one ();
+        }
+    }
+
+    ~TimerQueue ()
+    {
+        {
+            std::lock_guard<std::mutex> lock (mutex_);
+            stop_ = true;
+            cond_.notify_one ();
+        }
+        thread_.join ();
+    }
+
+private:
+    TimerQueue () : stop_ (false), thread_ ([this] { Loop (); }) {}
+
+    void Loop ()
+    {
+        std::unique_lock<std::mutex> lock (mutex_);
+        while (!stop_) {
+            if (timers_.empty ()) {
+                cond_.wait (lock);
+                continue;
+            }
+
+            auto first = timers_.begin ();
+            if (Clock::now () < first->first) {
+                cond_.wait_until (lock, first->first);
+                continue;
+            }
+
+            std::function<void ()> callback = std::move (first->second);
+            timers_.erase (first);
+            lock.unlock ();
+            callback ();
+            lock.lock ();
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::multimap<Clock::time_point, std::function<void ()> > timers_;
+    bool stop_;
+    std::thread thread_;
+};
+
+} // namespace detail
+
+// Runs task on the calling thread until its first suspension and blocks
+// until it is done, returns its result or rethrows its exception.
+template <typename T>
+T SyncWait (Task<T> task)
+{
+    detail::SyncState<T> state;
+    detail::RunSync (task, state);
+    return state.Wait ();
+}
+
+// co_await ScheduleOn (pool) continues the coroutine on a worker of pool
+class ScheduleOn
+{
+public:
+    explicit ScheduleOn (ThreadPool& pool) : pool_ (pool) {}
+
+    bool await_ready () const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend (std::coroutine_handle<> h)
+    {
+        pool_.Schedule ([h] { h.resume (); });
+    }
+
+    void await_resume () const noexcept {}
+
+private:
+    ThreadPool& pool_;
+};
+
+namespace detail {
+
+inline Detached RunSpawned (ThreadPool& pool, Task<void> task)
+{
+    co_await ScheduleOn (pool);
+    try {
+        co_await task;
+    }
+    catch (std::exception& ex) {
+        LOG(ERROR) << "Unhandled std::exception in spawned task: " << ex.what ();
+    }
+    catch (...) {
+        LOG(ERROR) << "Unhandled non-exception in spawned task";
+    }
+}
+
+} // namespace detail
+
+// Starts task on pool and forgets about it, exceptions are logged
+inline void Spawn (ThreadPool& pool, Task<void> task)
+{
+    detail::RunSpawned (pool, std::move (task));
+}
+
+// co_await SleepFor (pool, d) suspends the coroutine without holding a
+// thread and continues it on pool once d has passed
+class SleepFor
+{
+public:
+    template <typename Rep, typename Period>
+    SleepFor (ThreadPool& pool, const std::chrono::duration<Rep, Period>& duration)
+        : pool_ (pool)
+        , deadline_ (detail::TimerQueue::Clock::now () +
+                     std::chrono::duration_cast<detail::TimerQueue::Clock::duration> (duration))
+    {
+    }
+
+    bool await_ready () const noexcept
+    {
+        return detail::TimerQueue::Clock::now () >= deadline_;
+    }
+
+    void await_suspend (std::coroutine_handle<> h)
+    {
+        ThreadPool* pool = &pool_;
+        detail::TimerQueue::Instance ().Add (deadline_, [pool, h] {
+            pool->Schedule ([h] { h.resume (); });
+        });
+    }
+
+    void await_resume () const noexcept {}
+
+private:
+    ThreadPool& pool_;
+    detail::TimerQueue::Clock::time_point deadline_;
+};
+
+// co_await Offload (pool, f) runs the blocking call f () on pool and
+// continues the coroutine there with its result, so blocking calls
+// (disk, HttpClient) are confined to a pool sized for them
+template <typename F>
+class Offload
+{
+    typedef decltype (std::declval<F&> () ()) Result;
+
+public:
+    Offload (ThreadPool& pool, F f) : pool_ (pool), func_ (std::move (f)) {}
+
+    bool await_ready () const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend (std::coroutine_handle<> h)
+    {
+        pool_.Schedule ([this, h] {
+            try {
+                if constexpr (std::is_void<Result>::value) {
+                    func_ ();
+                }
+                else {
+                    result_.emplace (func_ ());
+                }
+            }
+            catch (...) {
+                exception_ = std::current_exception ();
+            }
+
+            h.resume ();
+        });
+    }
+
+    Result await_resume ()
+    {
+        if (exception_) {
+            std::rethrow_exception (exception_);
+        }
+
+        if constexpr (!std::is_void<Result>::value) {
+            return std::move (*result_);
+        }
+    }
+
+private:
+    ThreadPool& pool_;
+    F func_;
+    std::exception_ptr exception_;
+    std::conditional_t<std::is_void<Result>::value, char, std::optional<Result> > result_;
+};
+
+// co_await TakeAsync (queue, pool) takes an element of a BlockingQueue
+// without blocking a thread: on an empty queue the coroutine is suspended
+// and the next Put or Close schedules it on pool to try again. The result
+// is empty once the queue is closed and drained.
+template <typename T>
+class TakeAsync
+{
+public:
+    TakeAsync (BlockingQueue<T>& queue, ThreadPool& pool)
+        : queue_ (queue)
+        , pool_ (pool)
+    {
+    }
+
+    bool await_ready ()
+    {
+        T value = T ();
+        if (queue_.TryTake (value)) {
+            value_.emplace (std::move (value));
+            return true;
+        }
+
+        return false;
+    }
+
+    // false resumes the coroutine at once
+    bool await_suspend (std::coroutine_handle<> h)
+    {
+        return !TakeOrWait (h);
+    }
+
+    std::optional<T> await_resume ()
+    {
+        return std::move (value_);
+    }
+
+private:
+    // true once there is a value or the queue is closed and drained,
+    // otherwise h is resumed on pool by the next Put or Close
+    bool TakeOrWait (std::coroutine_handle<> h)
+    {
+        T value = T ();
+        bool drained = false;
+        if (!queue_.TakeOrNotify (value, &drained, [this, h] {
+            pool_.Schedule ([this, h] {
+                if (TakeOrWait (h)) {
+                    h.resume ();
+                }
+            });
+        })) {
+            return false;
+        }
+
+        if (!drained) {
+            value_.emplace (std::move (value));
+        }
+        return true;
+    }
+
+private:
+    BlockingQueue<T>& queue_;
+    ThreadPool& pool_;
+    std::optional<T> value_;
+};
+
+} // namespace swift
+
+#endif // __cpp_impl_coroutine
+#endif // __SWIFT_BASE_COROUTINE_H__
@@ -0,0 +1,244 @@
+/*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/*
+* A reader biased read-write lock with distributed reader state (brlock).
+*
+*  RWSpinLock and RWTicketSpinLockT keep every reader in one shared word,
+*  so each lock_shared () is an atomic read-modify-write on a cache line
+*  that all cores fight over and reads stop scaling after a few cores.
+*
+*  DistributedRWLock gives every thread a reader slot on a cache line of
+*  its own, a reader only touches its slot and reads the writer flag, which
+*  stays shared in every cache while there is no writer. A writer raises
+*  the flag, which turns new readers away, and then revokes the slots by
+*  waiting for each of them to drain, so writes cost O(kSlots) and the lock
+*  takes kSlots cache lines (4KB). Use it for read-mostly data with rare
+*  writes; writers are preferred, readers wait while one is pending.
+*
+*  Threads beyond kSlots share slots, which stays correct, a slot counts
+*  the readers of all its threads.
+*/
+
+#ifndef __SWIFT_BASE_DISTRIBUTEDRWLOCK_H__
+#define __SWIFT_BASE_DISTRIBUTEDRWLOCK_H__
+
+#include <atomic>
+#include <algorithm>
+#include <sched.h>
+#include <stdint.h>
+
+#include "swift/base/likely.h"
+#include "swift/base/noncopyable.hpp"
+
+namespace swift {
+
+class DistributedRWLock : swift::noncopyable
+{
+public:
+    static const uint32_t kSlots = 64;
+
+    DistributedRWLock () : writer_ (false)
+    {
+        for (uint32_t i = 0; i < kSlots; ++i) {
+            slots_[i].readers.store (0, std::memory_order_relaxed);
+        }
+    }
+
+    // Lockable Concept
+    void lock ()
+    {
+        int count = 0;
+        while (writer_.exchange (true, std::memory_order_seq_cst)) {
+            do {
+                Pause (++count);
+            } while (writer_.load (std::memory_order_relaxed));
+        }
+
+        // revoke the reader slots
+        for (uint32_t i = 0; i < kSlots; ++i) {
+            while (0 != slots_[i].readers.load (std::memory_order_seq_cst)) {
+                Pause (++count);
+            }
+        }
+    }
+
+    void unlock ()
+    {
+        writer_.store (false, std::memory_order_release);
+    }
+
+    // SharedLockable Concept
+    void lock_shared ()
+    {
+        int count = 0;
+        while (!LIKELY (try_lock_shared ())) {
+            do {
+                Pause (++count);
+            } while (writer_.load (std::memory_order_relaxed));
+        }
+    }
+
+    void unlock_shared ()
+    {
+        slots_[Slot ()].readers.fetch_sub (1, std::memory_order_release);
+    }
+
+    // Attempt to acquire writer permission. Return false if we didn't get it.
+    bool try_lock ()
+    {
+        if (writer_.exchange (true, std::memory_order_seq_cst)) {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < kSlots; ++i) {
+            if (0 != slots_[i].readers.load (std::memory_order_seq_cst)) {
+                writer_.store (false, std::memory_order_release);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Try to get reader permission on the lock. This fails while a writer
+    // holds or waits for the lock.
+    bool try_lock_shared ()
+    {
+        // the slot is raised before the flag is read, and the writer raises
+        // the flag before it reads the slots, so one of them sees the other
+        std::atomic<int32_t>& readers = slots_[Slot ()].readers;
+        readers.fetch_add (1, std::memory_order_seq_cst);
+        if (UNLIKELY (writer_.load (std::memory_order_seq_cst))) {
+            readers.fetch_sub (1, std::memory_order_release);
+            return false;
+        }
+
+        return true;
+    }
+
+    class ReadHolder;
+    class WriteHolder;
+
+    class ReadHolder : swift::noncopyable
+    {
+    public:
+        explicit ReadHolder (DistributedRWLock* lock = nullptr) : lock_ (lock)
+        {
+            if (lock_) lock_->lock_shared ();
+        }
+
+        explicit ReadHolder (DistributedRWLock& lock) : lock_ (&lock)
+        {
+            lock_->lock_shared ();
+        }
+
+        ~ReadHolder ()
+        {
+            if (lock_) lock_->unlock_shared ();
+        }
+
+        void reset (DistributedRWLock* lock = nullptr)
+        {
+            if (lock == lock_) return;
+            if (lock_) lock_->unlock_shared ();
+            lock_ = lock;
+            if (lock_) lock_->lock_shared ();
+        }
+
+        void swap (ReadHolder* other)
+        {
+            std::swap (this->lock_, other->lock_);
+        }
+
+    private:
+        DistributedRWLock* lock_;
+    };
+
+    class WriteHolder : swift::noncopyable
+    {
+    public:
+        explicit WriteHolder (DistributedRWLock* lock = nullptr) : lock_ (lock)
+        {
+            if (lock_) lock_->lock ();
+        }
+
+        explicit WriteHolder (DistributedRWLock& lock) : lock_ (&lock)
+        {
+            lock_->lock ();
+        }
+
+        ~WriteHolder ()
+        {
+            if (lock_) lock_->unlock ();
+        }
+
+        void reset (DistributedRWLock* lock = nullptr)
+        {
+            if (lock == lock_) return;
+            if (lock_) lock_->unlock ();
+            lock_ = lock;
+            if (lock_) lock_->lock ();
+        }
+
+        void swap (WriteHolder* other)
+        {
+            std::swap (this->lock_, other->lock_);
+        }
+
+    private:
+        DistributedRWLock* lock_;
+    };
+
+private:
+    // slot of the calling thread, handed out round robin on first use
+    static uint32_t Slot ()
+    {
+        static std::atomic<uint32_t> next (0);
+        static __thread uint32_t slot = kSlots;
+        if (UNLIKELY (kSlots == slot)) {
+            slot = next.fetch_add (1, std::memory_order_relaxed) % kSlots;
+        }
+
+        return slot;
+    }
+
+    static void Pause (int count)
+    {
+        if (count > 1000) {
+            sched_yield ();
+        }
+#if defined(__GNUC__) && (defined(__i386) || defined(__x86_64__))
+        else {
+            __asm__ __volatile__ ("pause");
+        }
+#endif
+    }
+
+    struct ReaderSlot
+    {
+        std::atomic<int32_t> readers;
+        char padding[64 - sizeof (std::atomic<int32_t>)];
+    };
+
+private:
+    char padding0_[64];
+    std::atomic<bool> writer_;
+    char padding1_[64 - sizeof (std::atomic<bool>)];
+    ReaderSlot slots_[kSlots];
+};
+
+} // namespace swift
+
+#endif // __SWIFT_BASE_DISTRIBUTEDRWLOCK_H__
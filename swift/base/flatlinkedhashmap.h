@@ -0,0 +1,606 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SWIFT_BASE_FLAT_LINKED_HASH_MAP_H__
+#define __SWIFT_BASE_FLAT_LINKED_HASH_MAP_H__
+
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+#include <functional>
+#include <stdint.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#include "swift/base/noncopyable.hpp"
+#include "swift/base/murmurhash3.h"
+#include "swift/base/linkedhashmap.h"
+
+namespace swift {
+
+/**
+ * Doubly-linked hash map with open addressing, an alternative to
+ * LinkedHashMap for large or lookup heavy maps.
+ *
+ * Records live in the slots of a Robin Hood table sized to a power of 2, so
+ * a probe is a mask instead of a division, and a hit usually touches a single
+ * cache line: the slot holds the hash, the order links and the record. The
+ * order links are slot numbers, fixed up whenever an insertion or removal
+ * shifts a record. The table grows at 80% load.
+ *
+ * Unlike LinkedHashMap, the pointers returned by Set and Get, and iterators,
+ * are only valid until the next Set or Remove.
+ *
+ * @param KEY the key type
+ * @param VALUE the value type
+ * @param HASH the hash functor
+ * @param EQUALTO the equality checking functor
+ */
+template <class KEY,
+          class VALUE,
+          class HASH = std::hash<KEY>,
+          class EQUALTO = std::equal_to<KEY> >
+class FlatLinkedHashMap : swift::noncopyable
+{
+private:
+    struct Record
+    {
+        KEY key_;		// key
+        VALUE value_;	// value
+
+        explicit Record (const KEY& k, const VALUE& v)
+            : key_ (k)
+            , value_ (v)
+        {
+        }
+    };
+
+    struct Slot
+    {
+        uint32_t hash_;		// the low 32 bits of the hash
+        uint32_t used_;		// non-zero if the slot holds a record
+        uint32_t prev_;		// previous record
+        uint32_t next_;		// next record
+        typename std::aligned_storage<sizeof(Record), alignof(Record)>::type rec_;
+    };
+
+    // new[] aligns no further than max_align_t, mmap to a page
+    static_assert (alignof(Slot) <= alignof(std::max_align_t),
+                   "FlatLinkedHashMap does not support over-aligned records");
+
+    //
+    // The end of a record list
+    //
+    static const uint32_t NIL = 0xffffffff;
+
+    //
+    // The default number of slots
+    //
+    static const size_t MAP_DEFAULT_SLOT_NUM = 32;
+
+    //
+    // The mininum number of slots to use mmap
+    //
+    static const size_t MIN_MAPZMAP_SLOT_NUM = 32768;
+
+public:
+    /**
+    * Moving Modes
+    */
+    enum MoveMode
+    {
+        MM_CURRENT,
+        MM_FIRST,
+        MM_LAST
+    };
+
+    //
+    // Iterator of records
+    //
+    class Iterator
+    {
+    public:
+        /**
+        * Get the key
+        *
+        * @return a reference of the key
+        */
+        const KEY& Key () const
+        {
+            return map_->At (pos_).key_;
+        }
+
+        /**
+        * Get the value
+        *
+        * @return a reference of the value
+        */
+        VALUE& Value ()
+        {
+            return map_->At (pos_).value_;
+        }
+
+        bool operator== (const Iterator& rhs) const
+        {
+            return ((map_ == rhs.map_) && (pos_ == rhs.pos_));
+        }
+
+        bool operator!= (const Iterator& rhs) const
+        {
+            return ((map_ != rhs.map_) || (pos_ != rhs.pos_));
+        }
+
+        Iterator& operator++ ()
+        {
+            pos_ = map_->slots_[pos_].next_;
+
+            return *this;
+        }
+
+        Iterator operator++ (int)
+        {
+            Iterator old (*this);
+            pos_ = map_->slots_[pos_].next_;
+
+            return old;
+        }
+
+        /**
+        * Preposting decrement operator, the end sentry steps to the last record
+        */
+        Iterator& operator-- ()
+        {
+            pos_ = (NIL != pos_) ? map_->slots_[pos_].prev_ : map_->last_;
+
+            return *this;
+        }
+
+        Iterator operator-- (int)
+        {
+            Iterator old (*this);
+            pos_ = (NIL != pos_) ? map_->slots_[pos_].prev_ : map_->last_;
+
+            return old;
+        }
+
+    private:
+        explicit Iterator (FlatLinkedHashMap* map, uint32_t pos)
+            : map_ (map)
+            , pos_ (pos)
+        {
+        }
+
+        friend class FlatLinkedHashMap;
+        FlatLinkedHashMap* map_;	// the container
+        uint32_t pos_;				// the slot of the current record
+    };
+
+public:
+    /**
+    * Constructor
+    *
+    * @param [in] num the expected number of records
+    */
+    explicit FlatLinkedHashMap (size_t num = 0)
+        : slots_ (nullptr)
+        , mask_ (0)
+        , first_ (NIL)
+        , last_ (NIL)
+        , count_ (0)
+    {
+        size_t snum = MAP_DEFAULT_SLOT_NUM;
+        while (snum * 4 < num * 5) {
+            snum <<= 1;
+        }
+
+        slots_ = AllocSlots (snum);
+        mask_ = snum - 1;
+    }
+
+    /**
+    * Destructor
+    */
+    ~FlatLinkedHashMap ()
+    {
+        Clear ();
+        FreeSlots (slots_, mask_ + 1);
+    }
+
+    /**
+    * Store a record
+    *
+    * @param [in] key the key
+    * @param [in] value the value
+    * @param [in] mode the moving mode
+    *
+    * @return the pointer to the value of the stored record
+    */
+    VALUE* Set (const KEY& key, const VALUE& value, MoveMode mode)
+    {
+        uint32_t hash = Hash (key);
+        uint32_t pos = Lookup (key, hash);
+        if (NIL != pos) {
+            At (pos).value_ = value;
+            Move (pos, mode);
+
+            return &At (pos).value_;
+        }
+
+        // key or value may live in this map, copy them before any record
+        // moves or the table is freed
+        Record rec (key, value);
+        if ((count_ + 1) * 5 > (mask_ + 1) * 4) {
+            Rehash ((mask_ + 1) * 2);
+        }
+
+        pos = Place (hash);
+        new (&slots_[pos].rec_) Record (std::move (rec));
+        if (MM_FIRST == mode) {
+            LinkFirst (pos);
+        }
+        else {
+            LinkLast (pos);
+        }
+        ++count_;
+
+        return &At (pos).value_;
+    }
+
+    /**
+    * Remove a record
+    *
+    * @param [in] key the key
+    *
+    * @return true on success, of false on failure
+    */
+    bool Remove (const KEY& key)
+    {
+        uint32_t pos = Lookup (key, Hash (key));
+        if (NIL == pos) {
+            return false;
+        }
+
+        Unlink (pos);
+        At (pos).~Record ();
+        slots_[pos].used_ = 0;
+        --count_;
+
+        // shift the rest of the run back by one
+        uint32_t next = (pos + 1) & mask_;
+        while (slots_[next].used_ && Distance (next) > 0) {
+            Shift (next, pos);
+            pos = next;
+            next = (next + 1) & mask_;
+        }
+
+        return true;
+    }
+
+    /**
+    * Migrate a record to another map
+    *
+    * @param [in] key the key
+    * @param [in] dist the destination map
+    * @param [in] mode the moving mode
+    *
+    * @return the pointer to the value of the migrated record, or zero on failure
+    */
+    VALUE* Migrate (const KEY& key,
+                    FlatLinkedHashMap* dist,
+                    MoveMode mode)
+    {
+        uint32_t pos = Lookup (key, Hash (key));
+        if (NIL == pos) {
+            return nullptr;
+        }
+
+        VALUE* value = dist->Set (At (pos).key_, At (pos).value_, mode);
+        Remove (key);
+
+        return value;
+    }
+
+    /**
+    * Retrieve a record
+    *
+    * @param [in] key the key
+    * @param [in] mode the moving mode
+    *
+    * @return the pointer to the value of the corresponding record, or zero on failure
+    */
+    VALUE* Get (const KEY& key, MoveMode mode)
+    {
+        uint32_t pos = Lookup (key, Hash (key));
+        if (NIL == pos) {
+            return nullptr;
+        }
+
+        Move (pos, mode);
+
+        return &At (pos).value_;
+    }
+
+    /**
+    * Remove all records
+    */
+    void Clear ()
+    {
+        for (uint32_t pos = first_; NIL != pos; pos = slots_[pos].next_) {
+            At (pos).~Record ();
+            slots_[pos].used_ = 0;
+        }
+
+        first_ = NIL;
+        last_ = NIL;
+        count_ = 0;
+    }
+
+    /**
+    * Get the number of records
+    */
+    size_t Count () const
+    {
+        return count_;
+    }
+
+    /**
+    * Get an iterator at the first record
+    */
+    Iterator Begin ()
+    {
+        return Iterator (this, first_);
+    }
+
+    /**
+    * Get an iterator of the end sentry.
+    */
+    Iterator End ()
+    {
+        return Iterator (this, NIL);
+    }
+
+    /**
+    * Get an iterator at a record
+    *
+    * @param [in] key the key
+    *
+    * @return an iterator at the record, or the end sentry on failure
+    */
+    Iterator Find (const KEY& key)
+    {
+        return Iterator (this, Lookup (key, Hash (key)));
+    }
+
+    const KEY& FirstKey () const
+    {
+        return At (first_).key_;
+    }
+
+    VALUE& FirstValue () const
+    {
+        return At (first_).value_;
+    }
+
+    const KEY& LastKey () const
+    {
+        return At (last_).key_;
+    }
+
+    VALUE& LastValue () const
+    {
+        return At (last_).value_;
+    }
+
+private:
+    Record& At (uint32_t pos) const
+    {
+        return *reinterpret_cast<Record*> (&slots_[pos].rec_);
+    }
+
+    uint32_t Hash (const KEY& key) const
+    {
+        // std::hash of integers is the identity, mix before taking the low bits
+        return static_cast<uint32_t> (fmix64 (static_cast<uint64_t> (hash_ (key))));
+    }
+
+    /**
+    * Get how far a record is from its home slot
+    */
+    size_t Distance (uint32_t pos) const
+    {
+        return (pos - slots_[pos].hash_) & mask_;
+    }
+
+    /**
+    * Find the slot of a key
+    *
+    * @return the slot, or NIL if not found
+    */
+    uint32_t Lookup (const KEY& key, uint32_t hash) const
+    {
+        uint32_t pos = hash & mask_;
+        for (size_t dist = 0; ; ++dist) {
+            const Slot& slot = slots_[pos];
+            // a record closer to its home than we are to ours ends the run
+            if (!slot.used_ || Distance (pos) < dist) {
+                return NIL;
+            }
+
+            if (slot.hash_ == hash && _equalto (At (pos).key_, key)) {
+                return pos;
+            }
+
+            pos = (pos + 1) & mask_;
+        }
+    }
+
+    /**
+    * Free the slot a new record of hash belongs to, shifting the records
+    * from there up to the next free slot forward by one
+    *
+    * @return the free slot, with hash_ and used_ set
+    */
+    uint32_t Place (uint32_t hash)
+    {
+        uint32_t pos = hash & mask_;
+        for (size_t dist = 0; slots_[pos].used_ && Distance (pos) >= dist; ++dist) {
+            pos = (pos + 1) & mask_;
+        }
+
+        uint32_t free = pos;
+        while (slots_[free].used_) {
+            free = (free + 1) & mask_;
+        }
+
+        while (free != pos) {
+            uint32_t prev = (free - 1) & mask_;
+            Shift (prev, free);
+            free = prev;
+        }
+
+        slots_[pos].hash_ = hash;
+        slots_[pos].used_ = 1;
+
+        return pos;
+    }
+
+    /**
+    * Move a record from a slot to a free one, keeping the order links
+    */
+    void Shift (uint32_t from, uint32_t to)
+    {
+        Slot& src = slots_[from];
+        Slot& dst = slots_[to];
+        new (&dst.rec_) Record (std::move (At (from)));
+        At (from).~Record ();
+
+        dst.hash_ = src.hash_;
+        dst.used_ = 1;
+        dst.prev_ = src.prev_;
+        dst.next_ = src.next_;
+        src.used_ = 0;
+
+        if (NIL != dst.prev_) slots_[dst.prev_].next_ = to;
+        else                  first_ = to;
+        if (NIL != dst.next_) slots_[dst.next_].prev_ = to;
+        else                  last_ = to;
+    }
+
+    /**
+    * Move every record to a table of snum slots, in order
+    */
+    void Rehash (size_t snum)
+    {
+        Slot* old = slots_;
+        size_t onum = mask_ + 1;
+        uint32_t pos = first_;
+
+        slots_ = AllocSlots (snum);
+        mask_ = snum - 1;
+        first_ = NIL;
+        last_ = NIL;
+
+        while (NIL != pos) {
+            Record& rec = *reinterpret_cast<Record*> (&old[pos].rec_);
+            uint32_t to = Place (old[pos].hash_);
+            new (&slots_[to].rec_) Record (std::move (rec));
+            rec.~Record ();
+            LinkLast (to);
+            pos = old[pos].next_;
+        }
+
+        FreeSlots (old, onum);
+    }
+
+    static Slot* AllocSlots (size_t snum)
+    {
+        assert (snum <= (size_t (1) << 32));
+        if (snum >= MIN_MAPZMAP_SLOT_NUM) {
+            // fresh anonymous pages are zero, i.e. free slots, and page aligned
+            // unlike detail::MapAlloc, which puts the size in front
+            void* ptr = ::mmap (0, sizeof(Slot) * snum, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (MAP_FAILED == ptr) {
+                throw std::bad_alloc ();
+            }
+
+            return (Slot*)ptr;
+        }
+
+        return new Slot[snum]();
+    }
+
+    static void FreeSlots (Slot* slots, size_t snum)
+    {
+        if (snum >= MIN_MAPZMAP_SLOT_NUM) {
+            ::munmap (slots, sizeof(Slot) * snum);
+        }
+        else {
+            delete [] slots;
+        }
+    }
+
+    void LinkFirst (uint32_t pos)
+    {
+        Slot& slot = slots_[pos];
+        slot.prev_ = NIL;
+        slot.next_ = first_;
+        if (NIL != first_) slots_[first_].prev_ = pos;
+        if (NIL == last_)  last_ = pos;
+        first_ = pos;
+    }
+
+    void LinkLast (uint32_t pos)
+    {
+        Slot& slot = slots_[pos];
+        slot.prev_ = last_;
+        slot.next_ = NIL;
+        if (NIL != last_)  slots_[last_].next_ = pos;
+        if (NIL == first_) first_ = pos;
+        last_ = pos;
+    }
+
+    void Unlink (uint32_t pos)
+    {
+        Slot& slot = slots_[pos];
+        if (NIL != slot.prev_) slots_[slot.prev_].next_ = slot.next_;
+        if (NIL != slot.next_) slots_[slot.next_].prev_ = slot.prev_;
+        if (first_ == pos)     first_ = slot.next_;
+        if (last_ == pos)      last_ = slot.prev_;
+    }
+
+    void Move (uint32_t pos, MoveMode mode)
+    {
+        if (MM_FIRST == mode && first_ != pos) {
+            Unlink (pos);
+            LinkFirst (pos);
+        }
+        else if (MM_LAST == mode && last_ != pos) {
+            Unlink (pos);
+            LinkLast (pos);
+        }
+    }
+
+private:
+    HASH hash_;			// the functor of the hash function
+    EQUALTO _equalto;	// the functor of the equalto function
+    Slot* slots_;		// the table
+    size_t mask_;		// the number of slots minus one
+    uint32_t first_;	// the slot of the first record
+    uint32_t last_;		// the slot of the last record
+    size_t count_;		// the number of records
+};
+
+} // namespace swift
+#endif //__SWIFT_BASE_FLAT_LINKED_HASH_MAP_H__
@@ -16,10 +16,14 @@
 #define __SWIFT_BASE_LINKED_HASH_MAP_H__
 
 #include <hash_map>
+#include <new>
+#include <memory>
+#include <utility>
 #include <limits> // numeric_limits
 #include <assert.h>
 
 #include "swift/base/noncopyable.hpp"
+#include "swift/base/slaballocator.h"
 
 namespace swift {
 namespace detail {
@@ -30,15 +34,29 @@ namespace detail {
 
 /**
  * Doubly-linked hash map
+ *
+ * The table grows once there are more records than buckets. Like Redis, it
+ * rehashes incrementally: the new table is allocated at once, and every
+ * following operation moves a bucket of the old one over, so no single Set
+ * pays for moving all records. Lookups check the old table for the buckets
+ * not moved yet.
+ *
+ * Records are allocated with ALLOCATOR, rebound to the record type. The
+ * default SlabAllocator gives every map its own pool, so records removed
+ * from an LRU-like map are reused by the next insertions instead of going
+ * back to malloc.
+ *
  * @param KEY the key type
  * @param VALUE the value type
  * @param HASH the hash functor
  * @param EQUALTO the equality checking functor
+ * @param ALLOCATOR the allocator of records
  */
 template <class KEY,
           class VALUE,
           class HASH = std::hash<KEY>,
-          class EQUALTO = std::equal_to<KEY> >
+          class EQUALTO = std::equal_to<KEY>,
+          class ALLOCATOR = swift::SlabAllocator<std::pair<const KEY, VALUE> > >
 class LinkedHashMap : swift::noncopyable
 {
 private:
@@ -50,9 +68,10 @@ private:
         Record* prev_;	// previous record
         Record* next_;	// next record
 
-        explicit Record (const KEY& k, const VALUE& v)
-            : key_ (k)
-            , value_ (v)
+        template <class K, class... ARGS>
+        explicit Record (K&& k, ARGS&&... args)
+            : key_ (std::forward<K> (k))
+            , value_ (std::forward<ARGS> (args)...)
             , child_ (nullptr)
             , prev_ (nullptr)
             , next_ (nullptr)
@@ -60,6 +79,8 @@ private:
         }
     };
 
+    typedef typename std::allocator_traits<ALLOCATOR>::template rebind_alloc<Record> RecordAllocator;
+
     //
     // The default bucket number of hash table
     //
@@ -70,6 +91,13 @@ private:
     //
     static const size_t MIN_MAPZMAP_BUCKET_NUM = 32768;
 
+    //
+    // The number of buckets moved to the new table by each operation while
+    // rehashing, and how many empty ones it may skip per moved bucket
+    //
+    static const size_t MAP_REHASH_STEP_BUCKET_NUM = 1;
+    static const size_t MAP_REHASH_EMPTY_VISIT_NUM = 10;
+
 public:
     /**
     * Moving Modes
@@ -248,6 +276,9 @@ public:
         , last_ (nullptr)
         , bnum_ (MAP_DEFAULT_BUCKET_NUM)
         , count_ (0)
+        , old_buckets_ (nullptr)
+        , old_bnum_ (0)
+        , rehash_idx_ (0)
     {
         if (bnum_ < 1) {
             bnum_ = MAP_DEFAULT_BUCKET_NUM;
@@ -259,14 +290,19 @@ public:
     /**
     * Constructor
     *
-    * @param [in] bnum the number of buckets of the hash table
+    * @param [in] bnum the initial number of buckets of the hash table
+    * @param [in] alloc the allocator of records
     */
-    explicit LinkedHashMap (size_t bnum)
-        : buckets_ (nullptr)
+    explicit LinkedHashMap (size_t bnum, const ALLOCATOR& alloc = ALLOCATOR ())
+        : alloc_ (alloc)
+        , buckets_ (nullptr)
         , first_ (nullptr)
         , last_ (nullptr)
         , bnum_ (bnum)
         , count_ (0)
+        , old_buckets_ (nullptr)
+        , old_bnum_ (0)
+        , rehash_idx_ (0)
     {
         if (bnum_ < 1) {
             bnum_ = MAP_DEFAULT_BUCKET_NUM;
@@ -294,92 +330,53 @@ public:
     */
     VALUE* Set (const KEY& key, const VALUE& value, MoveMode mode)
     {
-        size_t bidx = hash_ (key) % bnum_;
-        Record* rec = buckets_[bidx];
-        Record** entp = buckets_ + bidx;
-
-        while (rec) {
-            if (_equalto (rec->key_, key)) {
-                rec->value_ = value;
-                switch (mode) {
-                default:
-                {
-                    break;
-                }
-                case MM_FIRST:
-                {
-                    if (first_ != rec) {
-                        if (last_ == rec) last_ = rec->prev_;
-                        if (rec->prev_)    rec->prev_->next_ = rec->next_;
-                        if (rec->next_)    rec->next_->prev_ = rec->prev_;
-                        rec->prev_ = 0;
-                        rec->next_ = first_;
-                        first_->prev_ = rec;
-                        first_ = rec;
-                    }
-
-                    break;
-                }
-                case MM_LAST:
-                {
-                    if (last_ != rec) {
-                        if (first_ == rec) {
-                            first_ = rec->next_;
-                        }
-
-                        if (rec->prev_) {
-                            rec->prev_->next_ = rec->next_;
-                        }
-
-                        if (rec->next_) {
-                            rec->next_->prev_ = rec->prev_;
-                        }
-
-                        rec->prev_ = nullptr;
-                        rec->next_ = first_;
-                        first_->prev_ = rec;
-                        first_ = rec;
-                    }
-
-                    break;
-                } // end MM_LAST
-                } // end switch  (mode)
+        return Store (key, value, mode);
+    }
 
-                return &rec->value_;
-            } // end if _equalto (rec->key, key)
-            else {
-                entp = &rec->child_;
-                rec = rec->child_;
-            }
-        } // end while (rec)
+    /**
+    * Store a record, moving the value in
+    */
+    VALUE* Set (const KEY& key, VALUE&& value, MoveMode mode)
+    {
+        return Store (key, std::move (value), mode);
+    }
 
-        rec = new Record (key, value);
-        switch (mode) {
-        default:
-        {
-            rec->prev_ = last_;
-            if (!first_) first_ = rec;
-            if (last_)   last_->next_ = rec;
-            last_ = rec;
+    /**
+    * Store a record, moving the key and the value in
+    */
+    VALUE* Set (KEY&& key, VALUE&& value, MoveMode mode)
+    {
+        return Store (std::move (key), std::move (value), mode);
+    }
 
-            break;
-        }
-        case MM_FIRST:
-        {
-            rec->next_ = first_;
-            if (!last_) last_ = rec;
-            if (first_) first_->prev_ = rec;
-            first_ = rec;
+    /**
+    * Store a record whose value is constructed in place from args, unless
+    * the key is already there
+    *
+    * @param [in] key the key
+    * @param [in] mode the moving mode
+    * @param [in] args the arguments of the constructor of the value
+    *
+    * @return the pointer to the value of the record, and true if it was
+    *         inserted, or false if the existing record was left untouched
+    */
+    template <class... ARGS>
+    std::pair<VALUE*, bool> Emplace (const KEY& key, MoveMode mode, ARGS&&... args)
+    {
+        RehashStep ();
+        Record** entp = Locate (key);
+        Record* rec = *entp;
+        if (rec) {
+            Move (rec, mode);
 
-            break;
+            return std::make_pair (&rec->value_, false);
         }
-        } // end switch mode
 
-        *entp = rec;
-        ++count_;
+        rec = NewRecord (key, std::forward<ARGS> (args)...);
+        Insert (entp, rec, mode);
 
-        return &rec->value_;
-    } // end Set function
+        return std::make_pair (&rec->value_, true);
+    }
 
     /**
     * Remove a record
@@ -390,29 +387,19 @@ public:
     */
     bool Remove (const KEY& key)
     {
-        size_t bidx = hash_ (key) % bnum_;
-        Record* rec = buckets_[bidx];
-        Record** entp = buckets_ + bidx;
-        while (rec) {
-            if (_equalto (rec->key_, key)) {
-                if (rec->prev_)     rec->prev_->next_ = rec->next_;
-                if (rec->next_)     rec->next_->prev_ = rec->prev_;
-                if (rec == first_) first_ = rec->next_;
-                if (rec == last_)  last_ = rec->prev_;
-                *entp = rec->child_;
-                --count_;
-                delete rec;
-                rec = nullptr;
-
-                return true;
-            }
-            else {
-                entp = &rec->child_;
-                rec = rec->child_;
-            }
-        } // end while rec
+        RehashStep ();
+        Record** entp = Locate (key);
+        Record* rec = *entp;
+        if (!rec) {
+            return false;
+        }
 
-        return false;
+        *entp = rec->child_;
+        Unlink (rec);
+        --count_;
+        DeleteRecord (rec);
+
+        return true;
     }
 
     /**
@@ -428,121 +415,30 @@ public:
                     LinkedHashMap* dist,
                     MoveMode mode)
     {
-        size_t hash = hash_ (key);
-        size_t bidx = hash % bnum_;
-        Record* rec = buckets_[bidx];
-        Record** entp = buckets_ + bidx;
-        while (rec) {
-            if (_equalto (rec->key_, key)) {
-                if (rec->prev_)		rec->prev_->next_ = rec->next_;
-                if (rec->next_)		rec->next_->prev_ = rec->prev_;
-                if (rec == first_)	first_ = rec->next_;
-                if (rec == last_)	last_ = rec->prev_;
-                *entp = rec->child_;
-                --count_;
-                rec->child_ = nullptr;
-                rec->prev_ = nullptr;
-                rec->next_ = nullptr;
-
-                bidx = hash % dist->bnum_;
-                Record* drec = dist->buckets_[bidx];
-                entp = dist->buckets_ + bidx;
-
-                while (drec) {
-                    if (dist->_equalto (drec->key_, key)) {
-                        if (drec->child_) rec->child_ = drec->child_;
-
-                        if (drec->prev_) {
-                            rec->prev_ = drec->prev_;
-                            rec->prev_->next_ = rec;
-                        }
-
-                        if (drec->next_) {
-                            rec->next_ = drec->next_;
-                            rec->next_->prev_ = rec;
-                        }
-
-                        if (dist->first_ == drec) dist->first_ = rec;
-                        if (dist->last_ == drec)  dist->last_ = rec;
-                        *entp = rec;
-                        delete drec;
-                        drec = nullptr;
-
-                        switch (mode) {
-                        default:
-                        {
-                            break;
-                        }
-                        case MM_FIRST:
-                        {
-                            if (dist->first_ != rec) {
-                                if (dist->last_ == rec) dist->last_ = rec->prev_;
-                                if (rec->prev_)			rec->prev_->next_ = rec->next_;
-                                if (rec->next_)			rec->next_->prev_ = rec->prev_;
-                                rec->prev_ = nullptr;
-                                rec->next_ = dist->first_;
-                                dist->first_->prev_ = rec;
-                                dist->first_ = rec;
-                            }
-
-                            break;
-                        }
-                        case MM_LAST:
-                        {
-                            if (dist->last_ != rec) {
-                                if (dist->first_ == rec) dist->first_ = rec->next_;
-                                if (rec->prev_)			 rec->prev_->next_ = rec->next_;
-                                if (rec->next_)			 rec->next_->prev_ = rec->prev_;
-                                rec->prev_ = dist->last_;
-                                rec->next_ = nullptr;
-                                dist->last_->next_ = rec;
-                                dist->last_ = rec;
-                            }
-
-                            break;
-                        }
-                        } // end switch (mode)
-
-                        return &rec->value;
-                    } // end if (dist->_equalto (drec->key, key))
-
-                    entp = &drec->child_;
-                    drec = drec->child_;
-                } // end while (drec)
-
-                switch (mode) {
-                default:
-                {
-                    rec->prev_ = dist->last_;
-                    if (!dist->first_) dist->first_ = rec;
-                    if (dist->last_)   dist->last_->next_ = rec;
-                    dist->last_ = rec;
-
-                    break;
-                }
-                case MM_FIRST:
-                {
-                    rec->next_ = dist->first_;
-                    if (!dist->last_) dist->last_ = rec;
-                    if (dist->first_) dist->first_->prev_ = rec;
-                    dist->first_ = rec;
-
-                    break;
-                }
-                } // end switch (mode)
+        RehashStep ();
+        Record** entp = Locate (key);
+        Record* rec = *entp;
+        if (!rec) {
+            return nullptr;
+        }
+        if (dist == this) {
+            Move (rec, mode);
+            return &rec->value_;
+        }
 
-                *entp = rec;
-                ++dist->count_;
+        // the record is rebuilt from dist's allocator, so each map frees
+        // only what it allocated. It leaves this map only once dist holds
+        // it, and is copied if moving could throw, so a throw loses nothing.
+        // Storing into dist leaves this map and so entp untouched
+        VALUE* value = dist->Store (std::move_if_noexcept (rec->key_),
+                                    std::move_if_noexcept (rec->value_), mode);
 
-                return &rec->value_;
-            } // end if _equalte (rec->key, key)
-            else {
-                entp = &rec->child_;
-                rec = rec->child_;
-            }
-        } // end while (rec)
+        *entp = rec->child_;
+        Unlink (rec);
+        --count_;
+        DeleteRecord (rec);
 
-        return nullptr;
+        return value;
     }
 
     /**
@@ -555,54 +451,16 @@ public:
     */
     VALUE* Get (const KEY& key, MoveMode mode)
     {
-        size_t bidx = hash_ (key) % bnum_;
-        Record* rec = buckets_[bidx];
-
-        while (rec) {
-            if (_equalto (rec->key_, key)) {
-                switch (mode) {
-                default:
-                {
-                    break;
-                }
-                case MM_FIRST:
-                {
-                    if (first_ != rec) {
-                        if (last_ == rec) last_ = rec->prev_;
-                        if (rec->prev_)	  rec->prev_->next_ = rec->next_;
-                        if (rec->next_)	  rec->next_->prev_ = rec->prev_;
-                        rec->prev_ = nullptr;
-                        rec->next_ = first_;
-                        first_->prev_ = rec;
-                        first_ = rec;
-                    }
-
-                    break;
-                }
-                case MM_LAST:
-                {
-                    if (last_ != rec) {
-                        if (first_ == rec) first_ = rec->next_;
-                        if (rec->prev_)	   rec->prev_->next_ = rec->next_;
-                        if (rec->next_)	   rec->next_->prev_ = rec->prev_;
-                        rec->prev_ = last_;
-                        rec->next_ = nullptr;
-                        last_->next_ = rec;
-                        last_ = rec;
-                    }
-
-                    break;
-                }
-                } // end switch (mode)
+        RehashStep ();
+        Record** entp = Locate (key);
+        Record* rec = *entp;
+        if (!rec) {
+            return nullptr;
+        }
 
-                return &rec->value_;
-            } // end if (_equalto (rec->key, key))
-            else {
-                rec = rec->child_;
-            }
-        } // end while (rec)
+        Move (rec, mode);
 
-        return nullptr;
+        return &rec->value_;
     } // end Get
 
     /**
@@ -615,7 +473,7 @@ public:
         Record* rec = last_;
         while (rec) {
             Record* prev = rec->prev_;
-            delete rec;
+            DeleteRecord (rec);
             rec = prev;
         }
 
@@ -623,9 +481,15 @@ public:
             buckets_[i] = nullptr;
         }
 
+        if (old_buckets_) {
+            FreeBuckets (old_buckets_, old_bnum_);
+            old_buckets_ = nullptr;
+            old_bnum_ = 0;
+        }
+
         first_ = nullptr;
         last_ = nullptr;
-        count_ = nullptr;
+        count_ = 0;
     } // end Clear Function
 
     /**
@@ -636,6 +500,26 @@ public:
         return count_;
     }
 
+    /**
+    * Make room for num records at once, so that the map does not rehash
+    * until it holds more than that
+    *
+    * @param [in] num the expected number of records
+    */
+    void Reserve (size_t num)
+    {
+        while (old_buckets_) {
+            RehashStep ();
+        }
+
+        if (num > bnum_) {
+            StartRehash (num);
+            while (old_buckets_) {
+                RehashStep ();
+            }
+        }
+    }
+
     /**
     * Get an iterator at the first record
     */
@@ -661,17 +545,9 @@ public:
     */
     Iterator Find (const KEY& key)
     {
-        Record* rec = buckets_[hash_ (key) % bnum_];
-        while (rec) {
-            if (_equalto (rec->key_, key)) {
-                return Iterator (this, rec);
-            }
-            else {
-                rec = rec->child_;
-            }
-        }
+        RehashStep ();
 
-        return Iterator (this, nullptr);
+        return Iterator (this, *Locate (key));
 
     }
 
@@ -716,19 +592,246 @@ public:
     }
 
 private:
+    /**
+    * Find the link to a record
+    *
+    * @param [in] key the key
+    *
+    * @return the link pointing to the record, or to null at the end of the
+    *         chain the record would belong to
+    */
+    Record** Locate (const KEY& key) const
+    {
+        Record** entp = Bucket (hash_ (key));
+        while (*entp && !_equalto ((*entp)->key_, key)) {
+            entp = &(*entp)->child_;
+        }
+
+        return entp;
+    }
+
+    /**
+    * Store a record, forwarding the key and the value
+    */
+    template <class K, class V>
+    VALUE* Store (K&& key, V&& value, MoveMode mode)
+    {
+        RehashStep ();
+        Record** entp = Locate (key);
+        Record* rec = *entp;
+        if (rec) {
+            rec->value_ = std::forward<V> (value);
+            Move (rec, mode);
+
+            return &rec->value_;
+        }
+
+        rec = NewRecord (std::forward<K> (key), std::forward<V> (value));
+        Insert (entp, rec, mode);
+
+        return &rec->value_;
+    }
+
+    /**
+    * Link a new record at the end of its chain and in the order, first with
+    * MM_FIRST, last otherwise
+    */
+    void Insert (Record** entp, Record* rec, MoveMode mode)
+    {
+        if (MM_FIRST == mode) {
+            rec->next_ = first_;
+            if (!last_) last_ = rec;
+            if (first_) first_->prev_ = rec;
+            first_ = rec;
+        }
+        else {
+            rec->prev_ = last_;
+            if (!first_) first_ = rec;
+            if (last_)   last_->next_ = rec;
+            last_ = rec;
+        }
+
+        *entp = rec;
+        ++count_;
+        Grow ();
+    }
+
+    /**
+    * Take a record out of the order
+    */
+    void Unlink (Record* rec)
+    {
+        if (rec->prev_)    rec->prev_->next_ = rec->next_;
+        if (rec->next_)    rec->next_->prev_ = rec->prev_;
+        if (rec == first_) first_ = rec->next_;
+        if (rec == last_)  last_ = rec->prev_;
+        rec->prev_ = nullptr;
+        rec->next_ = nullptr;
+    }
+
+    /**
+    * Move a record to the front with MM_FIRST or to the back with MM_LAST
+    */
+    void Move (Record* rec, MoveMode mode)
+    {
+        if (MM_FIRST == mode && first_ != rec) {
+            Unlink (rec);
+            rec->next_ = first_;
+            first_->prev_ = rec;
+            first_ = rec;
+        }
+        else if (MM_LAST == mode && last_ != rec) {
+            Unlink (rec);
+            rec->prev_ = last_;
+            last_->next_ = rec;
+            last_ = rec;
+        }
+    }
+
+    template <class... ARGS>
+    Record* NewRecord (ARGS&&... args)
+    {
+        Record* rec = alloc_.allocate (1);
+        try {
+            new (rec) Record (std::forward<ARGS> (args)...);
+        }
+        catch (...) {
+            alloc_.deallocate (rec, 1);
+            throw;
+        }
+
+        return rec;
+    }
+
+    void DeleteRecord (Record* rec)
+    {
+        rec->~Record ();
+        alloc_.deallocate (rec, 1);
+    }
+
     /**
     * Initialize fields
     */
     void Initialize ()
     {
-        if (bnum_ >= MIN_MAPZMAP_BUCKET_NUM) {
-            buckets_ = (Record**)detail::MapAlloc (sizeof(*buckets_) * bnum_);
+        buckets_ = AllocBuckets (bnum_);
+    }
+
+    /**
+    * Allocate an empty bucket array
+    */
+    static Record** AllocBuckets (size_t bnum)
+    {
+        if (bnum >= MIN_MAPZMAP_BUCKET_NUM) {
+            return (Record**)detail::MapAlloc (sizeof(Record*) * bnum);
+        }
+
+        Record** buckets = new Record*[bnum];
+        for (size_t i = 0; i < bnum; ++i) {
+            buckets[i] = nullptr;
+        }
+
+        return buckets;
+    }
+
+    /**
+    * Free a bucket array
+    */
+    static void FreeBuckets (Record** buckets, size_t bnum)
+    {
+        if (bnum >= MIN_MAPZMAP_BUCKET_NUM) {
+            detail::MapFree (buckets);
         }
         else {
-            buckets_ = new Record*[bnum_];
-            for (size_t i = 0; i < bnum_; ++i) {
-                buckets_[i] = nullptr;
+            delete [] buckets;
+        }
+    }
+
+    /**
+    * Get the bucket of a hash value. While rehashing, the buckets of the old
+    * table below rehash_idx_ are already moved to the new one.
+    *
+    * @param [in] hash the hash value of the key
+    *
+    * @return the pointer to the head of the chain
+    */
+    Record** Bucket (size_t hash) const
+    {
+        if (old_buckets_) {
+            size_t bidx = hash % old_bnum_;
+            if (bidx >= rehash_idx_) {
+                return old_buckets_ + bidx;
+            }
+        }
+
+        return buckets_ + hash % bnum_;
+    }
+
+    /**
+    * Start rehashing when there are more records than buckets
+    */
+    void Grow ()
+    {
+        if (count_ > bnum_ && !old_buckets_) {
+            StartRehash (bnum_ * 2 + 1);
+        }
+    }
+
+    /**
+    * Switch to a new table of bnum buckets, the records are moved over by
+    * the following operations
+    *
+    * @param [in] bnum the number of buckets of the new table
+    */
+    void StartRehash (size_t bnum)
+    {
+        old_buckets_ = buckets_;
+        old_bnum_ = bnum_;
+        rehash_idx_ = 0;
+        buckets_ = AllocBuckets (bnum);
+        bnum_ = bnum;
+    }
+
+    /**
+    * Move a few buckets of the old table to the new one, and free the old
+    * table once it is empty
+    */
+    void RehashStep ()
+    {
+        if (!old_buckets_) {
+            return;
+        }
+
+        size_t moved = 0;
+        size_t empty_visits = MAP_REHASH_STEP_BUCKET_NUM * MAP_REHASH_EMPTY_VISIT_NUM;
+        while (moved < MAP_REHASH_STEP_BUCKET_NUM && rehash_idx_ < old_bnum_) {
+            Record* rec = old_buckets_[rehash_idx_];
+            if (!rec) {
+                ++rehash_idx_;
+                if (0 == --empty_visits) {
+                    break;
+                }
+
+                continue;
+            }
+
+            while (rec) {
+                Record* child = rec->child_;
+                Record** entp = buckets_ + hash_ (rec->key_) % bnum_;
+                rec->child_ = *entp;
+                *entp = rec;
+                rec = child;
             }
+
+            old_buckets_[rehash_idx_++] = nullptr;
+            ++moved;
+        }
+
+        if (rehash_idx_ >= old_bnum_) {
+            FreeBuckets (old_buckets_, old_bnum_);
+            old_buckets_ = nullptr;
+            old_bnum_ = 0;
+            rehash_idx_ = 0;
         }
     }
 
@@ -740,22 +843,23 @@ private:
         Record* rec = last_;
         while (rec) {
             Record* prev = rec->prev_;
-            delete rec;
+            DeleteRecord (rec);
             rec = prev;
         }
 
-        if (bnum_ >= MIN_MAPZMAP_BUCKET_NUM) {
-            detail::MapFree (buckets_);
+        if (buckets_) {
+            FreeBuckets (buckets_, bnum_);
+            buckets_ = nullptr;
         }
-        else {
-            if (buckets_) {
-                delete [] buckets_;
-                buckets_ = nullptr;
-            }
+
+        if (old_buckets_) {
+            FreeBuckets (old_buckets_, old_bnum_);
+            old_buckets_ = nullptr;
         }
     }
 
 private:
+    RecordAllocator alloc_;	// the allocator of records
     HASH hash_;			// the functor of the hash function
     EQUALTO _equalto;	// the functor of the equalto function
     Record** buckets_;  // the backet array
@@ -763,6 +867,9 @@ private:
     Record* last_;		// the lash record
     size_t bnum_;		// the number of backets
     size_t count_;		// the number of records
+    Record** old_buckets_;	// the table being rehashed from, or null
+    size_t old_bnum_;		// the number of buckets of the old table
+    size_t rehash_idx_;		// the next bucket of the old table to move
 
 };
 
@@ -19,6 +19,8 @@
 #include <unordered_map>
 #include <mutex>
 
+#include "swift/base/cache_metrics.hpp"
+
 namespace swift {
 
 template<typename KeyType, typename ValueType>
@@ -32,11 +34,17 @@ class LruCache {
   void Set(const KeyType& key, const ValueType& value);
   bool Get(const KeyType& key, ValueType& value);
 
+  // hit, miss and eviction counts, and the optional miss ratio curve; the
+  // counts take no ThreadLocalPtr id, an enabled curve takes one until the
+  // cache is destroyed
+  CacheMetrics<KeyType>& Metrics() { return metrics_; }
+
 private:
   std::mutex mutex_;
   size_t capacity_;
   std::list<KeyValuePairType> cache_items_list_;
   std::unordered_map<KeyType, ListIteratorType> cache_items_map_;
+  CacheMetrics<KeyType> metrics_;
 };
 
 template<typename KeyType, typename ValueType>
@@ -60,6 +68,7 @@ void swift::LruCache<KeyType, ValueType>::Set(const KeyType& key, const ValueTyp
   if (cache_items_map_.size() > capacity_) {
     cache_items_map_.erase(cache_items_list_.back().first);
     cache_items_list_.pop_back();
+    metrics_.Evict();
   }
 }
 
@@ -69,8 +78,10 @@ bool swift::LruCache<KeyType, ValueType>::Get(const KeyType& key, ValueType& val
 
   auto it = cache_items_map_.find(key);
   if (it == cache_items_map_.end()) {
+    metrics_.Miss(key);
     return false;
   } else {
+    metrics_.Hit(key);
     cache_items_list_.splice(cache_items_list_.begin(), cache_items_list_, it->second);
     value = it->second->second;
     return true;
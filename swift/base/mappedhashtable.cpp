@@ -0,0 +1,465 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/mman.h>
+#include <string.h>
+#include <vector>
+
+#include "swift/base/mappedhashtable.h"
+#include "swift/base/crc32.h"
+#include "swift/base/murmurhash3.h"
+
+namespace swift {
+namespace {
+
+const uint64_t kMagic = 0x5441484d54465753ULL;  // "SWFTMHAT"
+
+// the header has a page of its own, so it is flushed alone
+const size_t kHeaderSize = 4096;
+
+enum SlotState
+{
+    SLOT_EMPTY = 0,
+    SLOT_USED = 1,
+    SLOT_DELETED = 2,
+};
+
+inline size_t Align8 (size_t size)
+{
+    return (size + 7) & ~static_cast<size_t> (7);
+}
+} // anonymous namespace
+
+const uint32_t MappedHashTable::kVersion;
+
+// Every field has a fixed width, so the file reads the same in any build
+struct MappedHashTable::Header
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_crc;	// Crc32 of the header with this field 0
+    uint32_t slot_num;
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t dirty;			// set before the first change after a Sync ()
+    uint64_t heap_size;
+    uint64_t heap_used;
+    uint64_t count;
+    uint64_t tombstones;
+    uint32_t data_crc;		// Crc32 of the slots and of the used heap
+    uint32_t reserved;
+};
+
+// Followed by the key and the value in the fixed layout
+struct MappedHashTable::Slot
+{
+    uint32_t hash;
+    uint16_t state;
+    uint16_t key_len;
+    uint32_t value_len;
+    uint32_t reserved;
+    uint64_t offset;		// of the key then the value in the heap, variable layout
+};
+
+// public
+MappedHashTable::MappedHashTable ()
+    : header_ (nullptr)
+    , warm_ (false)
+{
+}
+
+// public
+MappedHashTable::~MappedHashTable ()
+{
+    Close ();
+}
+
+// public
+bool MappedHashTable::Open (const std::string& path, const Options& options)
+{
+    Close ();
+
+    if (0 == options.slot_num || options.key_size > 0xffff ||
+        (0 == options.value_size && 0 == options.heap_size)) {
+        return false;
+    }
+
+    if (!file_.Open (path.c_str ())) {
+        return false;
+    }
+
+    size_t slot_size = sizeof(Slot) + (options.value_size > 0 ? Align8 (options.key_size + options.value_size) : 0);
+    off_t length = kHeaderSize + options.slot_num * slot_size + (0 == options.value_size ? options.heap_size : 0);
+    if (file_.GetFileSize () != static_cast<size_t> (length) && !file_.Truncate (length)) {
+        file_.Close ();
+        return false;
+    }
+
+    mapping_.reset (new MemoryMapping (file_.GetFd (), 0, length, MemoryMapping::Writable ()));
+    header_ = reinterpret_cast<Header*> (Base ());
+
+    warm_ = IsValid (options);
+    if (!warm_) {
+        Reset (options);
+    }
+
+    return true;
+}
+
+// public
+void MappedHashTable::Close ()
+{
+    if (!IsOpen ()) {
+        return;
+    }
+
+    Sync ();
+    mapping_.reset ();
+    file_.Close ();
+    header_ = nullptr;
+    warm_ = false;
+}
+
+// public
+bool MappedHashTable::Sync ()
+{
+    if (!IsOpen ()) {
+        return false;
+    }
+
+    if (!header_->dirty) {
+        return true;
+    }
+
+    // the data must be on disk before the flag says it is consistent
+    if (0 != ::msync (Base (), mapping_->GetData ().size (), MS_SYNC)) {
+        return false;
+    }
+
+    header_->data_crc = DataCrc ();
+    header_->dirty = 0;
+    header_->header_crc = HeaderCrc ();
+
+    return 0 == ::msync (Base (), kHeaderSize, MS_SYNC);
+}
+
+// public
+bool MappedHashTable::Set (const StringPiece& key, const StringPiece& value)
+{
+    if (!IsOpen ()) {
+        return false;
+    }
+
+    if (key.size () > header_->key_size ||
+        (header_->value_size > 0 && value.size () > header_->value_size)) {
+        return false;
+    }
+
+    uint32_t hash = 0;
+    MurmurHash3_x86_32 (key.data (), static_cast<int> (key.size ()), 0, &hash);
+
+    bool found = false;
+    Slot* slot = Find (key, hash, &found);
+    if (found) {
+        return Store (slot, key, value, false);
+    }
+
+    if ((header_->count + header_->tombstones + 1) * 4 > static_cast<uint64_t> (header_->slot_num) * 3) {
+        if (0 == header_->tombstones) {
+            return false;
+        }
+
+        Rebuild ();
+        slot = Find (key, hash, &found);
+    }
+
+    if (nullptr == slot || (0 == header_->value_size &&
+                            header_->heap_used + key.size () + value.size () > header_->heap_size)) {
+        return false;
+    }
+
+    MarkDirty ();
+    if (SLOT_DELETED == slot->state) {
+        --header_->tombstones;
+    }
+
+    slot->hash = hash;
+    slot->key_len = static_cast<uint16_t> (key.size ());
+    slot->value_len = 0;
+    slot->state = SLOT_USED;
+    ++header_->count;
+
+    return Store (slot, key, value, true);
+}
+
+// public
+bool MappedHashTable::Get (const StringPiece& key, std::string* value) const
+{
+    if (!IsOpen ()) {
+        return false;
+    }
+
+    uint32_t hash = 0;
+    MurmurHash3_x86_32 (key.data (), static_cast<int> (key.size ()), 0, &hash);
+
+    bool found = false;
+    Slot* slot = Find (key, hash, &found);
+    if (!found) {
+        return false;
+    }
+
+    ValueOf (slot).CopyToString (value);
+    return true;
+}
+
+// public
+bool MappedHashTable::Remove (const StringPiece& key)
+{
+    if (!IsOpen ()) {
+        return false;
+    }
+
+    uint32_t hash = 0;
+    MurmurHash3_x86_32 (key.data (), static_cast<int> (key.size ()), 0, &hash);
+
+    bool found = false;
+    Slot* slot = Find (key, hash, &found);
+    if (!found) {
+        return false;
+    }
+
+    MarkDirty ();
+    --header_->count;
+
+    // no probe runs past an empty slot, so the end of a run needs no tombstone
+    uint64_t idx = (reinterpret_cast<char*> (slot) - reinterpret_cast<char*> (SlotAt (0))) / SlotSize ();
+    if (SLOT_EMPTY == SlotAt ((idx + 1) % header_->slot_num)->state) {
+        slot->state = SLOT_EMPTY;
+    }
+    else {
+        slot->state = SLOT_DELETED;
+        ++header_->tombstones;
+    }
+
+    return true;
+}
+
+// public
+void MappedHashTable::Clear ()
+{
+    if (!IsOpen ()) {
+        return;
+    }
+
+    MarkDirty ();
+    ::memset (SlotAt (0), 0, header_->slot_num * SlotSize ());
+    header_->heap_used = 0;
+    header_->count = 0;
+    header_->tombstones = 0;
+}
+
+// public
+uint64_t MappedHashTable::Count () const
+{
+    return IsOpen () ? header_->count : 0;
+}
+
+// private
+size_t MappedHashTable::SlotSize () const
+{
+    return sizeof(Slot) + (header_->value_size > 0 ? Align8 (header_->key_size + header_->value_size) : 0);
+}
+
+// private
+MappedHashTable::Slot* MappedHashTable::SlotAt (uint64_t idx) const
+{
+    return reinterpret_cast<Slot*> (Base () + kHeaderSize + idx * SlotSize ());
+}
+
+// private
+char* MappedHashTable::Base () const
+{
+    return const_cast<char*> (mapping_->GetData ().data ());
+}
+
+// private
+uint32_t MappedHashTable::HeaderCrc () const
+{
+    Header header = *header_;
+    header.header_crc = 0;
+    return Crc32::ComputeCrc32 (&header, sizeof(header));
+}
+
+// private
+uint32_t MappedHashTable::DataCrc () const
+{
+    uint32_t crc = Crc32::ComputeCrc32 (SlotAt (0), header_->slot_num * SlotSize ());
+    if (0 == header_->value_size) {
+        crc = Crc32::UpdateCrc32 (crc, SlotAt (header_->slot_num), header_->heap_used);
+    }
+
+    return crc;
+}
+
+// private
+bool MappedHashTable::IsValid (const Options& options) const
+{
+    if (kMagic != header_->magic ||
+        kVersion != header_->version ||
+        0 != header_->dirty ||
+        HeaderCrc () != header_->header_crc) {
+        return false;
+    }
+
+    if (options.slot_num != header_->slot_num ||
+        options.key_size != header_->key_size ||
+        options.value_size != header_->value_size ||
+        (0 == options.value_size && options.heap_size != header_->heap_size)) {
+        return false;
+    }
+
+    if (header_->heap_used > header_->heap_size ||
+        header_->count + header_->tombstones > header_->slot_num) {
+        return false;
+    }
+
+    return !options.verify_data || DataCrc () == header_->data_crc;
+}
+
+// private
+void MappedHashTable::Reset (const Options& options)
+{
+    // a crash in the middle leaves a dirty header, so the next Open resets again
+    header_->dirty = 1;
+    ::msync (Base (), kHeaderSize, MS_SYNC);
+
+    ::memset (Base (), 0, sizeof(Header));
+    header_->magic = kMagic;
+    header_->version = kVersion;
+    header_->slot_num = options.slot_num;
+    header_->key_size = options.key_size;
+    header_->value_size = options.value_size;
+    header_->heap_size = 0 == options.value_size ? options.heap_size : 0;
+    header_->dirty = 1;
+    ::memset (SlotAt (0), 0, header_->slot_num * SlotSize ());
+
+    Sync ();
+}
+
+// private
+void MappedHashTable::MarkDirty ()
+{
+    if (!header_->dirty) {
+        header_->dirty = 1;
+        ::msync (Base (), kHeaderSize, MS_SYNC);
+    }
+}
+
+// private
+MappedHashTable::Slot* MappedHashTable::Find (const StringPiece& key, uint32_t hash, bool* found) const
+{
+    Slot* free_slot = nullptr;
+    uint64_t idx = hash % header_->slot_num;
+    for (uint32_t i = 0; i < header_->slot_num; ++i) {
+        Slot* slot = SlotAt (idx);
+        if (SLOT_EMPTY == slot->state) {
+            *found = false;
+            return nullptr != free_slot ? free_slot : slot;
+        }
+
+        if (SLOT_USED == slot->state) {
+            if (hash == slot->hash && key == KeyOf (slot)) {
+                *found = true;
+                return slot;
+            }
+        }
+        else if (nullptr == free_slot) {
+            free_slot = slot;
+        }
+
+        idx = (idx + 1) % header_->slot_num;
+    }
+
+    *found = false;
+    return free_slot;
+}
+
+// private
+StringPiece MappedHashTable::KeyOf (const Slot* slot) const
+{
+    const char* data = (header_->value_size > 0)
+                       ? reinterpret_cast<const char*> (slot + 1)
+                       : reinterpret_cast<const char*> (SlotAt (header_->slot_num)) + slot->offset;
+    return StringPiece (data, slot->key_len);
+}
+
+// private
+StringPiece MappedHashTable::ValueOf (const Slot* slot) const
+{
+    return StringPiece (KeyOf (slot).data () + (header_->value_size > 0 ? header_->key_size : slot->key_len),
+                        slot->value_len);
+}
+
+// private
+bool MappedHashTable::Store (Slot* slot, const StringPiece& key, const StringPiece& value, bool fresh)
+{
+    if (0 == header_->value_size && (fresh || value.size () > slot->value_len)) {
+        // a new record, or one that does not fit the old one, goes to the end
+        if (header_->heap_used + key.size () + value.size () > header_->heap_size) {
+            return false;
+        }
+
+        MarkDirty ();
+        slot->offset = header_->heap_used;
+        header_->heap_used += key.size () + value.size ();
+        ::memcpy (const_cast<char*> (KeyOf (slot).data ()), key.data (), key.size ());
+    }
+    else if (fresh) {
+        ::memcpy (const_cast<char*> (KeyOf (slot).data ()), key.data (), key.size ());
+    }
+
+    MarkDirty ();
+    slot->value_len = static_cast<uint32_t> (value.size ());
+    ::memcpy (const_cast<char*> (ValueOf (slot).data ()), value.data (), value.size ());
+
+    return true;
+}
+
+// private
+void MappedHashTable::Rebuild ()
+{
+    MarkDirty ();
+
+    size_t slot_size = SlotSize ();
+    std::vector<char> used;
+    for (uint32_t i = 0; i < header_->slot_num; ++i) {
+        Slot* slot = SlotAt (i);
+        if (SLOT_USED == slot->state) {
+            used.insert (used.end (), reinterpret_cast<char*> (slot), reinterpret_cast<char*> (slot) + slot_size);
+        }
+    }
+
+    ::memset (SlotAt (0), 0, header_->slot_num * slot_size);
+    header_->tombstones = 0;
+    for (size_t off = 0; off < used.size (); off += slot_size) {
+        const Slot* from = reinterpret_cast<const Slot*> (&used[off]);
+        uint64_t idx = from->hash % header_->slot_num;
+        while (SLOT_EMPTY != SlotAt (idx)->state) {
+            idx = (idx + 1) % header_->slot_num;
+        }
+        ::memcpy (SlotAt (idx), from, slot_size);
+    }
+}
+
+} // namespace swift
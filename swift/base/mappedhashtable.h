@@ -0,0 +1,147 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SWIFT_BASE_MAPPED_HASH_TABLE_H__
+#define __SWIFT_BASE_MAPPED_HASH_TABLE_H__
+
+#include <memory>
+#include <string>
+#include <stdint.h>
+
+#include "swift/base/noncopyable.hpp"
+#include "swift/base/stringpiece.h"
+#include "swift/base/file.h"
+#include "swift/base/memorymapping.h"
+
+namespace swift {
+
+/**
+ * Hash table of byte strings living entirely in a shared file mapping, so a
+ * restarted process maps the file again and finds its cache warm.
+ *
+ * The file is a header page, an array of slots with linear probing, and for
+ * the variable layout a heap the slots point into by offset. With a fixed
+ * layout (value_size > 0) every slot holds its key and value inline, up to
+ * key_size and value_size bytes. With the variable layout (value_size == 0)
+ * records of any size are appended to the heap of heap_size bytes; space of
+ * replaced or removed records is reclaimed by Clear () only.
+ *
+ * Crash safety uses a write-ahead dirty flag: before the first change after
+ * a Sync (), the flag is set in the header and flushed to disk. Sync ()
+ * flushes the data, then clears the flag together with the Crc32 of the
+ * header and of the data. A file whose header is dirty, fails its checksum,
+ * has another version or another layout is reset to an empty table on
+ * Open (): a cache may come back cold, never corrupt.
+ *
+ * Not thread safe.
+ */
+class MappedHashTable : swift::noncopyable
+{
+public:
+    struct Options
+    {
+        Options () : slot_num (1024)
+            , key_size (64)
+            , value_size (0)
+            , heap_size (1024 * 1024)
+            , verify_data (false) { }
+
+        uint32_t slot_num;		// the number of slots, at most 3/4 are used
+        uint32_t key_size;		// the longest key
+        uint32_t value_size;	// the longest value, 0 for the variable layout
+        uint64_t heap_size;		// the heap of the variable layout
+        bool verify_data;		// check the Crc32 of the data on Open ()
+    };
+
+    // bump when the file layout changes
+    static const uint32_t kVersion = 1;
+
+public:
+    MappedHashTable ();
+    ~MappedHashTable ();
+
+    /**
+     * Map the table of path, creating or resetting it when needed
+     *
+     * @return false if the file can not be opened
+     */
+    bool Open (const std::string& path, const Options& options);
+
+    // Sync () and unmap
+    void Close ();
+
+    /**
+     * Flush the changes and mark the file clean. Until the next change, the
+     * table reopens warm even if the process dies without Close ()
+     */
+    bool Sync ();
+
+    // false if the table is not open, the key or the value is too long, or
+    // the table is full. Like Get and Remove, it does nothing on a closed
+    // table, where Count () is 0
+    bool Set (const StringPiece& key, const StringPiece& value);
+
+    bool Get (const StringPiece& key, std::string* value) const;
+
+    bool Remove (const StringPiece& key);
+
+    // removes every record
+    void Clear ();
+
+    uint64_t Count () const;
+
+    // true if Open () found the records of a previous run
+    inline bool IsWarm () const
+    {
+        return warm_;
+    }
+
+    inline bool IsOpen () const
+    {
+        return nullptr != mapping_.get ();
+    }
+
+private:
+    struct Header;
+    struct Slot;
+
+    // the bytes a slot takes in the file
+    size_t SlotSize () const;
+    Slot* SlotAt (uint64_t idx) const;
+    char* Base () const;
+
+    uint32_t HeaderCrc () const;
+    uint32_t DataCrc () const;
+    bool IsValid (const Options& options) const;
+    void Reset (const Options& options);
+    void MarkDirty ();
+
+    // the slot of key, or the slot to insert it at when not found
+    Slot* Find (const StringPiece& key, uint32_t hash, bool* found) const;
+    StringPiece KeyOf (const Slot* slot) const;
+    StringPiece ValueOf (const Slot* slot) const;
+    // writes the record, the key too when fresh
+    bool Store (Slot* slot, const StringPiece& key, const StringPiece& value, bool fresh);
+    void Rebuild ();
+
+private:
+    File file_;
+    std::unique_ptr<MemoryMapping> mapping_;
+    Header* header_;
+    bool warm_;
+};
+
+} // namespace swift
+
+#endif // __SWIFT_BASE_MAPPED_HASH_TABLE_H__
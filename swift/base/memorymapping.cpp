@@ -81,6 +81,8 @@ bool MemOpInChunks(std::function<int(void*, size_t)> func,
 
 } // anonymous namespace
 
+const off_t MemoryMapping::kHugePageSize;
+
 // public
 MemoryMapping::~MemoryMapping ()
 {
@@ -175,8 +177,9 @@ void MemoryMapping::Init(off_t offset, off_t length)
         CHECK_GE(length, 0);
     }
 
+    CHECK(!options_.huge_pages || anonymous);
     if (0 == page_size) {
-        page_size = ::sysconf(_SC_PAGESIZE);
+        page_size = options_.huge_pages ? kHugePageSize : ::sysconf(_SC_PAGESIZE);
     }
 
     CHECK_GT(page_size, 0);
@@ -191,7 +194,8 @@ void MemoryMapping::Init(off_t offset, off_t length)
         map_length_ = (map_length_ + page_size - 1) / page_size * page_size;
     }
 
-    off_t remaining = anonymous ? length : st.st_size - offset;
+    // huge pages must be unmapped in whole pages
+    off_t remaining = anonymous ? (options_.huge_pages ? map_length_ : length) : st.st_size - offset;
     if (-1 == map_length_) {
         length = map_length_ = remaining;
     } else {
@@ -233,8 +237,25 @@ void MemoryMapping::Init(off_t offset, off_t length)
                     (options_.writable ? PROT_WRITE : 0));
         }
 
-        unsigned char* start = static_cast<unsigned char*>(
-            mmap(options_.address, map_length_, prot, flags, file_.GetFd(), offset));
+        void* addr = MAP_FAILED;
+        if (options_.huge_pages) {
+            addr = mmap(options_.address, map_length_, prot, flags | MAP_HUGETLB, file_.GetFd(), offset);
+            if (MAP_FAILED == addr) {
+                PLOG(WARNING) << "mmap huge pages error, length = " << map_length_
+                              << ", fall back to transparent huge pages";
+            }
+        }
+
+        if (MAP_FAILED == addr) {
+            addr = mmap(options_.address, map_length_, prot, flags, file_.GetFd(), offset);
+#ifdef MADV_HUGEPAGE
+            if (MAP_FAILED != addr && options_.huge_pages) {
+                ::madvise(addr, map_length_, MADV_HUGEPAGE);
+            }
+#endif
+        }
+
+        unsigned char* start = static_cast<unsigned char*>(addr);
         PCHECK(start != MAP_FAILED)
             << "mmap error, offset = " << offset
             << " length = " << map_length_;
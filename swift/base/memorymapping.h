@@ -47,6 +47,7 @@ public:
             , readable(true)
             , writable(false)
             , grow(false)
+            , huge_pages(false)
             , address(nullptr) { }
 
         inline Options& SetPageSize(off_t val)
@@ -85,12 +86,21 @@ public:
             return *this;
         }
 
+        // Anonymous mappings only, backs them with huge pages (MAP_HUGETLB)
+        // and falls back to transparent huge pages when none are reserved
+        inline Options& SetHugePages(bool val)
+        {
+            huge_pages = val;
+            return *this;
+        }
+
         off_t page_size;
         bool shared;
         bool prefault;
         bool readable;
         bool writable;
         bool grow;
+        bool huge_pages;
         void* address;
     }; // Options
 
@@ -99,6 +109,9 @@ public:
         return Options().SetWritable(true).SetGrow(true);
     }
 
+    // the default huge page size on x86_64
+    static const off_t kHugePageSize = 2 * 1024 * 1024;
+
     enum class AnonymousType
     {
         ANONYMOUS_TYPE = 0,
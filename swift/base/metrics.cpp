@@ -0,0 +1,125 @@
+/*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "swift/base/metrics.h"
+
+namespace swift {
+
+const int Histogram::kBuckets;
+
+// private
+void Counter::Cell::Merge (const Cell& other)
+{
+    value.store (value.load (std::memory_order_relaxed) + other.value.load (std::memory_order_relaxed),
+                 std::memory_order_relaxed);
+}
+
+// public
+int64_t Counter::Value () const
+{
+    Cell result;
+    cells_.Fold (&result);
+    return result.value.load (std::memory_order_relaxed);
+}
+
+// private
+void Gauge::Cell::Merge (const Cell& other)
+{
+    value.store (value.load (std::memory_order_relaxed) + other.value.load (std::memory_order_relaxed),
+                 std::memory_order_relaxed);
+}
+
+// public
+void Gauge::Set (int64_t value)
+{
+    Cell delta;
+    delta.value.store (value - Value (), std::memory_order_relaxed);
+    cells_.Absorb (delta);
+}
+
+// public
+int64_t Gauge::Value () const
+{
+    Cell result;
+    cells_.Fold (&result);
+    return result.value.load (std::memory_order_relaxed);
+}
+
+// private
+Histogram::Cell::Cell () : count (0), sum (0)
+{
+    for (int i = 0; i < kBuckets; ++i) {
+        buckets[i].store (0, std::memory_order_relaxed);
+    }
+}
+
+// private
+void Histogram::Cell::Merge (const Cell& other)
+{
+    Add (&count, other.count.load (std::memory_order_relaxed));
+    Add (&sum, other.sum.load (std::memory_order_relaxed));
+    for (int i = 0; i < kBuckets; ++i) {
+        Add (&buckets[i], other.buckets[i].load (std::memory_order_relaxed));
+    }
+}
+
+// public
+Histogram::Snapshot Histogram::GetSnapshot () const
+{
+    Cell result;
+    cells_.Fold (&result);
+
+    Snapshot snapshot;
+    snapshot.count = result.count.load (std::memory_order_relaxed);
+    snapshot.sum = result.sum.load (std::memory_order_relaxed);
+    for (int i = 0; i < kBuckets; ++i) {
+        snapshot.buckets[i] = result.buckets[i].load (std::memory_order_relaxed);
+    }
+
+    return snapshot;
+}
+
+// public
+double Histogram::Snapshot::Average () const
+{
+    return 0 == count ? 0.0 : static_cast<double>(sum) / count;
+}
+
+// public
+uint64_t Histogram::Snapshot::Percentile (double p) const
+{
+    if (0 == count) {
+        return 0;
+    }
+
+    // the cells are read one after another, so the buckets may hold a few
+    // records more than count, the rank is taken from the buckets
+    uint64_t total = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        total += buckets[i];
+    }
+
+    uint64_t rank = static_cast<uint64_t>(total * p / 100.0);
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        seen += buckets[i];
+        if (seen > rank) {
+            return 0 == i ? 0 : (i == 64 ? UINT64_MAX : (1ull << i) - 1);
+        }
+    }
+
+    return UINT64_MAX;
+}
+
+} // namespace swift
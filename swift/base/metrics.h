@@ -0,0 +1,242 @@
+/*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef __SWIFT_BASE_METRICS_H__
+#define __SWIFT_BASE_METRICS_H__
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+#include <sched.h>
+
+#include "swift/base/likely.h"
+#include "swift/base/noncopyable.hpp"
+#include "swift/base/threadlocal.h"
+
+namespace swift {
+namespace detail {
+
+// The cells of the threads writing to one metric, one per thread in a
+// ThreadLocalPtr. Every thread writes to its own cell only, readers fold the
+// cells in place with ThreadLocalPtr::Fold. An exiting thread merges its
+// cell into base_ from the UnrefHandler. A fold that may have missed a cell
+// being merged is retried, so a read never misses the work of an exited
+// thread and never counts it twice.
+//
+// Cell has Merge (const Cell&), which adds the other cell to itself.
+template <typename Cell>
+class ThreadCells : swift::noncopyable
+{
+public:
+    ThreadCells () : tls_ (OnThreadExit) {}
+
+    Cell* Local ()
+    {
+        void* ptr = tls_.Get ();
+        if (LIKELY (nullptr != ptr)) {
+            return &static_cast<Slot*>(ptr)->cell;
+        }
+
+        Slot* slot = new Slot (this);
+        tls_.Reset (slot);
+        return &slot->cell;
+    }
+
+    // merges base_ and every cell into result
+    void Fold (Cell* result)
+    {
+        for (;;) {
+            {
+                // an exiting thread merges its cell under mutex_, so base_
+                // and the cells are read as one
+                std::lock_guard<std::mutex> lock (mutex_);
+                Cell sum;
+                if (tls_.Fold (&FoldSlot, &sum)) {
+                    sum.Merge (base_);
+                    result->Merge (sum);
+                    return;
+                }
+            }
+
+            // a thread exiting meanwhile took its cell before the walk got
+            // there, wait until the handler merged it
+            sched_yield ();
+        }
+    }
+
+    // merges delta into base_
+    void Absorb (const Cell& delta)
+    {
+        std::lock_guard<std::mutex> lock (mutex_);
+        base_.Merge (delta);
+    }
+
+private:
+    struct Slot
+    {
+        explicit Slot (ThreadCells* o) : owner (o) {}
+
+        ThreadCells* owner;
+        Cell cell;
+    };
+
+    static void FoldSlot (void* ptr, void* res)
+    {
+        static_cast<Cell*>(res)->Merge (static_cast<Slot*>(ptr)->cell);
+    }
+
+    static void OnThreadExit (void* ptr)
+    {
+        Slot* slot = static_cast<Slot*>(ptr);
+        {
+            std::lock_guard<std::mutex> lock (slot->owner->mutex_);
+            slot->owner->base_.Merge (slot->cell);
+        }
+
+        delete slot;
+    }
+
+    // tls_ goes last, its destructor still merges cells into base_ and
+    // waits for the handlers of exiting threads
+    std::mutex mutex_;
+    Cell base_;
+    ThreadLocalPtr tls_;
+};
+} // namespace detail
+
+// Counter, Gauge and Histogram are meant for hot paths: a write is a plain
+// relaxed add to a cell of the calling thread, so writers on different cores
+// never share a cache line. Reads fold the cells of every thread and are
+// much slower, they are meant for reporting. Every metric takes one
+// ThreadLocalPtr id, and must not be destroyed while a write to it may run;
+// threads that wrote to it may outlive it.
+class Counter : swift::noncopyable
+{
+public:
+    Counter () {}
+
+    void Increment (int64_t n = 1)
+    {
+        Cell* cell = cells_.Local ();
+        cell->value.store (cell->value.load (std::memory_order_relaxed) + n,
+                           std::memory_order_relaxed);
+    }
+
+    int64_t Value () const;
+
+private:
+    struct Cell
+    {
+        Cell () : value (0) {}
+        void Merge (const Cell& other);
+
+        std::atomic<int64_t> value;
+        char padding[64 - sizeof (std::atomic<int64_t>)];
+    };
+
+    mutable detail::ThreadCells<Cell> cells_;
+};
+
+// A value that goes up and down, e.g. the number of open connections
+class Gauge : swift::noncopyable
+{
+public:
+    Gauge () {}
+
+    void Add (int64_t n)
+    {
+        Cell* cell = cells_.Local ();
+        cell->value.store (cell->value.load (std::memory_order_relaxed) + n,
+                           std::memory_order_relaxed);
+    }
+
+    void Sub (int64_t n)
+    {
+        Add (-n);
+    }
+
+    // Adds writes racing with Set may land before or after it
+    void Set (int64_t value);
+    int64_t Value () const;
+
+private:
+    struct Cell
+    {
+        Cell () : value (0) {}
+        void Merge (const Cell& other);
+
+        std::atomic<int64_t> value;
+        char padding[64 - sizeof (std::atomic<int64_t>)];
+    };
+
+    mutable detail::ThreadCells<Cell> cells_;
+};
+
+// Distribution of unsigned values in power of 2 buckets, bucket i holds the
+// values of bit length i, so percentiles are exact within a factor of 2.
+class Histogram : swift::noncopyable
+{
+public:
+    static const int kBuckets = 65;
+
+    struct Snapshot
+    {
+        Snapshot () : count (0), sum (0), buckets (kBuckets, 0) {}
+
+        double Average () const;
+        // upper bound of the bucket holding the p-th percentile, p in [0, 100]
+        uint64_t Percentile (double p) const;
+
+        uint64_t count;
+        uint64_t sum;
+        std::vector<uint64_t> buckets;
+    };
+
+public:
+    Histogram () {}
+
+    void Record (uint64_t value)
+    {
+        Cell* cell = cells_.Local ();
+        int bucket = 0 == value ? 0 : 64 - __builtin_clzll (value);
+        Add (&cell->buckets[bucket], 1);
+        Add (&cell->count, 1);
+        Add (&cell->sum, value);
+    }
+
+    Snapshot GetSnapshot () const;
+
+private:
+    static void Add (std::atomic<uint64_t>* value, uint64_t n)
+    {
+        value->store (value->load (std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    struct Cell
+    {
+        Cell ();
+        void Merge (const Cell& other);
+
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> buckets[kBuckets];
+        char padding[64];
+    };
+
+    mutable detail::ThreadCells<Cell> cells_;
+};
+} // namespace swift
+
+#endif // __SWIFT_BASE_METRICS_H__
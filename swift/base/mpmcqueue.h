@@ -0,0 +1,390 @@
+/*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef __SWIFT_BASE_MPMC_QUEUE_H__
+#define __SWIFT_BASE_MPMC_QUEUE_H__
+
+#include <new>
+#include <time.h>
+#include <stdint.h>
+#include <sched.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <assert.h>
+#include <stddef.h>
+#include <type_traits>
+
+#include "swift/base/likely.h"
+#include "swift/base/noncopyable.hpp"
+
+namespace swift {
+namespace detail {
+
+static const size_t kCacheLineSize = 64;
+
+// Progressive backoff for the blocking operations: pause for a while,
+// then yield, then sleep with a growing interval capped at 1ms.
+class Backoff
+{
+public:
+    Backoff () : count_ (0) {}
+
+    void Pause ()
+    {
+        if (count_ < 64) {
+#if defined(__GNUC__) && (defined(__i386) || defined(__x86_64__))
+            __builtin_ia32_pause ();
+#endif
+        }
+        else if (count_ < 128) {
+            sched_yield ();
+        }
+        else {
+            long ns = 1000L << std::min (count_ - 128, 10);
+            struct timespec ts = { 0, std::min (ns, 1000L * 1000L) };
+            nanosleep (&ts, nullptr);
+        }
+
+        ++count_;
+    }
+
+    void Reset ()
+    {
+        count_ = 0;
+    }
+
+private:
+    int count_;
+};
+
+} // namespace detail
+
+// Bounded lock free multi producer / multi consumer queue.
+//
+// Based on Dmitry Vyukov's bounded MPMC queue: every slot carries a sequence
+// number that tells producers and consumers whether it is free or holds a
+// value of the current lap, so a put or take is a single CAS on the tail or
+// head position. Unlike BlockingQueue the capacity is fixed, a full queue
+// makes the producers wait (or fail for the Try variants).
+template <typename T>
+class MPMCQueue : swift::noncopyable
+{
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+
+        T* Value ()
+        {
+            return reinterpret_cast<T*>(&storage);
+        }
+    };
+
+public:
+    // capacity is rounded up to a power of 2
+    explicit MPMCQueue (size_t capacity)
+        : cells_ (nullptr)
+        , mask_ (0)
+        , tail_ (0)
+        , head_ (0)
+    {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        mask_ = size - 1;
+        cells_ = static_cast<Cell*>(::operator new (sizeof(Cell) * size));
+        for (size_t i = 0; i < size; ++i) {
+            new (&cells_[i].sequence) std::atomic<size_t> (i);
+        }
+    }
+
+    ~MPMCQueue ()
+    {
+        size_t tail = tail_.load (std::memory_order_acquire);
+        for (size_t pos = head_.load (std::memory_order_acquire); pos != tail; ++pos) {
+            cells_[pos & mask_].Value ()->~T ();
+        }
+
+        ::operator delete (cells_);
+    }
+
+    bool TryPut (const T& value)
+    {
+        return Enqueue (value);
+    }
+
+    bool TryPut (T&& value)
+    {
+        return Enqueue (std::move (value));
+    }
+
+    // blocks while the queue is full
+    void Put (const T& value)
+    {
+        detail::Backoff backoff;
+        while (!Enqueue (value)) {
+            backoff.Pause ();
+        }
+    }
+
+    void Put (T&& value)
+    {
+        detail::Backoff backoff;
+        while (!Enqueue (std::move (value))) {
+            backoff.Pause ();
+        }
+    }
+
+    // gives up after timeout, returns false if the value was not put
+    template <typename Rep, typename Period>
+    bool PutFor (const T& value, const std::chrono::duration<Rep, Period>& timeout)
+    {
+        auto deadline = std::chrono::steady_clock::now () + timeout;
+        detail::Backoff backoff;
+        while (!Enqueue (value)) {
+            if (std::chrono::steady_clock::now () >= deadline) {
+                return false;
+            }
+            backoff.Pause ();
+        }
+
+        return true;
+    }
+
+    template <typename Rep, typename Period>
+    bool PutFor (T&& value, const std::chrono::duration<Rep, Period>& timeout)
+    {
+        auto deadline = std::chrono::steady_clock::now () + timeout;
+        detail::Backoff backoff;
+        while (!Enqueue (std::move (value))) {
+            if (std::chrono::steady_clock::now () >= deadline) {
+                return false;
+            }
+            backoff.Pause ();
+        }
+
+        return true;
+    }
+
+    bool TryTake (T& value)
+    {
+        return Dequeue (value);
+    }
+
+    // blocks while the queue is empty
+    T Take ()
+    {
+        T value;
+        detail::Backoff backoff;
+        while (!Dequeue (value)) {
+            backoff.Pause ();
+        }
+
+        return value;
+    }
+
+    template <typename Rep, typename Period>
+    bool TakeFor (T& value, const std::chrono::duration<Rep, Period>& timeout)
+    {
+        auto deadline = std::chrono::steady_clock::now () + timeout;
+        detail::Backoff backoff;
+        while (!Dequeue (value)) {
+            if (std::chrono::steady_clock::now () >= deadline) {
+                return false;
+            }
+            backoff.Pause ();
+        }
+
+        return true;
+    }
+
+    // Puts up to n values copied from first, claiming the free slots with
+    // a single CAS. Never blocks, returns the number of values put.
+    template <typename InputIt>
+    size_t TryPutN (InputIt first, size_t n)
+    {
+        size_t done = 0;
+        while (done < n) {
+            size_t count = 0;
+            size_t pos = ClaimRange (tail_, 0, n - done, count);
+            if (0 == count) {
+                break;
+            }
+
+            for (size_t i = 0; i < count; ++i, ++first) {
+                Cell& cell = cells_[(pos + i) & mask_];
+                new (cell.Value ()) T (*first);
+                cell.sequence.store (pos + i + 1, std::memory_order_release);
+            }
+            done += count;
+        }
+
+        return done;
+    }
+
+    // blocks until all of the n values are put
+    template <typename InputIt>
+    void PutN (InputIt first, size_t n)
+    {
+        detail::Backoff backoff;
+        while (n > 0) {
+            size_t count = TryPutN (first, n);
+            if (0 == count) {
+                backoff.Pause ();
+                continue;
+            }
+
+            std::advance (first, count);
+            n -= count;
+            backoff.Reset ();
+        }
+    }
+
+    // Takes up to n values into out without blocking, returns the number taken
+    template <typename OutputIt>
+    size_t TryTakeN (OutputIt out, size_t n)
+    {
+        size_t done = 0;
+        while (done < n) {
+            size_t count = 0;
+            size_t pos = ClaimRange (head_, 1, n - done, count);
+            if (0 == count) {
+                break;
+            }
+
+            for (size_t i = 0; i < count; ++i, ++out) {
+                Cell& cell = cells_[(pos + i) & mask_];
+                *out = std::move (*cell.Value ());
+                cell.Value ()->~T ();
+                cell.sequence.store (pos + i + mask_ + 1, std::memory_order_release);
+            }
+            done += count;
+        }
+
+        return done;
+    }
+
+    // blocks until at least one value is available, then takes up to n
+    template <typename OutputIt>
+    size_t TakeN (OutputIt out, size_t n)
+    {
+        detail::Backoff backoff;
+        size_t count = 0;
+        while (n > 0 && 0 == (count = TryTakeN (out, n))) {
+            backoff.Pause ();
+        }
+
+        return count;
+    }
+
+    // approximate when other threads are working on the queue
+    size_t Size () const
+    {
+        size_t tail = tail_.load (std::memory_order_acquire);
+        size_t head = head_.load (std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    bool IsEmpty () const
+    {
+        return 0 == Size ();
+    }
+
+    size_t Capacity () const
+    {
+        return mask_ + 1;
+    }
+
+private:
+    template <typename V>
+    bool Enqueue (V&& value)
+    {
+        size_t count = 0;
+        size_t pos = ClaimRange (tail_, 0, 1, count);
+        if (0 == count) {
+            return false;
+        }
+
+        Cell& cell = cells_[pos & mask_];
+        new (cell.Value ()) T (std::forward<V> (value));
+        cell.sequence.store (pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Dequeue (T& value)
+    {
+        size_t count = 0;
+        size_t pos = ClaimRange (head_, 1, 1, count);
+        if (0 == count) {
+            return false;
+        }
+
+        Cell& cell = cells_[pos & mask_];
+        value = std::move (*cell.Value ());
+        cell.Value ()->~T ();
+        cell.sequence.store (pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Claims up to max consecutive slots starting at position, a slot at pos
+    // is ready when its sequence is pos + lag (0 for producers, 1 for consumers).
+    // Returns the first claimed position, count is 0 if nothing is ready.
+    size_t ClaimRange (std::atomic<size_t>& position, size_t lag, size_t max, size_t& count)
+    {
+        size_t pos = position.load (std::memory_order_relaxed);
+        while (true) {
+            size_t seq = cells_[pos & mask_].sequence.load (std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + lag);
+            if (0 == diff) {
+                size_t ready = 1;
+                while (ready < max && ready <= mask_ &&
+                       cells_[(pos + ready) & mask_].sequence.load (std::memory_order_acquire) == pos + ready + lag) {
+                    ++ready;
+                }
+
+                if (position.compare_exchange_weak (pos, pos + ready, std::memory_order_relaxed)) {
+                    count = ready;
+                    return pos;
+                }
+            }
+            else if (diff < 0) {
+                // full for producers, empty for consumers
+                count = 0;
+                return pos;
+            }
+            else {
+                pos = position.load (std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    char pad0_[detail::kCacheLineSize];
+    Cell* cells_;
+    size_t mask_;
+    char pad1_[detail::kCacheLineSize - sizeof(Cell*) - sizeof(size_t)];
+    std::atomic<size_t> tail_;  // next position to put
+    char pad2_[detail::kCacheLineSize - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> head_;  // next position to take
+    char pad3_[detail::kCacheLineSize - sizeof(std::atomic<size_t>)];
+};
+
+} // namespace swift
+
+#endif // __SWIFT_BASE_MPMC_QUEUE_H__
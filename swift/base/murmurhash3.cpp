@@ -87,17 +87,6 @@ FORCE_INLINE inline uint32_t fmix (uint32_t h)
     return h;
 }
 
-FORCE_INLINE inline uint64_t fmix (uint64_t k)
-{
-    k ^= k >> 33;
-    k *= BIG_CONSTANT (0xff51afd7ed558ccd);
-    k ^= k >> 33;
-    k *= BIG_CONSTANT (0xc4ceb9fe1a85ec53);
-    k ^= k >> 33;
-
-    return k;
-}
-
 void MurmurHash3_x86_32 (const void *key, 
                          int len,
                          uint32_t seed, 
@@ -356,8 +345,8 @@ void MurmurHash3_x64_128 (const void *key,
     h1 += h2;
     h2 += h1;
 
-    h1 = fmix (h1);
-    h2 = fmix (h2);
+    h1 = fmix64 (h1);
+    h2 = fmix64 (h2);
 
     h1 += h2;
     h2 += h1;
@@ -27,6 +27,20 @@ namespace swift {
     void MurmurHash3_x86_128 (const void *key, int len, uint32_t seed, void *out);
 
     void MurmurHash3_x64_128 (const void *key, int len, uint32_t seed, void *out);
+
+    // The 64-bit finalization mix of MurmurHash3, every input bit affects
+    // every output bit. Spreads hashes like std::hash of integers, which is
+    // the identity, before their low bits pick a bucket or a shard.
+    inline uint64_t fmix64 (uint64_t k)
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+
+        return k;
+    }
 }
 
 #endif // __SWIFT_BASE_MURMUR_HASH3_H__
@@ -0,0 +1,293 @@
+/*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef __SWIFT_BASE_PARALLEL_H__
+#define __SWIFT_BASE_PARALLEL_H__
+
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <exception>
+#include <condition_variable>
+
+#include "swift/base/threadpool.h"
+#include "swift/base/noncopyable.hpp"
+
+// Fork/join algorithms on top of ThreadPool. Every algorithm blocks until
+// the work is done, and the calling thread runs queued tasks of the pool
+// while it waits, so they may be nested or called from pool tasks.
+//
+// e.g. checksum a mapped file in 1MB pieces:
+//
+//  uint32_t crc = swift::ParallelReduce (pool, size_t (0), size / kPiece, 0u,
+//      [&](size_t b, size_t e) { ... hash pieces [b, e) ... },
+//      [](uint32_t a, uint32_t b) { return a ^ b; });
+
+namespace swift {
+
+// Tracks a set of tasks scheduled on a pool, Wait () blocks until all of
+// them are done. The first exception thrown by a task is rethrown by Wait ().
+class TaskGroup : swift::noncopyable
+{
+public:
+    explicit TaskGroup (ThreadPool& pool)
+        : pool_ (pool)
+        , pending_ (0)
+        , mutex_ ()
+        , cond_ ()
+        , exception_ ()
+    {
+    }
+
+    ~TaskGroup ()
+    {
+        WaitAll ();
+    }
+
+    template <typename F>
+    void Run (F f)
+    {
+        pending_.fetch_add (1, std::memory_order_relaxed);
+        pool_.Schedule ([this, f] () {
+            try {
+                f ();
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock (mutex_);
+                if (!exception_) {
+                    exception_ = std::current_exception ();
+                }
+            }
+
+            Done ();
+        });
+    }
+
+    // blocks until every task is done and rethrows the first failure
+    void Wait ()
+    {
+        WaitAll ();
+        std::exception_ptr ex;
+        {
+            std::lock_guard<std::mutex> lock (mutex_);
+            std::swap (ex, exception_);
+        }
+
+        if (ex) {
+            std::rethrow_exception (ex);
+        }
+    }
+
+    ThreadPool& GetPool () const
+    {
+        return pool_;
+    }
+
+private:
+    // Zero is only trusted under mutex_: Done () decrements and notifies
+    // under it, so once it is seen no task touches the group any more and
+    // the caller may destroy it.
+    void WaitAll ()
+    {
+        for (;;) {
+            // help the pool rather than sleeping on our own sub tasks
+            if (0 != pending_.load (std::memory_order_acquire) && pool_.RunPendingTask ()) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock (mutex_);
+            if (cond_.wait_for (lock, std::chrono::microseconds (100), [this] {
+                return 0 == pending_.load (std::memory_order_acquire);
+            })) {
+                return;
+            }
+        }
+    }
+
+    void Done ()
+    {
+        std::lock_guard<std::mutex> lock (mutex_);
+        if (1 == pending_.fetch_sub (1, std::memory_order_acq_rel)) {
+            cond_.notify_all ();
+        }
+    }
+
+private:
+    ThreadPool& pool_;
+    std::atomic<size_t> pending_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::exception_ptr exception_;
+};
+
+namespace detail {
+
+// about 8 pieces per thread, enough to balance uneven pieces without
+// paying the scheduling cost for tiny ones
+inline size_t AutoGrainSize (size_t n, const ThreadPool& pool)
+{
+    size_t pieces = static_cast<size_t>(pool.GetThreadsNumber ()) * 8;
+    size_t grain = n / (pieces > 0 ? pieces : 1);
+    return grain > 0 ? grain : 1;
+}
+
+// halves [begin, end) and hands the upper half to the pool until the
+// piece is no larger than grain, then runs it on the calling thread
+template <typename Index, typename Func>
+void SplitRange (TaskGroup& group, Index begin, Index end, size_t grain, const Func& func)
+{
+    while (static_cast<size_t>(end - begin) > grain) {
+        Index middle = begin + (end - begin) / 2;
+        Index upper = end;
+        group.Run ([&group, middle, upper, grain, &func] () {
+            SplitRange (group, middle, upper, grain, func);
+        });
+        end = middle;
+    }
+
+    func (begin, end);
+}
+
+template <typename RandomIt, typename Compare>
+void MergeSort (ThreadPool& pool, RandomIt first, RandomIt last, size_t grain, Compare comp)
+{
+    size_t n = static_cast<size_t>(last - first);
+    if (n <= grain) {
+        std::sort (first, last, comp);
+        return;
+    }
+
+    RandomIt middle = first + n / 2;
+    {
+        TaskGroup group (pool);
+        group.Run ([&pool, first, middle, grain, comp] () {
+            MergeSort (pool, first, middle, grain, comp);
+        });
+        MergeSort (pool, middle, last, grain, comp);
+        group.Wait ();
+    }
+
+    std::inplace_merge (first, middle, last, comp);
+}
+
+} // namespace detail
+
+// Calls func (b, e) on disjoint sub ranges that together cover [begin, end).
+// grain is the largest range handed to one call, 0 picks one from the pool size.
+template <typename Index, typename Func>
+void ParallelForRange (ThreadPool& pool, Index begin, Index end, Func func, size_t grain = 0)
+{
+    if (!(begin < end)) {
+        return;
+    }
+
+    size_t n = static_cast<size_t>(end - begin);
+    if (0 == grain) {
+        grain = detail::AutoGrainSize (n, pool);
+    }
+
+    if (n <= grain) {
+        func (begin, end);
+        return;
+    }
+
+    TaskGroup group (pool);
+    detail::SplitRange (group, begin, end, grain, func);
+    group.Wait ();
+}
+
+// Calls func (i) for every i in [begin, end)
+template <typename Index, typename Func>
+void ParallelFor (ThreadPool& pool, Index begin, Index end, Func func, size_t grain = 0)
+{
+    ParallelForRange (pool, begin, end, [&func] (Index b, Index e) {
+        for (Index i = b; i < e; ++i) {
+            func (i);
+        }
+    }, grain);
+}
+
+// map (b, e) reduces a sub range of [begin, end) to a T, the partial results
+// are folded with reduce in index order starting from init, so reduce only
+// needs to be associative.
+template <typename T, typename Index, typename Map, typename Reduce>
+T ParallelReduce (ThreadPool& pool, Index begin, Index end, T init,
+                  Map map, Reduce reduce, size_t grain = 0)
+{
+    if (!(begin < end)) {
+        return init;
+    }
+
+    size_t n = static_cast<size_t>(end - begin);
+    if (0 == grain) {
+        grain = detail::AutoGrainSize (n, pool);
+    }
+
+    typedef decltype (end - begin) Diff;
+    size_t pieces = (n + grain - 1) / grain;
+    std::vector<T> partials (pieces, init);
+    ParallelFor (pool, size_t (0), pieces, [&] (size_t piece) {
+        Index b = begin + static_cast<Diff>(piece * grain);
+        Index e = (piece + 1 == pieces) ? end : b + static_cast<Diff>(grain);
+        partials[piece] = map (b, e);
+    }, 1);
+
+    T result = init;
+    for (size_t i = 0; i < pieces; ++i) {
+        result = reduce (result, partials[i]);
+    }
+
+    return result;
+}
+
+// std::transform for random access iterators, returns the end of the output
+template <typename InputIt, typename OutputIt, typename UnaryOp>
+OutputIt ParallelTransform (ThreadPool& pool, InputIt first, InputIt last,
+                            OutputIt out, UnaryOp op, size_t grain = 0)
+{
+    typedef typename std::iterator_traits<InputIt>::difference_type Diff;
+    Diff n = last - first;
+    ParallelForRange (pool, Diff (0), n, [&] (Diff b, Diff e) {
+        std::transform (first + b, first + e, out + b, op);
+    }, grain);
+
+    return out + n;
+}
+
+// Merge sort, pieces no larger than grain are sorted with std::sort
+template <typename RandomIt, typename Compare>
+void ParallelSort (ThreadPool& pool, RandomIt first, RandomIt last,
+                   Compare comp, size_t grain = 0)
+{
+    size_t n = static_cast<size_t>(last - first);
+    if (0 == grain) {
+        grain = std::max (detail::AutoGrainSize (n, pool), static_cast<size_t>(2048));
+    }
+
+    detail::MergeSort (pool, first, last, grain, comp);
+}
+
+template <typename RandomIt>
+void ParallelSort (ThreadPool& pool, RandomIt first, RandomIt last, size_t grain = 0)
+{
+    typedef typename std::iterator_traits<RandomIt>::value_type Value;
+    ParallelSort (pool, first, last, std::less<Value> (), grain);
+}
+
+} // namespace swift
+
+#endif // __SWIFT_BASE_PARALLEL_H__
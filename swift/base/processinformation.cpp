@@ -364,6 +364,66 @@ public:
         }
     }
 
+    // Parse a kernel cpu list such as "0-3,8-11" into single cpu ids
+    static std::vector<int> ParseCpuList (const std::string& list)
+    {
+        std::vector<int> cpus;
+        const char* p = list.c_str ();
+        while ('\0' != *p) {
+            char* end = nullptr;
+            long first = strtol (p, &end, 10);
+            if (end == p) {
+                break;
+            }
+
+            long last = first;
+            p = end;
+            if ('-' == *p) {
+                last = strtol (p + 1, &end, 10);
+                p = end;
+            }
+
+            for (long cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back (static_cast<int>(cpu));
+            }
+
+            if (',' == *p) {
+                ++p;
+            }
+        }
+
+        return cpus;
+    }
+
+    // Get the cpus of every online NUMA node, if the kernel exports no
+    // topology all of the cpus are reported as a single node
+    static void GetNumaTopology (int proc_count, std::vector<std::vector<int> >& nodes)
+    {
+        nodes.clear ();
+        std::vector<int> online = ParseCpuList (ReadLineFromFile ("/sys/devices/system/node/online"));
+        for (size_t i = 0; i < online.size (); ++i) {
+            char file_name[128] = {'\0'};
+            snprintf (file_name, sizeof(file_name),
+                      "/sys/devices/system/node/node%d/cpulist", online[i]);
+            std::vector<int> cpus = ParseCpuList (ReadLineFromFile (file_name));
+            if (!cpus.empty ()) {
+                nodes.push_back (cpus);
+            }
+        }
+
+        if (nodes.empty ()) {
+            std::vector<int> cpus;
+            for (int cpu = 0; cpu < proc_count; ++cpu) {
+                cpus.push_back (cpu);
+            }
+
+            if (cpus.empty ()) {
+                cpus.push_back (0);
+            }
+            nodes.push_back (cpus);
+        }
+    }
+
     //Get system memory total size
     static unsigned long long GetSystemMemorySize ()
     {
@@ -552,6 +612,7 @@ void ProcessInformation::SystemInformation::CollectSystemInformation ()
     cpu_features_ = cpu_features;
     number_pages_ = static_cast<unsigned int>(sysconf (_SC_PHYS_PAGES));
     max_open_files_ = static_cast<unsigned int>(sysconf (_SC_OPEN_MAX));
+    detail::LinuxSystemHelper::GetNumaTopology (cpu_count, numa_node_cpus_);
 }
 
 } // namespace swift
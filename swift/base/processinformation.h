@@ -20,6 +20,7 @@
 #include <string>
 #include <mutex>
 #include <memory>
+#include <vector>
 
 namespace swift {
 class ProcessInformation
@@ -106,6 +107,18 @@ public:
         return GetSystemInfo ().has_numa_;
     }
 
+    // Get the number of online NUMA nodes, at least 1
+    inline unsigned int GetNumberOfNumaNodes () const
+    {
+        return static_cast<unsigned int>(GetSystemInfo ().numa_node_cpus_.size ());
+    }
+
+    // Get the CPUs belonging to the given NUMA node (index into the online nodes)
+    inline const std::vector<int>& GetNumaNodeCpus (unsigned int node) const
+    {
+        return GetSystemInfo ().numa_node_cpus_.at (node);
+    }
+
     inline const std::string& GetLibcVersion () const
     {
         return GetSystemInfo ().libc_version_;
@@ -207,6 +220,7 @@ private:
         std::string cpu_frequncy_;
         std::string cpu_features_;
         std::string version_signature_;
+        std::vector<std::vector<int> > numa_node_cpus_;
     }; // SystemInformation
 
 private:
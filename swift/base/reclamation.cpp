@@ -0,0 +1,357 @@
+/*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <algorithm>
+
+#include "swift/base/reclamation.h"
+#include "swift/base/likely.h"
+
+namespace swift {
+namespace {
+
+void FreeAll (std::vector<detail::Retired>* retired)
+{
+    for (auto& r : *retired) {
+        r.deleter (r.ptr);
+    }
+    retired->clear ();
+}
+} // anonymous namespace
+
+// public
+HazardPointerDomain::HazardPointerDomain (size_t retire_threshold)
+    : threshold_ (retire_threshold)
+    , records_ (nullptr)
+    , tls_ (new ThreadLocalPtr (&OnThreadExit))
+{
+}
+
+// public
+HazardPointerDomain::~HazardPointerDomain ()
+{
+    // hands the lists of the live threads to orphans_
+    tls_.reset ();
+    FreeAll (&orphans_);
+
+    Record* record = records_.load (std::memory_order_acquire);
+    while (nullptr != record) {
+        Record* next = record->next;
+        delete record;
+        record = next;
+    }
+}
+
+// public
+void HazardPointerDomain::Holder::Set (const void* ptr)
+{
+    // the store must be visible before the caller checks ptr is still
+    // reachable, Scan reads the records after the pointer was unlinked
+    record_->ptr.store (ptr, std::memory_order_seq_cst);
+}
+
+// public
+void HazardPointerDomain::Holder::Reset ()
+{
+    record_->ptr.store (nullptr, std::memory_order_release);
+}
+
+// public
+void HazardPointerDomain::Retire (void* ptr, detail::RetireDeleter deleter)
+{
+    RetireList* list = Local ();
+    detail::Retired r = { ptr, deleter, 0 };
+    list->retired.push_back (r);
+    if (list->retired.size () >= threshold_) {
+        Scan (&list->retired);
+        // the lists of exited threads go with the batch, a thread exiting
+        // meanwhile leaves them to the next one
+        ScanOrphans (false);
+    }
+}
+
+// public
+size_t HazardPointerDomain::Reclaim ()
+{
+    size_t count = Scan (&Local ()->retired);
+    return count + ScanOrphans (true);
+}
+
+// private
+HazardPointerDomain::Record* HazardPointerDomain::Acquire ()
+{
+    for (Record* record = records_.load (std::memory_order_acquire);
+         nullptr != record;
+         record = record->next) {
+        bool expected = false;
+        if (!record->active.load (std::memory_order_relaxed) &&
+            record->active.compare_exchange_strong (expected, true, std::memory_order_acquire)) {
+            return record;
+        }
+    }
+
+    // records are never removed, only pushed
+    Record* record = new Record ();
+    record->active.store (true, std::memory_order_relaxed);
+    Record* head = records_.load (std::memory_order_relaxed);
+    do {
+        record->next = head;
+    } while (!records_.compare_exchange_weak (head, record, std::memory_order_release));
+
+    return record;
+}
+
+// private
+void HazardPointerDomain::Release (Record* record)
+{
+    record->ptr.store (nullptr, std::memory_order_release);
+    record->active.store (false, std::memory_order_release);
+}
+
+// private
+HazardPointerDomain::RetireList* HazardPointerDomain::Local ()
+{
+    void* ptr = tls_->Get ();
+    if (LIKELY (nullptr != ptr)) {
+        return static_cast<RetireList*>(ptr);
+    }
+
+    RetireList* list = new RetireList (this);
+    tls_->Reset (list);
+    return list;
+}
+
+// private
+size_t HazardPointerDomain::Scan (std::vector<detail::Retired>* retired) const
+{
+    // pairs with the store in Set: a reader that protected a pointer before
+    // it was unlinked is seen here, a later one sees it unlinked
+    std::atomic_thread_fence (std::memory_order_seq_cst);
+
+    std::vector<const void*> hazards;
+    for (Record* record = records_.load (std::memory_order_acquire);
+         nullptr != record;
+         record = record->next) {
+        const void* ptr = record->ptr.load (std::memory_order_seq_cst);
+        if (nullptr != ptr) {
+            hazards.push_back (ptr);
+        }
+    }
+    std::sort (hazards.begin (), hazards.end ());
+
+    size_t kept = 0;
+    size_t count = retired->size ();
+    for (size_t i = 0; i < count; ++i) {
+        detail::Retired& r = (*retired)[i];
+        if (std::binary_search (hazards.begin (), hazards.end (), r.ptr)) {
+            (*retired)[kept++] = r;
+        } else {
+            r.deleter (r.ptr);
+        }
+    }
+    retired->resize (kept);
+
+    return count - kept;
+}
+
+// private
+size_t HazardPointerDomain::ScanOrphans (bool wait)
+{
+    std::unique_lock<std::mutex> lock (mutex_, std::defer_lock);
+    if (wait) {
+        lock.lock ();
+    } else if (!lock.try_lock ()) {
+        return 0;
+    }
+
+    return orphans_.empty () ? 0 : Scan (&orphans_);
+}
+
+// static private
+void HazardPointerDomain::OnThreadExit (void* ptr)
+{
+    RetireList* list = static_cast<RetireList*>(ptr);
+    HazardPointerDomain* domain = list->domain;
+    {
+        std::lock_guard<std::mutex> lock (domain->mutex_);
+        domain->orphans_.insert (domain->orphans_.end (), list->retired.begin (), list->retired.end ());
+    }
+
+    delete list;
+}
+
+// public
+EpochDomain::EpochDomain (size_t retire_threshold)
+    : threshold_ (retire_threshold)
+    , epoch_ (0)
+    , records_ (nullptr)
+    , tls_ (new ThreadLocalPtr (&OnThreadExit))
+{
+}
+
+// public
+EpochDomain::~EpochDomain ()
+{
+    tls_.reset ();
+    FreeAll (&orphans_);
+
+    Record* record = records_.load (std::memory_order_acquire);
+    while (nullptr != record) {
+        Record* next = record->next;
+        FreeAll (&record->retired);
+        delete record;
+        record = next;
+    }
+}
+
+// public
+void EpochDomain::Retire (void* ptr, detail::RetireDeleter deleter)
+{
+    Record* record = Local ();
+    detail::Retired r = { ptr, deleter, epoch_.load (std::memory_order_seq_cst) };
+    record->retired.push_back (r);
+    if (record->retired.size () >= threshold_) {
+        TryAdvance ();
+        Free (&record->retired);
+        FreeOrphans (false);
+    }
+}
+
+// public
+size_t EpochDomain::Reclaim ()
+{
+    TryAdvance ();
+    size_t count = Free (&Local ()->retired);
+    return count + FreeOrphans (true);
+}
+
+// private
+EpochDomain::Record* EpochDomain::Local ()
+{
+    void* ptr = tls_->Get ();
+    if (LIKELY (nullptr != ptr)) {
+        return static_cast<Record*>(ptr);
+    }
+
+    // take over the record of an exited thread, or register a new one
+    Record* record = records_.load (std::memory_order_acquire);
+    for (; nullptr != record; record = record->next) {
+        bool expected = false;
+        if (!record->in_use.load (std::memory_order_relaxed) &&
+            record->in_use.compare_exchange_strong (expected, true, std::memory_order_acquire)) {
+            break;
+        }
+    }
+
+    if (nullptr == record) {
+        record = new Record (this);
+        Record* head = records_.load (std::memory_order_relaxed);
+        do {
+            record->next = head;
+        } while (!records_.compare_exchange_weak (head, record, std::memory_order_release));
+    }
+
+    tls_->Reset (record);
+    return record;
+}
+
+// private
+EpochDomain::Record* EpochDomain::Enter ()
+{
+    Record* record = Local ();
+    if (0 == record->nesting++) {
+        uint64_t epoch = epoch_.load (std::memory_order_relaxed);
+        record->state.store ((epoch << 1) | 1, std::memory_order_relaxed);
+        // the announcement must be visible before any protected load
+        std::atomic_thread_fence (std::memory_order_seq_cst);
+    }
+
+    return record;
+}
+
+// private
+void EpochDomain::Exit (Record* record)
+{
+    if (0 == --record->nesting) {
+        record->state.store (0, std::memory_order_release);
+    }
+}
+
+// private
+bool EpochDomain::TryAdvance ()
+{
+    std::atomic_thread_fence (std::memory_order_seq_cst);
+    uint64_t epoch = epoch_.load (std::memory_order_relaxed);
+    for (Record* record = records_.load (std::memory_order_acquire);
+         nullptr != record;
+         record = record->next) {
+        uint64_t state = record->state.load (std::memory_order_acquire);
+        if ((state & 1) && (state >> 1) != epoch) {
+            return false;
+        }
+    }
+
+    return epoch_.compare_exchange_strong (epoch, epoch + 1, std::memory_order_acq_rel);
+}
+
+// private
+size_t EpochDomain::Free (std::vector<detail::Retired>* retired) const
+{
+    // every reader active when a node was retired at epoch e has left once
+    // the epoch reached e + 2
+    uint64_t epoch = epoch_.load (std::memory_order_acquire);
+    size_t kept = 0;
+    size_t count = retired->size ();
+    for (size_t i = 0; i < count; ++i) {
+        detail::Retired& r = (*retired)[i];
+        if (r.epoch + 2 > epoch) {
+            (*retired)[kept++] = r;
+        } else {
+            r.deleter (r.ptr);
+        }
+    }
+    retired->resize (kept);
+
+    return count - kept;
+}
+
+// private
+size_t EpochDomain::FreeOrphans (bool wait)
+{
+    std::unique_lock<std::mutex> lock (mutex_, std::defer_lock);
+    if (wait) {
+        lock.lock ();
+    } else if (!lock.try_lock ()) {
+        return 0;
+    }
+
+    return Free (&orphans_);
+}
+
+// static private
+void EpochDomain::OnThreadExit (void* ptr)
+{
+    Record* record = static_cast<Record*>(ptr);
+    EpochDomain* domain = record->domain;
+    {
+        std::lock_guard<std::mutex> lock (domain->mutex_);
+        domain->orphans_.insert (domain->orphans_.end (), record->retired.begin (), record->retired.end ());
+    }
+
+    record->retired.clear ();
+    record->nesting = 0;
+    record->state.store (0, std::memory_order_relaxed);
+    record->in_use.store (false, std::memory_order_release);
+}
+
+} // namespace swift
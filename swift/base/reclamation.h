@@ -0,0 +1,243 @@
+/*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#ifndef __SWIFT_BASE_RECLAMATION_H__
+#define __SWIFT_BASE_RECLAMATION_H__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+#include "swift/base/noncopyable.hpp"
+#include "swift/base/threadlocal.h"
+
+// Safe memory reclamation for lock free structures: a node unlinked by one
+// thread may still be read by others, so instead of deleting it the writer
+// retires it to a domain, which deletes it once no reader can reach it.
+//
+// HazardPointerDomain: readers publish every pointer they follow, reclaim
+// scans the published pointers. Bounded garbage, a store and a fence per
+// pointer on the read side.
+//
+// EpochDomain: readers only announce that they are inside a critical section,
+// a node is freed two epochs after it was retired. Cheapest reads, but one
+// stalled reader holds back all garbage.
+//
+// Both keep a retire list per thread and per domain in a ThreadLocalPtr and
+// reclaim in batches of retire_threshold. The list of an exiting thread is
+// handed to the domain and reclaimed with the next batch of any thread, or by
+// Reclaim (), so threads coming and going leave no garbage behind. A domain
+// must outlive the threads using it and is destroyed with no reader inside,
+// it then deletes everything still retired.
+
+namespace swift {
+namespace detail {
+
+typedef void (*RetireDeleter) (void* ptr);
+
+struct Retired
+{
+    void* ptr;
+    RetireDeleter deleter;
+    uint64_t epoch;
+};
+
+template <typename T>
+void DeleteRetired (void* ptr)
+{
+    delete static_cast<T*>(ptr);
+}
+} // namespace detail
+
+class HazardPointerDomain : swift::noncopyable
+{
+    struct Record;
+public:
+    explicit HazardPointerDomain (size_t retire_threshold = 128);
+    ~HazardPointerDomain ();
+
+    // A hazard pointer, owned by one thread at a time
+    class Holder : swift::noncopyable
+    {
+    public:
+        explicit Holder (HazardPointerDomain& domain)
+            : domain_ (domain), record_ (domain.Acquire ())
+        {
+        }
+
+        ~Holder ()
+        {
+            domain_.Release (record_);
+        }
+
+        // Loads src and protects the value, it may be dereferenced until the
+        // next Protect or Reset, even if it is retired meanwhile.
+        template <typename T>
+        T* Protect (const std::atomic<T*>& src)
+        {
+            T* ptr = src.load (std::memory_order_relaxed);
+            for (;;) {
+                Set (ptr);
+                T* again = src.load (std::memory_order_acquire);
+                if (again == ptr) {
+                    return ptr;
+                }
+                ptr = again;
+            }
+        }
+
+        // Protects ptr, the caller checks it is still reachable afterwards
+        void Set (const void* ptr);
+        void Reset ();
+
+    private:
+        HazardPointerDomain& domain_;
+        Record* record_;
+    };
+
+    void Retire (void* ptr, detail::RetireDeleter deleter);
+
+    template <typename T>
+    void Retire (T* ptr)
+    {
+        Retire (ptr, &detail::DeleteRetired<T>);
+    }
+
+    // frees the retired pointers of this thread and of exited threads which
+    // are not protected, returns how many were freed
+    size_t Reclaim ();
+
+private:
+    struct Record
+    {
+        Record () : ptr (nullptr), active (false), next (nullptr) {}
+
+        std::atomic<const void*> ptr;
+        std::atomic<bool> active;
+        Record* next;
+        char padding[64 - sizeof (void*) * 3];
+    };
+
+    struct RetireList
+    {
+        explicit RetireList (HazardPointerDomain* d) : domain (d) {}
+
+        HazardPointerDomain* domain;
+        std::vector<detail::Retired> retired;
+    };
+
+    Record* Acquire ();
+    void Release (Record* record);
+    RetireList* Local ();
+    size_t Scan (std::vector<detail::Retired>* retired) const;
+    // scans orphans_, if wait is false only when mutex_ is free
+    size_t ScanOrphans (bool wait);
+
+    static void OnThreadExit (void* ptr);
+
+private:
+    const size_t threshold_;
+    std::atomic<Record*> records_;
+    std::mutex mutex_;
+    std::vector<detail::Retired> orphans_;
+    std::unique_ptr<ThreadLocalPtr> tls_;
+};
+
+class EpochDomain : swift::noncopyable
+{
+    struct Record;
+public:
+    explicit EpochDomain (size_t retire_threshold = 128);
+    ~EpochDomain ();
+
+    // Critical section, nodes reachable when it starts stay alive until it
+    // ends. Guards nest.
+    class Guard : swift::noncopyable
+    {
+    public:
+        explicit Guard (EpochDomain& domain)
+            : domain_ (domain), record_ (domain.Enter ())
+        {
+        }
+
+        ~Guard ()
+        {
+            domain_.Exit (record_);
+        }
+
+    private:
+        EpochDomain& domain_;
+        Record* record_;
+    };
+
+    void Retire (void* ptr, detail::RetireDeleter deleter);
+
+    template <typename T>
+    void Retire (T* ptr)
+    {
+        Retire (ptr, &detail::DeleteRetired<T>);
+    }
+
+    // advances the epoch if every reader has seen it and frees what is two
+    // epochs old, returns how many were freed
+    size_t Reclaim ();
+
+    uint64_t Epoch () const
+    {
+        return epoch_.load (std::memory_order_acquire);
+    }
+
+private:
+    struct Record
+    {
+        explicit Record (EpochDomain* d)
+            : domain (d), state (0), in_use (true), nesting (0), next (nullptr)
+        {
+        }
+
+        EpochDomain* domain;
+        // epoch << 1 | 1 inside a critical section, 0 outside
+        std::atomic<uint64_t> state;
+        std::atomic<bool> in_use;
+        int nesting;
+        Record* next;
+        std::vector<detail::Retired> retired;
+        char padding[64];
+    };
+
+    Record* Local ();
+    Record* Enter ();
+    void Exit (Record* record);
+    bool TryAdvance ();
+    size_t Free (std::vector<detail::Retired>* retired) const;
+    // frees orphans_, if wait is false only when mutex_ is free
+    size_t FreeOrphans (bool wait);
+
+    static void OnThreadExit (void* ptr);
+
+private:
+    const size_t threshold_;
+    char padding0_[64];
+    std::atomic<uint64_t> epoch_;
+    char padding1_[64 - sizeof (std::atomic<uint64_t>)];
+    std::atomic<Record*> records_;
+    std::mutex mutex_;
+    std::vector<detail::Retired> orphans_;
+    std::unique_ptr<ThreadLocalPtr> tls_;
+};
+} // namespace swift
+
+#endif // __SWIFT_BASE_RECLAMATION_H__
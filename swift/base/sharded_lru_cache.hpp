@@ -0,0 +1,292 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SWIFT_BASE_SHARDED_LRU_CACHE_HPP__
+#define __SWIFT_BASE_SHARDED_LRU_CACHE_HPP__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "swift/base/cache_metrics.hpp"
+#include "swift/base/murmurhash3.h"
+
+namespace swift {
+
+// LruCache split into hash partitioned shards, each with its own lock, map
+// and intrusive LRU list, so threads working on different keys rarely meet.
+// The capacity is divided evenly between the shards, so the cache as a whole
+// is only approximately LRU.
+//
+// Get returns a Handle which pins the entry: the value is read in place,
+// without a copy under the lock, and stays valid after the entry is evicted
+// or replaced, until the last handle goes away.
+template<typename KeyType, typename ValueType, typename Hash = std::hash<KeyType> >
+class ShardedLruCache {
+ private:
+  struct Link {
+    Link() : prev(this), next(this) {}
+    Link* prev;
+    Link* next;
+  };
+
+  struct Node : public Link {
+    Node(const KeyType& k, const ValueType& v) : key(k), value(v), refs(1) {}
+
+    const KeyType key;
+    const ValueType value;
+    // one for the cache while the node is in it, one per handle
+    std::atomic<uint32_t> refs;
+  };
+
+  static void Unref(Node* node) {
+    if (1 == node->refs.fetch_sub(1, std::memory_order_acq_rel)) {
+      delete node;
+    }
+  }
+
+ public:
+  class Handle {
+   public:
+    Handle() : node_(nullptr) {}
+    ~Handle() { Reset(); }
+
+    Handle(Handle&& other) : node_(other.node_) {
+      other.node_ = nullptr;
+    }
+
+    Handle& operator=(Handle&& other) {
+      std::swap(node_, other.node_);
+      return *this;
+    }
+
+    explicit operator bool() const { return nullptr != node_; }
+
+    const KeyType& Key() const { return node_->key; }
+    const ValueType& Value() const { return node_->value; }
+    const ValueType& operator*() const { return node_->value; }
+    const ValueType* operator->() const { return &node_->value; }
+
+    void Reset() {
+      if (nullptr != node_) {
+        Unref(node_);
+        node_ = nullptr;
+      }
+    }
+
+   private:
+    friend class ShardedLruCache;
+    explicit Handle(Node* node) : node_(node) {}
+    Handle(const Handle&);
+    Handle& operator=(const Handle&);
+
+    Node* node_;
+  };
+
+ public:
+  /**
+   * @param capacity - total number of entries
+   * @param shards - rounded up to a power of 2
+   */
+  explicit ShardedLruCache(size_t capacity, size_t shards = 16);
+  ~ShardedLruCache();
+
+  void Set(const KeyType& key, const ValueType& value);
+  // an empty handle if the key is not cached
+  Handle Get(const KeyType& key);
+  // copies the value out, like LruCache::Get
+  bool Get(const KeyType& key, ValueType& value);
+  bool Erase(const KeyType& key);
+  size_t Size() const;
+
+  size_t Capacity() const { return shard_capacity_ * shards_.size(); }
+
+  // hit, miss and eviction counts over all shards, and the optional miss
+  // ratio curve; only an enabled curve takes a ThreadLocalPtr id, held until
+  // the cache is destroyed
+  CacheMetrics<KeyType, Hash>& Metrics() { return metrics_; }
+
+ private:
+  ShardedLruCache(const ShardedLruCache&);
+  ShardedLruCache& operator=(const ShardedLruCache&);
+
+  struct Shard {
+    Shard() : size(0) {}
+
+    std::mutex mutex;
+    std::unordered_map<KeyType, Node*, Hash> map;
+    Link lru;  // lru.next is the most recently used
+    size_t size;
+    char padding[64];
+  };
+
+  static void Unlink(Link* link) {
+    link->prev->next = link->next;
+    link->next->prev = link->prev;
+  }
+
+  static void PushFront(Link* head, Link* link) {
+    link->next = head->next;
+    link->prev = head;
+    head->next->prev = link;
+    head->next = link;
+  }
+
+  Shard& ShardOf(const KeyType& key) {
+    // std::hash of integers is the identity, mix before taking the low bits
+    uint64_t h = fmix64(static_cast<uint64_t>(Hash()(key)));
+    return *shards_[h & (shards_.size() - 1)];
+  }
+
+  size_t shard_capacity_;
+  std::vector<std::unique_ptr<Shard> > shards_;
+  CacheMetrics<KeyType, Hash> metrics_;
+};
+
+template<typename KeyType, typename ValueType, typename Hash>
+swift::ShardedLruCache<KeyType, ValueType, Hash>::ShardedLruCache(size_t capacity, size_t shards) {
+  size_t count = 1;
+  while (count < shards) {
+    count <<= 1;
+  }
+
+  shard_capacity_ = (capacity + count - 1) / count;
+  if (0 == shard_capacity_) {
+    shard_capacity_ = 1;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    shards_.push_back(std::unique_ptr<Shard>(new Shard()));
+  }
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+swift::ShardedLruCache<KeyType, ValueType, Hash>::~ShardedLruCache() {
+  for (auto& shard : shards_) {
+    Link* link = shard->lru.next;
+    while (link != &shard->lru) {
+      Link* next = link->next;
+      Unref(static_cast<Node*>(link));
+      link = next;
+    }
+  }
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+void swift::ShardedLruCache<KeyType, ValueType, Hash>::Set(const KeyType& key, const ValueType& value) {
+  Node* node = new Node(key, value);
+  Node* replaced = nullptr;
+  Node* evicted = nullptr;
+  Shard& shard = ShardOf(key);
+  {
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto result = shard.map.insert(std::make_pair(key, node));
+    if (!result.second) {
+      replaced = result.first->second;
+      Unlink(replaced);
+      result.first->second = node;
+    } else {
+      ++shard.size;
+    }
+    PushFront(&shard.lru, node);
+
+    if (shard.size > shard_capacity_) {
+      evicted = static_cast<Node*>(shard.lru.prev);
+      Unlink(evicted);
+      shard.map.erase(evicted->key);
+      --shard.size;
+    }
+  }
+
+  // values are destroyed outside the lock
+  if (nullptr != replaced) {
+    Unref(replaced);
+  }
+  if (nullptr != evicted) {
+    metrics_.Evict();
+    Unref(evicted);
+  }
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+typename swift::ShardedLruCache<KeyType, ValueType, Hash>::Handle
+swift::ShardedLruCache<KeyType, ValueType, Hash>::Get(const KeyType& key) {
+  Shard& shard = ShardOf(key);
+  std::unique_lock<std::mutex> lock(shard.mutex);
+
+  auto it = shard.map.find(key);
+  if (it == shard.map.end()) {
+    metrics_.Miss(key);
+    return Handle();
+  }
+
+  metrics_.Hit(key);
+  Node* node = it->second;
+  if (shard.lru.next != node) {
+    Unlink(node);
+    PushFront(&shard.lru, node);
+  }
+  node->refs.fetch_add(1, std::memory_order_relaxed);
+  return Handle(node);
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+bool swift::ShardedLruCache<KeyType, ValueType, Hash>::Get(const KeyType& key, ValueType& value) {
+  Handle handle = Get(key);
+  if (!handle) {
+    return false;
+  }
+
+  value = handle.Value();
+  return true;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+bool swift::ShardedLruCache<KeyType, ValueType, Hash>::Erase(const KeyType& key) {
+  Node* node = nullptr;
+  Shard& shard = ShardOf(key);
+  {
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto it = shard.map.find(key);
+    if (it == shard.map.end()) {
+      return false;
+    }
+
+    node = it->second;
+    shard.map.erase(it);
+    Unlink(node);
+    --shard.size;
+  }
+
+  Unref(node);
+  return true;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+size_t swift::ShardedLruCache<KeyType, ValueType, Hash>::Size() const {
+  size_t size = 0;
+  for (auto& shard : shards_) {
+    std::unique_lock<std::mutex> lock(shard->mutex);
+    size += shard->size;
+  }
+  return size;
+}
+
+} // namespace swift
+
+#endif // __SWIFT_BASE_SHARDED_LRU_CACHE_HPP__
@@ -0,0 +1,241 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SWIFT_BASE_SLAB_ALLOCATOR_H__
+#define __SWIFT_BASE_SLAB_ALLOCATOR_H__
+
+#include <new>
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+#include "swift/base/noncopyable.hpp"
+
+namespace swift {
+namespace detail {
+
+/**
+ * The slabs behind SlabAllocator, shared by an allocator, its copies and
+ * rebinds. Blocks are sized in steps of max_align_t, every size has its own
+ * free list, and the slabs of a size double from 16 blocks up to 64KB.
+ */
+class SlabPool : swift::noncopyable
+{
+public:
+    SlabPool ()
+    {
+    }
+
+    ~SlabPool ()
+    {
+        for (size_t i = 0; i < slabs_.size (); ++i) {
+            ::operator delete (slabs_[i]);
+        }
+    }
+
+    void* Allocate (size_t size)
+    {
+        SizeClass& sc = SizeClassOf (size);
+        if (!sc.free_) {
+            Refill (sc, size);
+        }
+
+        Block* block = sc.free_;
+        sc.free_ = block->next_;
+
+        return block;
+    }
+
+    void Deallocate (void* ptr, size_t size)
+    {
+        SizeClass& sc = SizeClassOf (size);
+        Block* block = static_cast<Block*> (ptr);
+        block->next_ = sc.free_;
+        sc.free_ = block;
+    }
+
+private:
+    struct Block
+    {
+        Block* next_;	// the next free block
+    };
+
+    struct SizeClass
+    {
+        Block* free_;		// the first free block
+        size_t slab_num_;	// the number of blocks of the next slab
+    };
+
+    //
+    // The step of block sizes, every block is aligned to it
+    //
+    static const size_t BLOCK_ALIGN = alignof(std::max_align_t);
+
+    //
+    // The number of blocks of the first slab
+    //
+    static const size_t SLAB_MIN_NUM = 16;
+
+    //
+    // Slabs stop doubling at this size
+    //
+    static const size_t SLAB_MAX_BYTES = 65536;
+
+    static size_t BlockSize (size_t size)
+    {
+        return (size + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN;
+    }
+
+    SizeClass& SizeClassOf (size_t size)
+    {
+        size_t index = BlockSize (size) / BLOCK_ALIGN - 1;
+        if (index >= classes_.size ()) {
+            SizeClass empty = { nullptr, SLAB_MIN_NUM };
+            classes_.resize (index + 1, empty);
+        }
+
+        return classes_[index];
+    }
+
+    /**
+    * Carve a new slab into free blocks
+    */
+    void Refill (SizeClass& sc, size_t size)
+    {
+        size_t bsize = BlockSize (size);
+        char* slab = static_cast<char*> (::operator new (sc.slab_num_ * bsize));
+        slabs_.push_back (slab);
+
+        for (size_t i = sc.slab_num_; i > 0; --i) {
+            Block* block = reinterpret_cast<Block*> (slab + (i - 1) * bsize);
+            block->next_ = sc.free_;
+            sc.free_ = block;
+        }
+
+        if (sc.slab_num_ * bsize * 2 <= SLAB_MAX_BYTES) {
+            sc.slab_num_ *= 2;
+        }
+    }
+
+private:
+    std::vector<SizeClass> classes_;	// indexed by block size / BLOCK_ALIGN - 1
+    std::vector<void*> slabs_;			// every slab, freed with the pool
+};
+} // namespace detail
+
+/**
+ * Allocator for node based containers, which allocate one object at a time.
+ * Objects are carved from slabs and freed objects go to a free list for the
+ * next allocation, so churn does not reach malloc. The slabs are only
+ * released with the last allocator using them.
+ *
+ * A default constructed allocator starts a new pool, copies and rebinds
+ * share it and compare equal, so memory may be freed through any of them.
+ * Like the containers using it, a pool is not thread safe. Allocations of
+ * several objects at once go straight to operator new.
+ *
+ * @param T the object type
+ */
+template <class T>
+class SlabAllocator
+{
+    static_assert (alignof(T) <= alignof(std::max_align_t),
+                   "SlabAllocator does not support over-aligned types");
+
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <class U>
+    struct rebind
+    {
+        typedef SlabAllocator<U> other;
+    };
+
+public:
+    SlabAllocator ()
+        : pool_ (std::make_shared<detail::SlabPool> ())
+    {
+    }
+
+    template <class U>
+    SlabAllocator (const SlabAllocator<U>& other)
+        : pool_ (other.pool_)
+    {
+    }
+
+    /**
+    * Allocate memory for num objects
+    *
+    * @param [in] num the number of objects
+    *
+    * @return uninitialized memory
+    */
+    T* allocate (size_t num)
+    {
+        if (1 != num) {
+            return static_cast<T*> (::operator new (num * sizeof(T)));
+        }
+
+        return static_cast<T*> (pool_->Allocate (sizeof(T)));
+    }
+
+    /**
+    * Free memory returned by allocate
+    *
+    * @param [in] ptr the memory
+    * @param [in] num the number of objects, as passed to allocate
+    */
+    void deallocate (T* ptr, size_t num)
+    {
+        if (1 != num) {
+            ::operator delete (ptr);
+            return;
+        }
+
+        pool_->Deallocate (ptr, sizeof(T));
+    }
+
+    size_t max_size () const
+    {
+        return static_cast<size_t> (-1) / sizeof(T);
+    }
+
+    template <class U>
+    bool operator== (const SlabAllocator<U>& rhs) const
+    {
+        return pool_ == rhs.pool_;
+    }
+
+    template <class U>
+    bool operator!= (const SlabAllocator<U>& rhs) const
+    {
+        return pool_ != rhs.pool_;
+    }
+
+private:
+    template <class U>
+    friend class SlabAllocator;
+
+    std::shared_ptr<detail::SlabPool> pool_;	// shared by copies and rebinds
+};
+
+} // namespace swift
+
+#endif // __SWIFT_BASE_SLAB_ALLOCATOR_H__
@@ -15,19 +15,71 @@
 #include "swift/base/threadlocal.h"
 #include "swift/base/likely.h"
 
+#include <sched.h>
+#include <stdexcept>
+
 namespace swift {
 
 std::mutex ThreadLocalPtr::StaticMeta::kLock_;
 __thread ThreadLocalPtr::ThreadData* ThreadLocalPtr::StaticMeta::kTls_ = nullptr;
 
+const uint32_t ThreadLocalPtr::kChunkSize;
+const uint32_t ThreadLocalPtr::kMaxChunks;
+
+// public
+ThreadLocalPtr::ThreadData::ThreadData () : next (nullptr), prev (nullptr)
+{
+    for (uint32_t i = 0; i < kMaxChunks; ++i) {
+        chunks[i].store (nullptr, std::memory_order_relaxed);
+    }
+}
+
+// public
+ThreadLocalPtr::ThreadData::~ThreadData ()
+{
+    for (uint32_t i = 0; i < kMaxChunks; ++i) {
+        delete [] chunks[i].load (std::memory_order_relaxed);
+    }
+}
+
+// public
+ThreadLocalPtr::Entry* ThreadLocalPtr::ThreadData::Find (uint32_t id) const
+{
+    Entry* chunk = chunks[id / kChunkSize].load (std::memory_order_acquire);
+    if (nullptr == chunk) {
+        return nullptr;
+    }
+
+    return &chunk[id % kChunkSize];
+}
+
+// public
+ThreadLocalPtr::Entry* ThreadLocalPtr::ThreadData::Ensure (uint32_t id)
+{
+    std::atomic<Entry*>& slot = chunks[id / kChunkSize];
+    Entry* chunk = slot.load (std::memory_order_relaxed);
+    if (UNLIKELY (nullptr == chunk)) {
+        chunk = new Entry[kChunkSize];
+        slot.store (chunk, std::memory_order_release);
+    }
+
+    return &chunk[id % kChunkSize];
+}
+
 // public
-ThreadLocalPtr::StaticMeta::StaticMeta () : next_instance_id_ (0)
+ThreadLocalPtr::StaticMeta::StaticMeta () : next_instance_id_ (0), epoch_ (0)
 {
     if (0 != pthread_key_create (&key_, &OnThreadExit)) {
         throw std::runtime_error ("pthread_key_create failed");
     }
 
-    head_.next = &head_;
+    for (uint32_t i = 0; i < kMaxChunks; ++i) {
+        slots_[i].store (nullptr, std::memory_order_relaxed);
+    }
+    readers_[0].store (0, std::memory_order_relaxed);
+    readers_[1].store (0, std::memory_order_relaxed);
+
+    head_.next.store (&head_, std::memory_order_relaxed);
     head_.prev = &head_;
 }
 
@@ -36,6 +88,21 @@ uint32_t ThreadLocalPtr::StaticMeta::GetId ()
 {
     std::lock_guard<std::mutex> lock (kLock_);
     if (free_instance_ids_.empty ()) {
+        if (next_instance_id_ >= kChunkSize * kMaxChunks) {
+            throw std::runtime_error ("too many ThreadLocalPtr instances");
+        }
+
+        // slots are looked up without the lock, allocate their chunk now
+        uint32_t chunk = next_instance_id_ / kChunkSize;
+        if (nullptr == slots_[chunk].load (std::memory_order_relaxed)) {
+            Slot* slots = new Slot[kChunkSize];
+            for (uint32_t i = 0; i < kChunkSize; ++i) {
+                slots[i].handler.store (nullptr, std::memory_order_relaxed);
+                slots[i].unrefs.store (0, std::memory_order_relaxed);
+            }
+            slots_[chunk].store (slots, std::memory_order_release);
+        }
+
         return next_instance_id_++;
     }
 
@@ -59,42 +126,52 @@ uint32_t ThreadLocalPtr::StaticMeta::PeekId () const
 void* ThreadLocalPtr::StaticMeta::Get (uint32_t id)
 {
     ThreadLocalPtr::ThreadData* data = GetThreadLocal ();
-    if (UNLIKELY (id >= data->entries.size ())) {
+    Entry* entry = data->Find (id);
+    if (UNLIKELY (nullptr == entry)) {
         return nullptr;
     }
 
-    return data->entries[id].ptr.load (std::memory_order_relaxed);
+    return entry->ptr.load (std::memory_order_acquire);
 }
 
 // public
 void ThreadLocalPtr::StaticMeta::Reset (uint32_t id, void* ptr)
 {
-    assert (id >= 0);
     ThreadLocalPtr::ThreadData* data = GetThreadLocal ();
-    if (UNLIKELY (id >= data->entries.size ())) {
-        std::lock_guard<std::mutex> lock (kLock_);
-        data->entries.resize (id + 1);
-    }
-
-    data->entries[id].ptr.store (ptr, std::memory_order_relaxed);
+    data->Ensure (id)->ptr.store (ptr, std::memory_order_release);
 }
 
 // public
 void ThreadLocalPtr::StaticMeta::ReclaimId (uint32_t id)
 {
-    assert (id >= 0);
-    std::lock_guard<std::mutex> lock (kLock_);
-    UnrefHandler handler = GetHandler (id);
-    for (ThreadLocalPtr::ThreadData* data = head_.next; data != &head_; data = data->next) {
-        if (id < data->entries.size ()) {
-            void *ptr = data->entries[id].ptr.exchange (nullptr, std::memory_order_relaxed);
-            if (nullptr != ptr && nullptr != handler) {
-                handler (ptr);
+    Slot& slot = SlotOf (id);
+    {
+        std::lock_guard<std::mutex> lock (kLock_);
+        UnrefHandler handler = GetHandler (id);
+        for (ThreadLocalPtr::ThreadData* data = head_.next.load (std::memory_order_acquire);
+             data != &head_;
+             data = data->next.load (std::memory_order_acquire)) {
+            Entry* entry = data->Find (id);
+            if (nullptr != entry) {
+                void *ptr = entry->ptr.exchange (nullptr, std::memory_order_acquire);
+                if (nullptr != ptr && nullptr != handler) {
+                    handler (ptr);
+                }
             }
         }
+
+        // a thread exiting right now may have taken its pointer before us,
+        // once its read section is over it has counted it in unrefs
+        slot.handler.store (nullptr, std::memory_order_relaxed);
+        Synchronize ();
+    }
+
+    // the handlers run without kLock_, they may use ThreadLocals themselves
+    while (0 != slot.unrefs.load (std::memory_order_acquire)) {
+        sched_yield ();
     }
 
-    handler_map_[id] = nullptr;
+    std::lock_guard<std::mutex> lock (kLock_);
     free_instance_ids_.push_back (id);
 }
 
@@ -103,79 +180,125 @@ void ThreadLocalPtr::StaticMeta::Scrape (uint32_t id,
                                          std::vector<void*>* ptrs,
                                          const void* replacement)
 {
-    std::lock_guard<std::mutex> lock (kLock_);
-    for (ThreadLocalPtr::ThreadData *data = head_.next; data != &head_; data = data->next) {
-        if (id < data->entries.size ()) {
-            void *ptr = data->entries[id].ptr.exchange (
-                const_cast<void*>(replacement), std::memory_order_relaxed);
+    uint32_t index = ReadLock ();
+    for (ThreadLocalPtr::ThreadData *data = head_.next.load (std::memory_order_acquire);
+         data != &head_;
+         data = data->next.load (std::memory_order_acquire)) {
+        Entry* entry = data->Find (id);
+        if (nullptr != entry) {
+            void *ptr = entry->ptr.exchange (
+                const_cast<void*>(replacement), std::memory_order_acq_rel);
             if (ptr != nullptr) {
                 ptrs->push_back (ptr);
             }
         }
     }
+    ReadUnlock (index);
 }
 
 // public
-void* ThreadLocalPtr::StaticMeta::Swap (uint32_t id, void* ptr)
+bool ThreadLocalPtr::StaticMeta::Fold (uint32_t id, FoldFunc func, void* res) const
 {
-    assert (id >= 0);
-    ThreadLocalPtr::ThreadData* data = GetThreadLocal ();
-    if (UNLIKELY (id >= data->entries.size ())) {
-        std::lock_guard<std::mutex> lock (kLock_);
-        data->entries.resize (id + 1);
+    uint32_t index = ReadLock ();
+    for (ThreadLocalPtr::ThreadData *data = head_.next.load (std::memory_order_acquire);
+         data != &head_;
+         data = data->next.load (std::memory_order_acquire)) {
+        Entry* entry = data->Find (id);
+        if (nullptr != entry) {
+            void *ptr = entry->ptr.load (std::memory_order_acquire);
+            if (nullptr != ptr) {
+                func (ptr, res);
+            }
+        }
     }
+    ReadUnlock (index);
 
-    return data->entries[id].ptr.exchange (ptr, std::memory_order_relaxed);
+    // an exiting thread counts its value in unrefs before taking it, so a
+    // value the walk missed is seen here until its handler returned
+    return 0 == SlotOf (id).unrefs.load (std::memory_order_seq_cst);
 }
 
 // public
-bool ThreadLocalPtr::StaticMeta::CompareAndSwap (uint32_t id, void* ptr, void*& expected)
+void* ThreadLocalPtr::StaticMeta::Swap (uint32_t id, void* ptr)
 {
-    assert (id >= 0);
     ThreadLocalPtr::ThreadData* data = GetThreadLocal ();
-    if (UNLIKELY (id >= data->entries.size ())) {
-        std::lock_guard<std::mutex> lock (kLock_);
-        data->entries.resize (id + 1);
-    }
+    return data->Ensure (id)->ptr.exchange (ptr, std::memory_order_acq_rel);
+}
 
-    return data->entries[id].ptr.compare_exchange_strong (expected, ptr,
-           std::memory_order_relaxed, std::memory_order_relaxed);
+// public
+bool ThreadLocalPtr::StaticMeta::CompareAndSwap (uint32_t id, void* ptr, void*& expected)
+{
+    ThreadLocalPtr::ThreadData* data = GetThreadLocal ();
+    return data->Ensure (id)->ptr.compare_exchange_strong (expected, ptr,
+           std::memory_order_acq_rel, std::memory_order_acquire);
 }
 
 // public
 void ThreadLocalPtr::StaticMeta::SetHandler (uint32_t id, UnrefHandler handler)
 {
-    assert (id >= 0);
     std::lock_guard<std::mutex> lock (kLock_);
-    handler_map_[id] = handler;
+    SlotOf (id).handler.store (handler, std::memory_order_release);
 }
 
 // private
-UnrefHandler ThreadLocalPtr::StaticMeta::GetHandler (uint32_t id) const
+ThreadLocalPtr::StaticMeta::Slot& ThreadLocalPtr::StaticMeta::SlotOf (uint32_t id) const
 {
-    auto it = handler_map_.find (id);
-    if (it == handler_map_.end ()) {
-        return nullptr;
-    }
+    // allocated by GetId before the id was handed out
+    return slots_[id / kChunkSize].load (std::memory_order_acquire)[id % kChunkSize];
+}
 
-    return it->second;
+// private
+UnrefHandler ThreadLocalPtr::StaticMeta::GetHandler (uint32_t id) const
+{
+    return SlotOf (id).handler.load (std::memory_order_acquire);
 }
 
 //private
 void ThreadLocalPtr::StaticMeta::AddThreadData (ThreadData* data)
 {
-    data->next = &head_;
-    data->prev = head_.prev;
-    head_.prev->next = data;
+    // data is complete before readers can reach it
+    ThreadData* last = head_.prev;
+    data->next.store (&head_, std::memory_order_relaxed);
+    data->prev = last;
+    last->next.store (data, std::memory_order_release);
     head_.prev = data;
 }
 
 // private
 void ThreadLocalPtr::StaticMeta::RemoveThreadData (ThreadData* data)
 {
-    data->next->prev = data->prev;
-    data->prev->next = data->next;
-    data->next = data->prev = data;
+    // data->next is left alone, readers standing on data go on from there
+    ThreadData* next = data->next.load (std::memory_order_relaxed);
+    next->prev = data->prev;
+    data->prev->next.store (next, std::memory_order_release);
+    data->prev = data;
+}
+
+// private
+uint32_t ThreadLocalPtr::StaticMeta::ReadLock () const
+{
+    uint32_t index = epoch_.load (std::memory_order_acquire) & 1;
+    readers_[index].fetch_add (1, std::memory_order_seq_cst);
+    return index;
+}
+
+// private
+void ThreadLocalPtr::StaticMeta::ReadUnlock (uint32_t index) const
+{
+    readers_[index].fetch_sub (1, std::memory_order_release);
+}
+
+// private, kLock_ held
+void ThreadLocalPtr::StaticMeta::Synchronize ()
+{
+    // flip twice, a reader that read the old epoch just before the first
+    // flip registers in the counter waited for by the second one
+    for (int i = 0; i < 2; ++i) {
+        uint32_t index = epoch_.fetch_add (1, std::memory_order_seq_cst) & 1;
+        while (0 != readers_[index].load (std::memory_order_acquire)) {
+            sched_yield ();
+        }
+    }
 }
 
 // static private
@@ -186,21 +309,51 @@ void ThreadLocalPtr::StaticMeta::OnThreadExit (void* ptr)
 
     ThreadLocalPtr::StaticMeta* instance = Instance ();
     pthread_setspecific (instance->key_, nullptr);
+    kTls_ = nullptr;
+
+    // Take the values with their handlers. Each one is counted in unrefs of
+    // its id first, so ReclaimId waits for the handler, and a Fold that finds
+    // the value gone knows it is not handled yet.
+    std::vector<Unref> unrefs;
+    for (uint32_t chunk = 0; chunk < kMaxChunks; ++chunk) {
+        Entry* entries = data->chunks[chunk].load (std::memory_order_relaxed);
+        if (nullptr == entries) {
+            continue;
+        }
 
-    std::lock_guard<std::mutex> lock (kLock_);
-    instance->RemoveThreadData (data);
+        for (uint32_t i = 0; i < kChunkSize; ++i) {
+            // only this thread sets its values, it may find one taken by
+            // Scrape or ReclaimId meanwhile
+            if (nullptr == entries[i].ptr.load (std::memory_order_relaxed)) {
+                continue;
+            }
 
-    uint32_t id = 0;
-    for (auto &it : data->entries) {
-        void *p = it.ptr.load (std::memory_order_relaxed);
-        if (nullptr != p) {
-            UnrefHandler handler = instance->GetHandler (id);
+            Slot& slot = instance->SlotOf (chunk * kChunkSize + i);
+            uint32_t index = instance->ReadLock ();
+            slot.unrefs.fetch_add (1, std::memory_order_seq_cst);
+            void *p = entries[i].ptr.exchange (nullptr, std::memory_order_acq_rel);
+            UnrefHandler handler = nullptr != p ? slot.handler.load (std::memory_order_acquire) : nullptr;
             if (nullptr != handler) {
-                handler (p);
+                Unref unref = { p, handler, &slot.unrefs };
+                unrefs.push_back (unref);
+            } else {
+                slot.unrefs.fetch_sub (1, std::memory_order_release);
             }
+            instance->ReadUnlock (index);
         }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock (kLock_);
+        instance->RemoveThreadData (data);
+        instance->Synchronize ();
+    }
 
-        ++id;
+    // no Fold or Scrape reads the values any more. The handlers run without
+    // kLock_, they may use other ThreadLocals
+    for (size_t i = 0; i < unrefs.size (); ++i) {
+        unrefs[i].handler (unrefs[i].ptr);
+        unrefs[i].unrefs->fetch_sub (1, std::memory_order_release);
     }
 
     delete data;
@@ -209,27 +362,29 @@ void ThreadLocalPtr::StaticMeta::OnThreadExit (void* ptr)
 // static private
 ThreadLocalPtr::ThreadData* ThreadLocalPtr::StaticMeta::GetThreadLocal ()
 {
-    ThreadLocalPtr::ThreadData* data = static_cast<ThreadLocalPtr::ThreadData*>(
-        pthread_getspecific (Instance ()->key_));
-    if (UNLIKELY (data == nullptr)) {
-        auto instance = Instance ();
-        data = new ThreadLocalPtr::ThreadData ();
+    if (LIKELY (nullptr != kTls_)) {
+        return kTls_;
+    }
+
+    auto instance = Instance ();
+    ThreadLocalPtr::ThreadData* data = new ThreadLocalPtr::ThreadData ();
+    {
+        std::lock_guard<std::mutex> lock (kLock_);
+        instance->AddThreadData (data);
+    }
+
+    if (0 != pthread_setspecific (instance->key_, data)) {
         {
             std::lock_guard<std::mutex> lock (kLock_);
-            instance->AddThreadData (data);
+            instance->RemoveThreadData (data);
+            instance->Synchronize ();
         }
 
-        if (0 != pthread_setspecific (instance->key_, data)) {
-            {
-                std::lock_guard<std::mutex> lock (kLock_);
-                instance->RemoveThreadData (data);
-            }
-
-            delete data;
-            throw std::runtime_error ("pthread_setspecific failed");
-        }
+        delete data;
+        throw std::runtime_error ("pthread_setspecific failed");
     }
 
+    kTls_ = data;
     return data;
 }
 
@@ -278,6 +433,12 @@ void ThreadLocalPtr::Scrape (std::vector<void*>* ptrs, const void* replacement)
     Instance ()->Scrape (id_, ptrs, replacement);
 }
 
+// public
+bool ThreadLocalPtr::Fold (FoldFunc func, void* res) const
+{
+    return Instance ()->Fold (id_, func, res);
+}
+
 // public
 ThreadLocalPtr::StaticMeta* ThreadLocalPtr::Instance ()
 {
@@ -21,14 +21,18 @@
 #include <memory>
 #include <vector>
 #include <mutex>
-#include <unordered_map>
 
 #include "swift/base/noncopyable.hpp"
 
 namespace swift {
 
 // ThreadLocalPtr is stolen from the rocksdb and change some implementation
+//
+// The UnrefHandler gets the value of a thread when it exits, once no Fold
+// can still be reading it, and the values left when the ThreadLocalPtr is
+// destroyed. The destructor waits for the handlers of exiting threads.
 typedef void (*UnrefHandler) (void* ptr);
+typedef void (*FoldFunc) (void* ptr, void* res);
 class ThreadLocalPtr
 {
 public:
@@ -41,22 +45,44 @@ public:
     bool CompareAndSwap (void* ptr, void*& expected);
     void Scrape (std::vector<void*>* ptrs, const void* replacement);
 
+    // Calls func (ptr, res) for the non-null value of every live thread,
+    // leaving the values in place, concurrently with Get/Reset. Returns false
+    // if a thread exiting meanwhile may have taken its value before the walk
+    // reached it, and its UnrefHandler has not returned yet.
+    bool Fold (FoldFunc func, void* res) const;
+
 protected:
+    // A thread's entries live in fixed chunks of kChunkSize which the thread
+    // allocates the first time it touches one of their ids and never moves,
+    // so Get/Reset never take a lock and Scrape may read them concurrently.
+    static const uint32_t kChunkSize = 256;
+    static const uint32_t kMaxChunks = 256;
+
     struct Entry
     {
         Entry () : ptr (nullptr) {}
-        Entry (const Entry& other) : ptr (other.ptr.load (std::memory_order_relaxed)) {}
         std::atomic<void*> ptr;
     };
 
     struct ThreadData
     {
-        ThreadData () : next (nullptr), prev (nullptr) {}
-        std::vector<Entry> entries;
-        ThreadData* next;
+        ThreadData ();
+        ~ThreadData ();
+
+        // nullptr if the chunk of id was never allocated
+        Entry* Find (uint32_t id) const;
+        // owner thread only
+        Entry* Ensure (uint32_t id);
+
+        std::atomic<Entry*> chunks[kMaxChunks];
+        std::atomic<ThreadData*> next;
         ThreadData* prev;
     };
 
+    // The thread list is changed under kLock_ and read without it: readers
+    // (Scrape, Fold, thread exit) register in readers_ of the current epoch,
+    // a removed ThreadData is deleted after Synchronize (), once every reader
+    // that might still see it is gone.
     class StaticMeta
     {
     public:
@@ -69,14 +95,34 @@ protected:
         void* Swap (uint32_t id, void* ptr);
         void ReclaimId (uint32_t id);
         void Scrape (uint32_t id, std::vector<void*>* ptrs, const void* replacement);
+        bool Fold (uint32_t id, FoldFunc func, void* res) const;
         bool CompareAndSwap (uint32_t id, void* ptr, void*& expected);
         void SetHandler (uint32_t id, UnrefHandler handler);
 
     private:
+        struct Slot
+        {
+            std::atomic<UnrefHandler> handler;
+            // values taken by exiting threads whose handler has not returned
+            std::atomic<int32_t> unrefs;
+        };
+
+        struct Unref
+        {
+            void* ptr;
+            UnrefHandler handler;
+            std::atomic<int32_t>* unrefs;
+        };
+
+        Slot& SlotOf (uint32_t id) const;
         UnrefHandler GetHandler (uint32_t id) const;
         void AddThreadData (ThreadData* data);
         void RemoveThreadData (ThreadData* data);
 
+        uint32_t ReadLock () const;
+        void ReadUnlock (uint32_t index) const;
+        void Synchronize ();
+
     private:
         static void OnThreadExit (void* ptr);
         static ThreadData* GetThreadLocal ();
@@ -86,7 +132,9 @@ protected:
         pthread_key_t key_;
         uint32_t next_instance_id_;
         std::vector<uint32_t> free_instance_ids_;
-        std::unordered_map<uint32_t, UnrefHandler> handler_map_;
+        std::atomic<Slot*> slots_[kMaxChunks];
+        std::atomic<uint32_t> epoch_;
+        mutable std::atomic<int64_t> readers_[2];
 
         static std::mutex kLock_;
         static __thread ThreadData *kTls_;
@@ -13,11 +13,15 @@
 */
 
 #include <thread>
+#include <sched.h>
+#include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "swift/base/threadpool.h"
 #include "swift/base/exception.h"
 #include "swift/base/logging.h"
+#include "swift/base/processinformation.h"
 
 namespace swift {
 namespace detail {
@@ -167,13 +171,33 @@ private:
     std::condition_variable_any condition_;
 };
 
+static void RunTask (const ThreadPool::Task& t)
+{
+    try {
+        t ();
+    }
+    catch (Exception& ex) {
+        LOG(ERROR) << "Unhandled Exception: " << ex.what () << "\n";
+        LOG(ERROR) << "BackStack: " << ex.GetStackTrace () << "\n";
+    }
+    catch (std::exception& ex) {
+        LOG(ERROR) << "Unhandled std::exception: " << ex.what () << "\n";
+    }
+    catch (...) {
+        LOG(ERROR) << "Unhandled non-exception in worker thread\n";
+    }
+}
+
 } // namespace detail
 
 class ThreadPool::Worker : swift::noncopyable
 {
 public:
-    explicit Worker (ThreadPool& owner)
+    // cpus is empty if the worker should not be pinned
+    Worker (ThreadPool& owner, int node, const std::vector<int>& cpus)
         : owner_ (owner)
+        , node_ (node)
+        , cpus_ (cpus)
         , is_done_ (true)
         , thread_ (std::bind (&Worker::Loop, this))
     {
@@ -203,28 +227,42 @@ public:
         task_.Put (std::move (t));
     }
 
+    int GetNode () const
+    {
+        return node_;
+    }
+
 private:
+    void BindCpus ()
+    {
+        if (cpus_.empty ()) {
+            return;
+        }
+
+        cpu_set_t set;
+        CPU_ZERO (&set);
+        for (auto cpu : cpus_) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) {
+                CPU_SET (cpu, &set);
+            }
+        }
+
+        int err = pthread_setaffinity_np (pthread_self (), sizeof(set), &set);
+        if (0 != err) {
+            LOG(WARNING) << "Bind worker to node " << node_ << " failed: " << strerror (err);
+        }
+    }
+
     void Loop ()
     {
+        BindCpus ();
         while (true) {
             ThreadPool::Task t = std::move (task_.Take ());
             if (nullptr == t) {
                 break; // ends the thread
             }
 
-            try {
-                t ();
-            }
-            catch (Exception& ex) {
-                LOG(ERROR) << "Unhandled Exception: " << ex.what () << "\n";
-                LOG(ERROR) << "BackStack: " << ex.GetStackTrace () << "\n";
-            }
-            catch (std::exception& ex) {
-                LOG(ERROR) << "Unhandled std::exception: " << ex.what () << "\n";
-            }
-            catch (...) {
-                LOG(ERROR) << "Unhandled non-exception in worker thread\n";
-            }
+            detail::RunTask (t);
 
             is_done_ = true;
             owner_.TaskDone (this);
@@ -233,6 +271,8 @@ private:
 
 private:
     ThreadPool& owner_;
+    const int node_;
+    const std::vector<int> cpus_;
     detail::MVar<ThreadPool::Task> task_;
     std::atomic<bool> is_done_;
     std::thread thread_;
@@ -242,35 +282,69 @@ private:
 ThreadPool::ThreadPool (int threads_number /*= 4*/)
     : mutex_ ()
     , condition_ ()
-    , free_workers_ ()
-    , tasks_ ()
+    , nodes_ ()
+    , cpu_to_node_ ()
+    , tasks_remaining_ (0)
+    , threads_number_ (threads_number)
+    , mode_ (AFFINITY_NONE)
+{
+    assert (threads_number > 0);
+    InitializeNodes ();
+}
+
+// public
+ThreadPool::ThreadPool (int threads_number, AffinityMode mode)
+    : mutex_ ()
+    , condition_ ()
+    , nodes_ ()
+    , cpu_to_node_ ()
     , tasks_remaining_ (0)
     , threads_number_ (threads_number)
+    , mode_ (mode)
 {
     assert (threads_number > 0);
+    InitializeNodes ();
 }
 
 // public
 ThreadPool::~ThreadPool ()
 {
     Join ();
-    assert (tasks_.empty ());
-    assert (static_cast<int>(free_workers_.size ()) == threads_number_);
-    while (!free_workers_.empty ()) {
-        delete free_workers_.front ();
-        free_workers_.pop_front ();
+    int workers = 0;
+    for (auto& node : nodes_) {
+        assert (node.tasks.empty ());
+        workers += static_cast<int>(node.free_workers.size ());
+        while (!node.free_workers.empty ()) {
+            delete node.free_workers.front ();
+            node.free_workers.pop_front ();
+        }
     }
+
+    assert (workers == threads_number_);
+    (void)workers;
 }
 
 // public
 void ThreadPool::Start ()
 {
     assert (threads_number_ > 0);
-    int count = threads_number_;
     std::lock_guard<std::mutex> lock (mutex_);
-    while (count-- > 0) {
-        Worker* worker = new Worker (*this);
-        free_workers_.push_back (worker);
+    for (int i = 0; i < threads_number_; ++i) {
+        int index = i % GetNodeCount ();
+        Node& node = nodes_[index];
+        std::vector<int> cpus;
+        if (AFFINITY_CORE == mode_) {
+            // spread the workers over the cpus in node order, so consecutive
+            // workers are siblings rather than on different sockets
+            cpus.push_back (node.cpus[(i / GetNodeCount ()) % node.cpus.size ()]);
+        }
+        else if (AFFINITY_NUMA_NODE == mode_) {
+            cpus = node.cpus;
+        }
+
+        Worker* worker = new Worker (*this, index, cpus);
+        node.free_workers.push_back (worker);
+        ++node.workers_number;
     }
 }
 
@@ -286,41 +360,157 @@ void ThreadPool::Join ()
 // public
 void ThreadPool::Schedule (const Task& task)
 {
-    std::lock_guard<std::mutex> lock (mutex_);
-    ++tasks_remaining_;
-    if (!free_workers_.empty ()) {
-        free_workers_.front ()->SetTask (task);
-        free_workers_.pop_front ();
-    }
-    else {
-        tasks_.push_back (task);
-    }
+    ScheduleOnNode (task, kAnyNode);
 }
 
 //public
 void ThreadPool::Schedule (Task&& task)
 {
+    ScheduleOnNode (std::move (task), kAnyNode);
+}
+
+// public
+void ThreadPool::ScheduleOnNode (const Task& task, int node)
+{
+    int index = ResolveNode (node);
+    std::lock_guard<std::mutex> lock (mutex_);
+    ++tasks_remaining_;
+    Dispatch (task, index);
+}
+
+// public
+void ThreadPool::ScheduleOnNode (Task&& task, int node)
+{
+    int index = ResolveNode (node);
     std::lock_guard<std::mutex> lock (mutex_);
     ++tasks_remaining_;
-    if (!free_workers_.empty ()) {
-        free_workers_.front ()->SetTask (std::move (task));
-        free_workers_.pop_front ();
+    Dispatch (std::move (task), index);
+}
+
+// public
+bool ThreadPool::RunPendingTask ()
+{
+    Task task;
+    {
+        int count = GetNodeCount ();
+        int index = GetCurrentNode ();
+        std::lock_guard<std::mutex> lock (mutex_);
+        for (int i = 0; i < count && nullptr == task; ++i) {
+            Node& node = nodes_[(index + i) % count];
+            if (!node.tasks.empty ()) {
+                task = std::move (node.tasks.front ());
+                node.tasks.pop_front ();
+            }
+        }
+    }
+
+    if (nullptr == task) {
+        return false;
+    }
+
+    detail::RunTask (task);
+
+    std::lock_guard<std::mutex> lock (mutex_);
+    if (0 == --tasks_remaining_) {
+        condition_.notify_all ();
+    }
+
+    return true;
+}
+
+// public
+int ThreadPool::GetCurrentNode () const
+{
+    if (1 == nodes_.size ()) {
+        return 0;
+    }
+
+    int cpu = sched_getcpu ();
+    if (cpu < 0 || cpu >= static_cast<int>(cpu_to_node_.size ())) {
+        return 0;
+    }
+
+    return cpu_to_node_[cpu];
+}
+
+// private
+void ThreadPool::InitializeNodes ()
+{
+    ProcessInformation info;
+    if (AFFINITY_NUMA_NODE == mode_) {
+        nodes_.resize (info.GetNumberOfNumaNodes ());
+        for (unsigned int i = 0; i < info.GetNumberOfNumaNodes (); ++i) {
+            nodes_[i].cpus = info.GetNumaNodeCpus (i);
+        }
     }
     else {
-        tasks_.push_back (std::move (task));
+        // a single node holding every cpu in NUMA order
+        nodes_.resize (1);
+        for (unsigned int i = 0; i < info.GetNumberOfNumaNodes (); ++i) {
+            const std::vector<int>& cpus = info.GetNumaNodeCpus (i);
+            nodes_[0].cpus.insert (nodes_[0].cpus.end (), cpus.begin (), cpus.end ());
+        }
+    }
+
+    for (size_t i = 0; i < nodes_.size (); ++i) {
+        nodes_[i].workers_number = 0;
+        for (auto cpu : nodes_[i].cpus) {
+            if (cpu >= static_cast<int>(cpu_to_node_.size ())) {
+                cpu_to_node_.resize (cpu + 1, 0);
+            }
+            cpu_to_node_[cpu] = static_cast<int>(i);
+        }
+    }
+}
+
+// private
+int ThreadPool::ResolveNode (int node) const
+{
+    if (node < 0) {
+        return GetCurrentNode ();
     }
+
+    return node % GetNodeCount ();
+}
+
+// private
+template <typename T>
+void ThreadPool::Dispatch (T&& task, int node)
+{
+    // local idle worker first, then an idle worker of the next nodes in
+    // index order, not by NUMA distance; only queue the task if every
+    // worker is busy
+    int count = GetNodeCount ();
+    for (int i = 0; i < count; ++i) {
+        Node& target = nodes_[(node + i) % count];
+        if (!target.free_workers.empty ()) {
+            target.free_workers.front ()->SetTask (std::forward<T> (task));
+            target.free_workers.pop_front ();
+            return;
+        }
+    }
+
+    nodes_[node].tasks.push_back (std::forward<T> (task));
 }
 
 // private
 void ThreadPool::TaskDone (Worker* worker)
 {
     std::lock_guard<std::mutex> lock (mutex_);
-    if (!tasks_.empty ()) {
-        worker->SetTask (tasks_.front ());
-        tasks_.pop_front ();
+    int count = GetNodeCount ();
+    int index = worker->GetNode ();
+    bool assigned = false;
+    for (int i = 0; i < count && !assigned; ++i) {
+        Node& node = nodes_[(index + i) % count];
+        if (!node.tasks.empty ()) {
+            worker->SetTask (std::move (node.tasks.front ()));
+            node.tasks.pop_front ();
+            assigned = true;
+        }
     }
-    else {
-        free_workers_.push_front (worker);
+
+    if (!assigned) {
+        nodes_[index].free_workers.push_front (worker);
     }
 
     if (0 == --tasks_remaining_) {
@@ -17,6 +17,7 @@
 
 #include <mutex>
 #include <list>
+#include <vector>
 #include <atomic>
 #include <functional>
 #include <condition_variable>
@@ -31,9 +32,24 @@ class ThreadPool : swift::noncopyable
 public:
     typedef std::function<void (void)> Task;
 
+    // How the workers are bound to the cpus
+    enum AffinityMode
+    {
+        AFFINITY_NONE = 0,  // workers float freely, one shared queue
+        AFFINITY_CORE,      // worker i is pinned to the i-th cpu (round robin)
+        AFFINITY_NUMA_NODE, // one sub-pool per NUMA node, workers pinned to the node's cpus
+    };
+
+    // schedule on the NUMA node of the calling thread
+    static const int kAnyNode = -1;
+
 public:
     explicit ThreadPool (int threads_number = 4);
 
+    // workers are spread round robin over the sub-pools, so with
+    // AFFINITY_NUMA_NODE use a multiple of GetNodeCount () threads
+    ThreadPool (int threads_number, AffinityMode mode);
+
     // blocks until all tasks are complete (TasksRemaining () == 0)
     // You should not call schedule while in the destructor
     ~ThreadPool ();
@@ -51,6 +67,13 @@ public:
 
     void Schedule (Task&& task);
 
+    // The task is queued on the sub-pool of node (taken modulo GetNodeCount ()).
+    // Workers run their own node's tasks first and only steal from the
+    // other nodes when they would otherwise sit idle.
+    void ScheduleOnNode (const Task& task, int node);
+
+    void ScheduleOnNode (Task&& task, int node);
+
     // Helpers that wrap schedule and std::bind.
     // Functor and args will be copied a few times so make sure it's relatively cheap
     template<typename F, typename A>
@@ -88,14 +111,53 @@ public:
         return tasks_remaining_; 
     }
 
+    int GetThreadsNumber () const
+    {
+        return threads_number_;
+    }
+
+    // Pops one queued task, preferring the calling thread's node, and runs it
+    // on the calling thread. Returns false if nothing was queued.
+    // Lets a thread that waits on other tasks of this pool help instead of
+    // blocking, which keeps nested fork/join from dead locking the workers.
+    bool RunPendingTask ();
+
+    // the number of sub-pools, 1 unless AFFINITY_NUMA_NODE is used
+    int GetNodeCount () const
+    {
+        return static_cast<int>(nodes_.size ());
+    }
+
+    // the sub-pool the calling thread is running on, used for kAnyNode
+    int GetCurrentNode () const;
+
 private:
+    // a sub-pool, all of them are guarded by mutex_
+    struct Node
+    {
+        std::vector<int> cpus;              // cpus the workers are allowed to run on
+        std::list<Worker*> free_workers;    // used as LIFO stack (always front)
+        std::list<Task> tasks;              // used as FIFO queue (push_back, pop_front)
+        int workers_number;
+    };
+
     std::mutex mutex_;
     std::condition_variable condition_;
 
-    std::list<Worker*> free_workers_;   //used as LIFO stack (always front)
-    std::list<Task> tasks_;             //used as FIFO queue (push_back, pop_front)
+    std::vector<Node> nodes_;
+    std::vector<int> cpu_to_node_;      // cpu id -> index of nodes_
     std::atomic<int> tasks_remaining_;  // in queue + currently processing
     int threads_number_;                // only used for sanity checking. could be removed in the future.
+    AffinityMode mode_;
+
+    void InitializeNodes ();
+
+    int ResolveNode (int node) const;
+
+    // hands the task to an idle worker, the local node first, or queues it on node.
+    // must hold mutex_
+    template <typename T>
+    void Dispatch (T&& task, int node);
 
     // should only be called by a worker from the worker's thread
     void TaskDone (Worker* worker);
@@ -0,0 +1,278 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SWIFT_BASE_TINYLFU_CACHE_HPP__
+#define __SWIFT_BASE_TINYLFU_CACHE_HPP__
+
+#include <list>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "swift/base/cache_metrics.hpp"
+#include "swift/base/murmurhash3.h"
+
+namespace swift {
+
+// Count-min sketch of 4 rows of counters saturating at 15. Every
+// 10 * width increments all counters are halved, so old popularity fades.
+class FrequencySketch {
+ public:
+  explicit FrequencySketch(size_t capacity)
+    : mask_(RoundUp(capacity) - 1)
+    , table_(kRows * (mask_ + 1), 0)
+    , additions_(0)
+    , sample_size_(10 * (mask_ + 1)) {
+  }
+
+  void Increment(uint64_t h1, uint64_t h2) {
+    bool added = false;
+    for (size_t i = 0; i < kRows; ++i) {
+      uint8_t& counter = table_[Index(i, h1, h2)];
+      if (counter < kMaxCount) {
+        ++counter;
+        added = true;
+      }
+    }
+
+    if (added && ++additions_ >= sample_size_) {
+      Age();
+    }
+  }
+
+  uint8_t Frequency(uint64_t h1, uint64_t h2) const {
+    uint8_t frequency = kMaxCount;
+    for (size_t i = 0; i < kRows; ++i) {
+      uint8_t counter = table_[Index(i, h1, h2)];
+      if (counter < frequency) {
+        frequency = counter;
+      }
+    }
+    return frequency;
+  }
+
+ private:
+  static const size_t kRows = 4;
+  static const uint8_t kMaxCount = 15;
+
+  static size_t RoundUp(size_t capacity) {
+    size_t size = 16;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  size_t Index(size_t row, uint64_t h1, uint64_t h2) const {
+    // double hashing, each row gets an independent looking hash
+    return row * (mask_ + 1) + ((h1 + row * h2) & mask_);
+  }
+
+  void Age() {
+    for (auto& counter : table_) {
+      counter >>= 1;
+    }
+    additions_ /= 2;
+  }
+
+  const size_t mask_;
+  std::vector<uint8_t> table_;
+  size_t additions_;
+  const size_t sample_size_;
+};
+
+// Scan resistant replacement for LruCache (W-TinyLFU). New entries land in a
+// small LRU window (1% of the capacity). An entry falling out of the window
+// only enters the main region if the sketch says it is used more often than
+// the entry it would evict there, so a scan of one-hit-wonders churns the
+// window and leaves the hot set alone. The main region is a segmented LRU:
+// entries hit again in probation move to the protected segment (80%).
+//
+// Every Get and Set counts as an access of the key.
+template<typename KeyType, typename ValueType, typename Hash = std::hash<KeyType> >
+class TinyLfuCache {
+ private:
+  enum Region { WINDOW, PROBATION, PROTECTED };
+
+  struct Entry {
+    Entry(const KeyType& k, const ValueType& v) : key(k), value(v), region(WINDOW) {}
+    KeyType key;
+    ValueType value;
+    Region region;
+  };
+
+  typedef typename std::list<Entry>::iterator ListIteratorType;
+
+ public:
+  TinyLfuCache(size_t capacity);
+  void Set(const KeyType& key, const ValueType& value);
+  bool Get(const KeyType& key, ValueType& value);
+  size_t Size();
+
+  // hit, miss and eviction counts, and the optional miss ratio curve, which
+  // takes a ThreadLocalPtr id once enabled; the counts take none
+  CacheMetrics<KeyType, Hash>& Metrics() { return metrics_; }
+
+ private:
+  void Hash128(const KeyType& key, uint64_t* h1, uint64_t* h2) const;
+  uint8_t Frequency(const KeyType& key) const;
+  void OnHit(ListIteratorType it);
+  void Evict();
+
+  std::mutex mutex_;
+  size_t window_capacity_;
+  size_t protected_capacity_;
+  size_t main_capacity_;
+  FrequencySketch sketch_;
+  std::list<Entry> lists_[3];
+  size_t sizes_[3];
+  std::unordered_map<KeyType, ListIteratorType, Hash> cache_items_map_;
+  CacheMetrics<KeyType, Hash> metrics_;
+};
+
+template<typename KeyType, typename ValueType, typename Hash>
+swift::TinyLfuCache<KeyType, ValueType, Hash>::TinyLfuCache(size_t capacity)
+  : window_capacity_(capacity / 100 > 0 ? capacity / 100 : 1)
+  , protected_capacity_(0)
+  , main_capacity_(capacity > window_capacity_ ? capacity - window_capacity_ : 0)
+  , sketch_(capacity) {
+  protected_capacity_ = main_capacity_ * 8 / 10;
+  sizes_[WINDOW] = sizes_[PROBATION] = sizes_[PROTECTED] = 0;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+void swift::TinyLfuCache<KeyType, ValueType, Hash>::Set(const KeyType& key, const ValueType& value) {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  uint64_t h1, h2;
+  Hash128(key, &h1, &h2);
+  sketch_.Increment(h1, h2);
+
+  auto it = cache_items_map_.find(key);
+  if (it != cache_items_map_.end()) {
+    it->second->value = value;
+    OnHit(it->second);
+    return;
+  }
+
+  lists_[WINDOW].push_front(Entry(key, value));
+  ++sizes_[WINDOW];
+  cache_items_map_[key] = lists_[WINDOW].begin();
+  if (sizes_[WINDOW] > window_capacity_) {
+    Evict();
+  }
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+bool swift::TinyLfuCache<KeyType, ValueType, Hash>::Get(const KeyType& key, ValueType& value) {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  uint64_t h1, h2;
+  Hash128(key, &h1, &h2);
+  sketch_.Increment(h1, h2);
+
+  auto it = cache_items_map_.find(key);
+  if (it == cache_items_map_.end()) {
+    metrics_.Miss(key);
+    return false;
+  }
+
+  metrics_.Hit(key);
+  OnHit(it->second);
+  value = it->second->value;
+  return true;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+size_t swift::TinyLfuCache<KeyType, ValueType, Hash>::Size() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return cache_items_map_.size();
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+void swift::TinyLfuCache<KeyType, ValueType, Hash>::Hash128(const KeyType& key, uint64_t* h1, uint64_t* h2) const {
+  size_t h = Hash()(key);
+  uint64_t out[2];
+  MurmurHash3_x64_128(&h, sizeof(h), 0, out);
+  *h1 = out[0];
+  *h2 = out[1] | 1;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+uint8_t swift::TinyLfuCache<KeyType, ValueType, Hash>::Frequency(const KeyType& key) const {
+  uint64_t h1, h2;
+  Hash128(key, &h1, &h2);
+  return sketch_.Frequency(h1, h2);
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+void swift::TinyLfuCache<KeyType, ValueType, Hash>::OnHit(ListIteratorType it) {
+  switch (it->region) {
+  case WINDOW:
+  case PROTECTED:
+    lists_[it->region].splice(lists_[it->region].begin(), lists_[it->region], it);
+    break;
+  case PROBATION:
+    // promote, the protected segment overflows into probation
+    it->region = PROTECTED;
+    lists_[PROTECTED].splice(lists_[PROTECTED].begin(), lists_[PROBATION], it);
+    --sizes_[PROBATION];
+    ++sizes_[PROTECTED];
+    if (sizes_[PROTECTED] > protected_capacity_) {
+      ListIteratorType demoted = --lists_[PROTECTED].end();
+      demoted->region = PROBATION;
+      lists_[PROBATION].splice(lists_[PROBATION].begin(), lists_[PROTECTED], demoted);
+      --sizes_[PROTECTED];
+      ++sizes_[PROBATION];
+    }
+    break;
+  }
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+void swift::TinyLfuCache<KeyType, ValueType, Hash>::Evict() {
+  // the window's LRU entry is the candidate for the main region
+  ListIteratorType candidate = --lists_[WINDOW].end();
+  candidate->region = PROBATION;
+  lists_[PROBATION].splice(lists_[PROBATION].begin(), lists_[WINDOW], candidate);
+  --sizes_[WINDOW];
+  ++sizes_[PROBATION];
+  if (sizes_[PROBATION] + sizes_[PROTECTED] <= main_capacity_) {
+    return;
+  }
+
+  // main is full: the candidate fights the probation victim (or the
+  // protected one, when everything in main got promoted)
+  ListIteratorType victim = candidate;
+  if (sizes_[PROBATION] > 1) {
+    victim = --lists_[PROBATION].end();
+  } else if (sizes_[PROTECTED] > 0) {
+    victim = --lists_[PROTECTED].end();
+  }
+  ListIteratorType loser = candidate;
+  if (victim != candidate && Frequency(candidate->key) > Frequency(victim->key)) {
+    loser = victim;
+  }
+
+  cache_items_map_.erase(loser->key);
+  metrics_.Evict();
+  --sizes_[loser->region];
+  lists_[loser->region].erase(loser);
+}
+
+} // namespace swift
+
+#endif // __SWIFT_BASE_TINYLFU_CACHE_HPP__
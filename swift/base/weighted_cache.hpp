@@ -0,0 +1,341 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SWIFT_BASE_WEIGHTED_CACHE_HPP__
+#define __SWIFT_BASE_WEIGHTED_CACHE_HPP__
+
+#include <map>
+#include <list>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+#include <stdint.h>
+
+#include "swift/base/cache_metrics.hpp"
+
+namespace swift {
+
+enum EvictionReason {
+  EVICTION_CAPACITY,   // made room for a new entry
+  EVICTION_EXPIRED,    // its TTL passed
+  EVICTION_REPLACED,   // Set with the same key
+  EVICTION_ERASED,     // Erase or Clear
+};
+
+// LRU cache whose capacity is in bytes. Every Set passes the charge of the
+// entry, e.g. the size of an object body, and least recently used entries
+// are evicted until the new one fits. Entries may have a TTL: an expired
+// entry is dropped by the Get that finds it, by Expire () or by the sweeper
+// thread started with StartSweeper ().
+//
+// The eviction callback runs outside the lock, after the entry left the
+// cache, so it may call back into the cache.
+template<typename KeyType, typename ValueType, typename Hash = std::hash<KeyType> >
+class WeightedCache {
+ public:
+  typedef std::chrono::steady_clock Clock;
+  typedef std::function<void (const KeyType& key, const ValueType& value, EvictionReason reason)> EvictionCallback;
+
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;     // EVICTION_CAPACITY
+    uint64_t expirations;   // EVICTION_EXPIRED
+    size_t   bytes;         // sum of the charges
+    size_t   entries;
+    size_t   capacity;
+  };
+
+ private:
+  typedef typename std::multimap<Clock::time_point, KeyType>::iterator ExpiryIteratorType;
+
+  struct Entry {
+    KeyType key;
+    ValueType value;
+    size_t charge;
+    bool expires;
+    ExpiryIteratorType expiry;
+  };
+
+  typedef typename std::list<Entry>::iterator ListIteratorType;
+
+  struct Evicted {
+    Evicted(const Entry& e, EvictionReason r) : key(e.key), value(e.value), reason(r) {}
+    KeyType key;
+    ValueType value;
+    EvictionReason reason;
+  };
+
+ public:
+  explicit WeightedCache(size_t capacity_bytes, const EvictionCallback& callback = EvictionCallback());
+  ~WeightedCache();
+
+  // ttl 0 never expires. Returns false and caches nothing if the charge
+  // alone is above the capacity; an entry already cached under key is
+  // removed then as EVICTION_REPLACED.
+  bool Set(const KeyType& key, const ValueType& value, size_t charge,
+           std::chrono::milliseconds ttl = std::chrono::milliseconds(0));
+  bool Get(const KeyType& key, ValueType& value);
+  bool Erase(const KeyType& key);
+  void Clear();
+
+  // drops every expired entry now, returns how many
+  size_t Expire();
+
+  // runs Expire () every interval on a background thread
+  void StartSweeper(std::chrono::milliseconds interval);
+  void StopSweeper();
+
+  Stats GetStats();
+
+  // the counters of GetStats (), and the optional miss ratio curve; only an
+  // enabled curve takes a ThreadLocalPtr id
+  CacheMetrics<KeyType, Hash>& Metrics() { return metrics_; }
+
+ private:
+  WeightedCache(const WeightedCache&);
+  WeightedCache& operator=(const WeightedCache&);
+
+  void Remove(ListIteratorType it, EvictionReason reason, std::vector<Evicted>* evicted);
+  size_t ExpireLocked(Clock::time_point now, std::vector<Evicted>* evicted);
+  void Notify(const std::vector<Evicted>& evicted);
+
+  std::mutex mutex_;
+  const size_t capacity_;
+  size_t bytes_;
+  uint64_t expirations_;
+  EvictionCallback callback_;
+  std::list<Entry> cache_items_list_;
+  std::unordered_map<KeyType, ListIteratorType, Hash> cache_items_map_;
+  std::multimap<Clock::time_point, KeyType> expiries_;
+  CacheMetrics<KeyType, Hash> metrics_;
+
+  std::mutex sweeper_mutex_;
+  std::condition_variable sweeper_cond_;
+  bool sweeper_stop_;
+  std::thread sweeper_;
+};
+
+template<typename KeyType, typename ValueType, typename Hash>
+swift::WeightedCache<KeyType, ValueType, Hash>::WeightedCache(size_t capacity_bytes, const EvictionCallback& callback)
+  : capacity_(capacity_bytes)
+  , bytes_(0)
+  , expirations_(0)
+  , callback_(callback)
+  , sweeper_stop_(false) {
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+swift::WeightedCache<KeyType, ValueType, Hash>::~WeightedCache() {
+  StopSweeper();
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+bool swift::WeightedCache<KeyType, ValueType, Hash>::Set(const KeyType& key, const ValueType& value, size_t charge,
+                                                         std::chrono::milliseconds ttl) {
+  std::vector<Evicted> evicted;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    // an oversized value still replaces the old one, which would be stale
+    auto it = cache_items_map_.find(key);
+    if (it != cache_items_map_.end()) {
+      Remove(it->second, EVICTION_REPLACED, &evicted);
+    }
+    if (charge > capacity_) {
+      lock.unlock();
+      Notify(evicted);
+      return false;
+    }
+
+    // expired entries go first, then the least recently used
+    Clock::time_point now = Clock::now();
+    if (bytes_ + charge > capacity_) {
+      ExpireLocked(now, &evicted);
+    }
+    while (bytes_ + charge > capacity_) {
+      Remove(--cache_items_list_.end(), EVICTION_CAPACITY, &evicted);
+    }
+
+    Entry entry = { key, value, charge, ttl.count() > 0, expiries_.end() };
+    if (entry.expires) {
+      entry.expiry = expiries_.insert(std::make_pair(now + ttl, key));
+    }
+    cache_items_list_.push_front(entry);
+    cache_items_map_[key] = cache_items_list_.begin();
+    bytes_ += charge;
+  }
+
+  Notify(evicted);
+  return true;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+bool swift::WeightedCache<KeyType, ValueType, Hash>::Get(const KeyType& key, ValueType& value) {
+  std::vector<Evicted> evicted;
+  bool found = false;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto it = cache_items_map_.find(key);
+    if (it != cache_items_map_.end()) {
+      ListIteratorType entry = it->second;
+      if (entry->expires && entry->expiry->first <= Clock::now()) {
+        Remove(entry, EVICTION_EXPIRED, &evicted);
+      } else {
+        cache_items_list_.splice(cache_items_list_.begin(), cache_items_list_, entry);
+        value = entry->value;
+        found = true;
+      }
+    }
+
+    if (found) {
+      metrics_.Hit(key);
+    } else {
+      metrics_.Miss(key);
+    }
+  }
+
+  Notify(evicted);
+  return found;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+bool swift::WeightedCache<KeyType, ValueType, Hash>::Erase(const KeyType& key) {
+  std::vector<Evicted> evicted;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = cache_items_map_.find(key);
+    if (it == cache_items_map_.end()) {
+      return false;
+    }
+    Remove(it->second, EVICTION_ERASED, &evicted);
+  }
+
+  Notify(evicted);
+  return true;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+void swift::WeightedCache<KeyType, ValueType, Hash>::Clear() {
+  std::vector<Evicted> evicted;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!cache_items_list_.empty()) {
+      Remove(cache_items_list_.begin(), EVICTION_ERASED, &evicted);
+    }
+  }
+
+  Notify(evicted);
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+size_t swift::WeightedCache<KeyType, ValueType, Hash>::Expire() {
+  std::vector<Evicted> evicted;
+  size_t count = 0;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    count = ExpireLocked(Clock::now(), &evicted);
+  }
+
+  Notify(evicted);
+  return count;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+void swift::WeightedCache<KeyType, ValueType, Hash>::StartSweeper(std::chrono::milliseconds interval) {
+  StopSweeper();
+
+  sweeper_stop_ = false;
+  sweeper_ = std::thread([this, interval] () {
+    std::unique_lock<std::mutex> lock(sweeper_mutex_);
+    while (!sweeper_stop_) {
+      sweeper_cond_.wait_for(lock, interval);
+      if (!sweeper_stop_) {
+        lock.unlock();
+        Expire();
+        lock.lock();
+      }
+    }
+  });
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+void swift::WeightedCache<KeyType, ValueType, Hash>::StopSweeper() {
+  if (!sweeper_.joinable()) {
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(sweeper_mutex_);
+    sweeper_stop_ = true;
+  }
+  sweeper_cond_.notify_all();
+  sweeper_.join();
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+typename swift::WeightedCache<KeyType, ValueType, Hash>::Stats
+swift::WeightedCache<KeyType, ValueType, Hash>::GetStats() {
+  typename CacheMetrics<KeyType, Hash>::Stats counts = metrics_.GetStats();
+  std::unique_lock<std::mutex> lock(mutex_);
+  Stats stats = { counts.hits, counts.misses, counts.evictions, expirations_, bytes_, cache_items_map_.size(), capacity_ };
+  return stats;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+void swift::WeightedCache<KeyType, ValueType, Hash>::Remove(ListIteratorType it, EvictionReason reason,
+                                                            std::vector<Evicted>* evicted) {
+  if (EVICTION_CAPACITY == reason) {
+    metrics_.Evict();
+  } else if (EVICTION_EXPIRED == reason) {
+    ++expirations_;
+  }
+
+  if (callback_) {
+    evicted->push_back(Evicted(*it, reason));
+  }
+  if (it->expires) {
+    expiries_.erase(it->expiry);
+  }
+  bytes_ -= it->charge;
+  cache_items_map_.erase(it->key);
+  cache_items_list_.erase(it);
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+size_t swift::WeightedCache<KeyType, ValueType, Hash>::ExpireLocked(Clock::time_point now,
+                                                                    std::vector<Evicted>* evicted) {
+  size_t count = 0;
+  while (!expiries_.empty() && expiries_.begin()->first <= now) {
+    Remove(cache_items_map_[expiries_.begin()->second], EVICTION_EXPIRED, evicted);
+    ++count;
+  }
+  return count;
+}
+
+template<typename KeyType, typename ValueType, typename Hash>
+void swift::WeightedCache<KeyType, ValueType, Hash>::Notify(const std::vector<Evicted>& evicted) {
+  for (auto& e : evicted) {
+    callback_(e.key, e.value, e.reason);
+  }
+}
+
+} // namespace swift
+
+#endif // __SWIFT_BASE_WEIGHTED_CACHE_HPP__
@@ -0,0 +1,319 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SWIFT_DISRUPTOR_BYTE_RING_HPP__
+#define __SWIFT_DISRUPTOR_BYTE_RING_HPP__
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "swift/disruptor/disruptor.hpp"
+
+namespace swift {
+namespace disruptor {
+
+/**
+ *  Ring of variable length byte records for log and network buffers.
+ *
+ *  The memory is mapped twice back to back, so a record that wraps around
+ *  the end of the ring is still contiguous in the address space and can be
+ *  written in place by the producer and handed to write(2) / writev(2) by
+ *  the consumer without copying.
+ *
+ *  Every record starts with an 8 byte header, records are 8 byte aligned.
+ *  There is one consumer and either one (kSingleProducer) or many
+ *  (kMultiProducer) producers, which claim their space with a CAS and may
+ *  commit out of order, the consumer stops at the first record that is
+ *  not committed yet.
+ *
+ *  @code
+ *  // producer
+ *  char* buf = ring.reserve(4096);
+ *  ssize_t n = read(fd, buf, 4096);
+ *  ring.commit(buf, n);
+ *
+ *  // consumer
+ *  struct iovec iov[64];
+ *  size_t count = ring.peek(iov, 64);
+ *  writev(out, iov, count);
+ *  ring.release();
+ *  @endcode
+ */
+class ByteRing
+{
+ public:
+  enum ProducerType {
+    kSingleProducer,
+    kMultiProducer,
+  };
+
+  /**
+   * @param capacity - rounded up to a power of 2 multiple of the page size
+   */
+  explicit ByteRing(size_t capacity, ProducerType type = kSingleProducer)
+    : type_(type)
+    , size_(round_up(capacity))
+    , base_(map_mirror(size_))
+    , head_(0)
+    , read_(0)
+    , tail_(0) {
+    assert(size_ <= kCommitted);
+  }
+
+  ~ByteRing() {
+    munmap(base_, size_ * 2);
+  }
+
+  /**
+   * the largest record length that fits the ring
+   */
+  size_t max_record() const {
+    return size_ - sizeof(Header);
+  }
+
+  size_t capacity() const {
+    return size_;
+  }
+
+  /**
+   * Reserves length contiguous bytes for a record without waiting.
+   * @return where to write the record, nullptr if the ring is full
+   */
+  char* try_reserve(size_t length) {
+    assert(length <= max_record());
+    uint64_t total = align(sizeof(Header) + length);
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    if (kSingleProducer == type_) {
+      if (head + total - tail_.load(std::memory_order_acquire) > size_) {
+        return nullptr;
+      }
+    } else {
+      for (;;) {
+        uint64_t tail = tail_.load(std::memory_order_acquire);
+        if (tail > head) {
+          // head was loaded before other producers and the consumer moved
+          // past it, the ring is not full
+          head = head_.load(std::memory_order_relaxed);
+          continue;
+        }
+        if (head + total - tail > size_) {
+          return nullptr;
+        }
+        if (head_.compare_exchange_weak(head, head + total, std::memory_order_relaxed)) {
+          break;
+        }
+      }
+    }
+
+    Header* header = header_at(head);
+    header->total = static_cast<uint32_t>(total);
+    return reinterpret_cast<char*>(header + 1);
+  }
+
+  /**
+   * Same as try_reserve but waits for the consumer to free enough space
+   */
+  char* reserve(size_t length) {
+    char* data = nullptr;
+    for (int64_t tries = 0; nullptr == (data = try_reserve(length)); ++tries) {
+      backoff(tries);
+    }
+    return data;
+  }
+
+  /**
+   * Publishes a reserved record, its length may be smaller than reserved
+   */
+  void commit(char* data, size_t length) {
+    Header* header = reinterpret_cast<Header*>(data) - 1;
+    assert(align(sizeof(Header) + length) <= header->total);
+    header->length.store(static_cast<uint32_t>(length) | kCommitted, std::memory_order_release);
+    if (kSingleProducer == type_) {
+      head_.store(head_.load(std::memory_order_relaxed) + header->total, std::memory_order_release);
+    }
+  }
+
+  /**
+   * Returns the next committed record after the ones already peeked.
+   * @return the record, nullptr if there is none
+   */
+  const char* peek(size_t* length) {
+    Header* header = next();
+    if (nullptr == header) {
+      return nullptr;
+    }
+
+    *length = header->length.load(std::memory_order_relaxed) & ~kCommitted;
+    read_ += header->total;
+    return reinterpret_cast<const char*>(header + 1);
+  }
+
+  /**
+   * Peeks up to max records, ready for writev(2)
+   * @return the number of records
+   */
+  size_t peek(struct iovec* iov, size_t max) {
+    size_t count = 0;
+    size_t length = 0;
+    const char* data = nullptr;
+    while (count < max && nullptr != (data = peek(&length))) {
+      iov[count].iov_base = const_cast<char*>(data);
+      iov[count].iov_len = length;
+      ++count;
+    }
+    return count;
+  }
+
+  /**
+   * Gives the space of every peeked record back to the producers
+   */
+  void release() {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == read_) {
+      return;
+    }
+
+    if (kMultiProducer == type_) {
+      // stale bytes must not look like a committed header next lap
+      memset(base_ + (tail & (size_ - 1)), 0, read_ - tail);
+    }
+    tail_.store(read_, std::memory_order_release);
+  }
+
+  /**
+   * bytes reserved and not released, including headers
+   */
+  size_t size() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+  }
+
+ private:
+  ByteRing(const ByteRing&);
+  ByteRing& operator=(const ByteRing&);
+
+  struct Header {
+    std::atomic<uint32_t> length;   // kCommitted | length of the record
+    uint32_t              total;    // bytes up to the next header
+  };
+
+  static const uint32_t kCommitted = 0x80000000u;
+
+  static uint64_t align(uint64_t length) {
+    return (length + 7) & ~static_cast<uint64_t>(7);
+  }
+
+  static size_t round_up(size_t capacity) {
+    size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    while (size < capacity) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  static char* map_mirror(size_t size) {
+    int fd = -1;
+#ifdef SYS_memfd_create
+    fd = static_cast<int>(syscall(SYS_memfd_create, "swift_byte_ring", 0));
+#endif
+    if (fd < 0) {
+      char path[] = "/dev/shm/swift_byte_ring_XXXXXX";
+      fd = mkstemp(path);
+      if (fd >= 0) {
+        unlink(path);
+      }
+    }
+    if (fd < 0 || 0 != ftruncate(fd, size)) {
+      int err = errno;
+      if (fd >= 0) {
+        close(fd);
+      }
+      throw std::system_error(err, std::system_category(), "ByteRing create");
+    }
+
+    // reserve both halves, then map the file over each of them
+    char* base = static_cast<char*>(mmap(nullptr, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (MAP_FAILED != base &&
+        (MAP_FAILED == mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) ||
+         MAP_FAILED == mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0))) {
+      munmap(base, size * 2);
+      base = static_cast<char*>(MAP_FAILED);
+    }
+
+    int err = errno;
+    close(fd);
+    if (MAP_FAILED == base) {
+      throw std::system_error(err, std::system_category(), "ByteRing mmap");
+    }
+    return base;
+  }
+
+  static void backoff(int64_t tries) {
+    if (tries < 100) {
+      cpu_relax();
+    } else if (tries < 200) {
+      sched_yield();
+    } else {
+      struct timespec ts = { 0, 50 * 1000 };
+      nanosleep(&ts, nullptr);
+    }
+  }
+
+  Header* header_at(uint64_t pos) const {
+    return reinterpret_cast<Header*>(base_ + (pos & (size_ - 1)));
+  }
+
+  Header* next() const {
+    if (kSingleProducer == type_) {
+      if (read_ == head_.load(std::memory_order_acquire)) {
+        return nullptr;
+      }
+      return header_at(read_);
+    }
+
+    // multi producer: claimed space is zero until its record is committed
+    if (read_ - tail_.load(std::memory_order_relaxed) >= size_) {
+      return nullptr;
+    }
+    Header* header = header_at(read_);
+    if (0 == (header->length.load(std::memory_order_acquire) & kCommitted)) {
+      return nullptr;
+    }
+    return header;
+  }
+
+ private:
+  const ProducerType    type_;
+  const size_t          size_;
+  char* const           base_;
+  char                  padding0_[64];
+  std::atomic<uint64_t> head_;    // next byte to reserve
+  char                  padding1_[64 - sizeof(std::atomic<uint64_t>)];
+  uint64_t              read_;    // consumer only, end of the peeked records
+  std::atomic<uint64_t> tail_;    // first byte not released
+  char                  padding2_[64 - sizeof(uint64_t) - sizeof(std::atomic<uint64_t>)];
+};
+
+} // namespace disruptor
+} // namespace swift
+
+#endif // __SWIFT_DISRUPTOR_BYTE_RING_HPP__
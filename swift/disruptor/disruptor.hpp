@@ -19,13 +19,19 @@
 #include <vector>
 #include <atomic>
 #include <limits>
+#include <time.h>
+#include <sched.h>
+#include <climits>
 #include <unistd.h>
 #include <assert.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 namespace swift {
 namespace disruptor {
 
 const int64_t kMaxInt64Value = std::numeric_limits<int64_t>::max();
+const int64_t kMinInt64Value = std::numeric_limits<int64_t>::min();
 
 class Eof : public std::exception {
  public:
@@ -57,20 +63,22 @@ class Sequence {
     sequence_.store (value, std::memory_order_release); 
   }
 
+  // release, whatever was written before (the alert exception) is
+  // visible to whoever sees the flag
   void set_eof() {
-    alert_ = 1;
+    alert_.store(1, std::memory_order_release);
   }
 
   void set_alert() {
-    alert_ = -1;
+    alert_.store(-1, std::memory_order_release);
   }
 
   bool eof() const {
-    return alert_ == 1;
+    return alert_.load(std::memory_order_acquire) == 1;
   }
 
   bool alert() const {
-    return alert_ != 0;
+    return alert_.load(std::memory_order_acquire) != 0;
   }
 
   int64_t atomic_increment_and_get(uint64_t increment) {
@@ -80,29 +88,210 @@ class Sequence {
  private:
   // x86 machine cpu cacheline is 64 byte
   std::atomic<int64_t> sequence_;
-  volatile int64_t     alert_;
+  std::atomic<int64_t> alert_;
   int64_t              padding_[6];
 };
 
 class EventCursor;
 
+inline void cpu_relax() {
+#if defined(__GNUC__) && (defined(__i386) || defined(__x86_64__))
+  __builtin_ia32_pause();
+#endif
+}
+
+/**
+ *  Lets the followers of a cursor sleep in the kernel (futex) until the
+ *  cursor publishes. Publishers only pay for it once a blocking follower
+ *  registered, a fence and a load per publish, plus a wake up syscall
+ *  while somebody actually sleeps.
+ */
+class PublishSignal {
+ public:
+  PublishSignal()
+    : blocking_followers_(0)
+    , waiters_(0)
+    , futex_(0) {
+  }
+
+  void add_blocking_follower() {
+    blocking_followers_.fetch_add(1, std::memory_order_release);
+  }
+
+  /** called by the publisher after the sequence was stored */
+  void notify() {
+    if (blocking_followers_.load(std::memory_order_relaxed) == 0) {
+      return;
+    }
+
+    // pairs with the fence in wait(), either the waiter sees the new
+    // sequence or we see the waiter
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_relaxed) > 0) {
+      futex_.fetch_add(1, std::memory_order_release);
+      syscall(SYS_futex, reinterpret_cast<int*>(&futex_), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    }
+  }
+
+  /** sleeps until notify() or the timeout unless ready() already holds */
+  template<typename Ready>
+  void wait(Ready ready, int64_t timeout_ns) {
+    waiters_.fetch_add(1, std::memory_order_relaxed);
+    int32_t seen = futex_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!ready()) {
+      struct timespec ts = { static_cast<time_t>(timeout_ns / 1000000000),
+                             static_cast<long>(timeout_ns % 1000000000) };
+      syscall(SYS_futex, reinterpret_cast<int*>(&futex_), FUTEX_WAIT_PRIVATE, seen, &ts, nullptr, 0);
+    }
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<int32_t> blocking_followers_;
+  std::atomic<int32_t> waiters_;
+  std::atomic<int32_t> futex_;
+  int32_t              padding_[13];
+};
+
+/**
+ *  Decides what a barrier does while a cursor it follows is behind the
+ *  position it waits for. idle() is called repeatedly, tries counts the
+ *  calls made for the current wait.
+ */
+class WaitStrategy {
+ public:
+  virtual ~WaitStrategy() {}
+
+  virtual void idle(const EventCursor& cursor, int64_t pos, int64_t tries) const = 0;
+
+  /** true if the followed cursors must wake us up when they publish */
+  virtual bool blocking() const { return false; }
+};
+typedef std::shared_ptr<const WaitStrategy> WaitStrategySPtr;
+
+/**
+ *  Lowest latency, burns a whole cpu while waiting.
+ */
+class BusySpinWaitStrategy : public WaitStrategy {
+ public:
+  virtual void idle(const EventCursor&, int64_t, int64_t) const {
+    cpu_relax();
+  }
+};
+
+/**
+ *  Spins for a while, then gives the cpu to other threads, a good choice
+ *  when there are more cpus than busy threads.
+ */
+class YieldingWaitStrategy : public WaitStrategy {
+ public:
+  explicit YieldingWaitStrategy(int64_t spin_tries = 100)
+    : spin_tries_(spin_tries) {
+  }
+
+  virtual void idle(const EventCursor&, int64_t, int64_t tries) const {
+    if (tries < spin_tries_) {
+      cpu_relax();
+    } else {
+      sched_yield();
+    }
+  }
+
+ private:
+  const int64_t spin_tries_;
+};
+
+/**
+ *  Spins briefly and then sleeps on a futex until the followed cursor
+ *  publishes. Uses no cpu while idle and wakes up within a syscall of
+ *  the publish, at the price of a check on every publish.
+ */
+class BlockingWaitStrategy : public WaitStrategy {
+ public:
+  explicit BlockingWaitStrategy(int64_t spin_tries = 100)
+    : spin_tries_(spin_tries) {
+  }
+
+  virtual void idle(const EventCursor& cursor, int64_t pos, int64_t tries) const;
+
+  virtual bool blocking() const { return true; }
+
+ private:
+  const int64_t spin_tries_;
+};
+
+/**
+ *  Progressive backoff: busy wait for spin_tries, yield for yield_tries
+ *  and then sleep, starting at min_park_ns and doubling up to max_park_ns.
+ *  The defaults are the historical behaviour of the barrier, 1000 spins,
+ *  1000 yields and then 10ms naps.
+ */
+class TimedParkWaitStrategy : public WaitStrategy {
+ public:
+  explicit TimedParkWaitStrategy(int64_t spin_tries = 1000,
+                                 int64_t yield_tries = 1000,
+                                 int64_t min_park_ns = 10 * 1000 * 1000,
+                                 int64_t max_park_ns = 10 * 1000 * 1000)
+    : spin_tries_(spin_tries)
+    , yield_tries_(yield_tries)
+    , min_park_ns_(min_park_ns)
+    , max_park_ns_(max_park_ns < min_park_ns ? min_park_ns : max_park_ns) {
+  }
+
+  virtual void idle(const EventCursor&, int64_t, int64_t tries) const {
+    if (tries < spin_tries_) {
+      cpu_relax();
+    } else if (tries < spin_tries_ + yield_tries_) {
+      sched_yield();
+    } else {
+      int64_t park = min_park_ns_;
+      for (int64_t i = spin_tries_ + yield_tries_; i < tries && park < max_park_ns_; ++i) {
+        park *= 2;
+      }
+      if (park > max_park_ns_) {
+        park = max_park_ns_;
+      }
+
+      struct timespec ts = { static_cast<time_t>(park / 1000000000),
+                             static_cast<long>(park % 1000000000) };
+      nanosleep(&ts, nullptr);
+    }
+  }
+
+ private:
+  const int64_t spin_tries_;
+  const int64_t yield_tries_;
+  const int64_t min_park_ns_;
+  const int64_t max_park_ns_;
+};
+
 /**
  *   A barrier will block until all cursors it is following are
- *   have moved past a given position. The barrier uses a
- *   progressive backoff strategy of busy waiting for 1000
- *   tries, yielding for 1000 tries, and the usleeping in 10 ms
- *   intervals.
+ *   have moved past a given position. What it does while waiting is
+ *   up to its WaitStrategy, by default a progressive backoff of busy
+ *   waiting for 1000 tries, yielding for 1000 tries, and then usleeping
+ *   in 10 ms intervals (TimedParkWaitStrategy).
  *
- *   No wait conditions or locks are used because they would
- *   be 'intrusive' to publishers which must check to see whether
- *   or not they must 'notify'. The progressive backoff approach
- *   uses little CPU and is a good compromise for most use cases.
+ *   Only the BlockingWaitStrategy makes publishers 'notify', the others
+ *   are not 'intrusive' to publishers at all.
  */
 class Barrier
 {
  public:
+  Barrier ();
+
   void follows (std::shared_ptr<const EventCursor> event_cursor);
 
+  /**
+   *  Selects how to wait, may be changed before the cursor starts waiting.
+   */
+  void set_wait_strategy (WaitStrategySPtr strategy);
+
+  const WaitStrategySPtr& wait_strategy () const {
+    return strategy_;
+  }
+
   /**
    *  Used to check how much you can read/write without blocking.
    *  @return the min position of every cusror this barrier follows.
@@ -110,15 +299,22 @@ class Barrier
   int64_t get_min ();
 
   /**
-   *  This method will wait until all s in seq >= pos using a progressive
-   *  backoff of busy wait, yield, and usleep(10 * 1000)
+   *  This method will wait until all s in seq >= pos using the
+   *  wait strategy
    *  @return the minimum value of every dependency
    */
   int64_t wait_for (int64_t pos) const;
 
+  /**
+   *  Same as wait_for but does not cache the minimum, so it may be
+   *  called by several threads at once (multi producer cursors)
+   */
+  int64_t wait_for_concurrent (int64_t pos) const;
+
  private:
   mutable int64_t                                   last_min_;
   std::vector<std::shared_ptr<const EventCursor> >  limit_seq_;
+  WaitStrategySPtr                                  strategy_;
 };
 
 /**
@@ -238,15 +434,19 @@ class EventCursor
   EventCursor(int64_t pos = -1)
     : name_("")
     , begin_(pos)
-    , end_(pos) {
+    , end_(pos)
+    , cursor_(pos - 1) {
   }
 
   EventCursor(const char* name, int64_t pos = 0)
     : name_(name)
     , begin_(pos)
-    , end_(pos) {
+    , end_(pos)
+    , cursor_(pos - 1) {
   }
 
+  virtual ~EventCursor() {}
+
   /** 
    * this event processor will process every event upto, but not including s 
    */
@@ -255,6 +455,13 @@ class EventCursor
     barrier_.follows (std::forward<T> (s));
   }
 
+  /** 
+   * how this cursor waits on the cursors it follows
+   */
+  void set_wait_strategy (WaitStrategySPtr strategy) {
+    barrier_.set_wait_strategy (std::move (strategy));
+  }
+
   /** 
    * returns one after cursor 
    */
@@ -276,6 +483,7 @@ class EventCursor
     check_alert();
     begin_ = pos + 1;
     cursor_.store(pos);
+    signal_.notify();
   }
 
   /** 
@@ -283,6 +491,7 @@ class EventCursor
    */
   void set_eof() {
     cursor_.set_eof();
+    signal_.notify();
   }
 
   /** 
@@ -293,6 +502,7 @@ class EventCursor
   void set_alert(std::exception_ptr exception) {
     alert_ = std::move(exception);
     cursor_.set_alert();
+    signal_.notify();
   }
 
   /** 
@@ -318,6 +528,16 @@ class EventCursor
     return cursor_;
   }
 
+  /**
+   * the highest sequence followers may read, given that every sequence
+   * before pos was already readable. Equals pos() for cursors publishing
+   * in order, multi producer cursors scan their slots.
+   */
+  virtual int64_t highest_published(int64_t pos) const {
+    (void)pos;
+    return cursor_.aquire();
+  }
+
   /** 
    * used for debug messages 
    */
@@ -325,6 +545,13 @@ class EventCursor
     return name_;
   }
 
+  /** 
+   * lets blocking followers sleep until this cursor publishes
+   */
+  PublishSignal& signal() const {
+    return signal_;
+  }
+
  protected:
   // last know available, min(limit_seq_) 
   const char*                   name_;
@@ -333,6 +560,7 @@ class EventCursor
   std::exception_ptr            alert_;
   Barrier                       barrier_;
   Sequence                      cursor_;
+  mutable PublishSignal         signal_;
 };
 
 /**
@@ -351,7 +579,7 @@ class ReadCursor : public EventCursor
     try {
       return end_ = barrier_.wait_for(pos) + 1;
     } catch (const Eof&) {
-      cursor_.set_eof();
+      set_eof();
       throw;
     } catch (...) {
       set_alert(std::current_exception());
@@ -418,8 +646,9 @@ class WriteCursor : public EventCursor
    */
   int64_t wait_for (int64_t pos) {
     try {
-      // throws exception on error, returns 'short' on eof
-      return end_ = barrier_.wait_for (pos - size_) + size_;
+      // throws exception on error, returns 'short' on eof. A follower at
+      // min is done with the slot of min + size_, so end is one after it
+      return end_ = barrier_.wait_for (pos - size_) + size_ + 1;
     } catch (...) {
       set_alert (std::current_exception ());
       throw;
@@ -427,7 +656,7 @@ class WriteCursor : public EventCursor
   }
 
   int64_t check_end() {
-    return end_ = barrier_.get_min() + size_;
+    return end_ = barrier_.get_min() + size_ + 1;
   }
 
  private:
@@ -482,7 +711,7 @@ class SharedWriteCursor : public WriteCursor
       barrier_.wait_for(after_pos);
       publish(pos);
     } catch (const Eof&) {
-      cursor_.set_eof();
+      set_eof();
       throw;
     } catch (...) {
       set_alert(std::current_exception());
@@ -495,18 +724,170 @@ class SharedWriteCursor : public WriteCursor
 };
 typedef std::shared_ptr<SharedWriteCursor> SharedWriteCursorSPtr;
 
+/**
+ * Multi producer write cursor which does not make producers wait for
+ * each other. Every slot of the ring remembers the lap it was last
+ * published in, producers claim batches with a single atomic add and
+ * publish them in any order, followers scan for the highest contiguous
+ * published sequence.
+ *
+ * pos() is the highest claimed sequence, not the highest published one,
+ * it must only be followed through a Barrier.
+ *
+ * @code
+ * auto start = cur->claim (slots);
+ * ... write start .. start + slots - 1 ...
+ * cur->publish (start, start + slots - 1);
+ * @endcode
+ */
+class MultiWriteCursor : public EventCursor
+{
+ public:
+  /**
+   * @param size - the size of the ringbuffer, a power of 2
+   */
+  MultiWriteCursor(int64_t size)
+    : size_(size)
+    , shift_(log2(size))
+    , gating_(-1)
+    , available_(new std::atomic<int32_t>[size]) {
+    init();
+  }
+
+  /**
+   * @param name - name of the cursor for debug purposes
+   * @param size - the size of the ringbuffer, a power of 2
+   */
+  MultiWriteCursor(const char* name, int64_t size)
+    : EventCursor(name)
+    , size_(size)
+    , shift_(log2(size))
+    , gating_(-1)
+    , available_(new std::atomic<int32_t>[size]) {
+    init();
+  }
+
+  /**
+   * Claims num_slots consecutive slots, waits until the followed cursors
+   * freed them.
+   *
+   * @return the first slot the caller may write to.
+   */
+  int64_t claim(size_t num_slots) {
+    assert(num_slots > 0 && static_cast<int64_t>(num_slots) <= size_);
+    int64_t last = cursor_.atomic_increment_and_get(num_slots);
+    try {
+      check_alert();
+      wait_for(last);
+    } catch (...) {
+      set_alert(std::current_exception());
+      throw;
+    }
+
+    return last - num_slots + 1;
+  }
+
+  /**
+   * makes the claimed slots first .. last available to the followers
+   */
+  void publish(int64_t first, int64_t last) {
+    check_alert();
+    for (int64_t pos = first; pos <= last; ++pos) {
+      available_[pos & (size_ - 1)].store(static_cast<int32_t>(pos >> shift_), std::memory_order_release);
+    }
+    signal_.notify();
+  }
+
+  void publish(int64_t pos) {
+    publish(pos, pos);
+  }
+
+  virtual int64_t highest_published(int64_t pos) const {
+    // slots claimed but not published yet still carry the previous lap
+    int64_t claimed = cursor_.aquire();
+    for (; pos <= claimed; ++pos) {
+      if (available_[pos & (size_ - 1)].load(std::memory_order_acquire) != static_cast<int32_t>(pos >> shift_)) {
+        return pos - 1;
+      }
+    }
+
+    return claimed;
+  }
+
+ private:
+  static int log2(int64_t size) {
+    assert(size > 0 && (size & (size - 1)) == 0);
+    int shift = 0;
+    while ((1LL << shift) < size) {
+      ++shift;
+    }
+    return shift;
+  }
+
+  void init() {
+    begin_ = 0;
+    end_ = size_;
+    cursor_.store(-1);
+    for (int64_t i = 0; i < size_; ++i) {
+      available_[i].store(-1, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * waits until the followed cursors are past last - size_, the minimum
+   * is shared between the producers so most claims never look at them
+   */
+  void wait_for(int64_t last) {
+    int64_t wrap = last - size_;
+    if (wrap <= gating_.load(std::memory_order_acquire)) {
+      return;
+    }
+
+    int64_t min_pos = barrier_.wait_for_concurrent(wrap);
+    int64_t cached = gating_.load(std::memory_order_relaxed);
+    while (cached < min_pos && !gating_.compare_exchange_weak(cached, min_pos, std::memory_order_release)) {
+    }
+  }
+
+ private:
+  const int64_t                         size_;
+  const int                             shift_;
+  std::atomic<int64_t>                  gating_;
+  std::unique_ptr<std::atomic<int32_t>[]> available_;
+};
+typedef std::shared_ptr<MultiWriteCursor> MultiWriteCursorSPtr;
+
 //////////////////////////////////////////////////////////////////////////
 //
 // Barrier function define
 //
+inline Barrier::Barrier ()
+  : last_min_ (kMinInt64Value)
+  , strategy_ (std::make_shared<TimedParkWaitStrategy> ()) {
+}
+
 inline void Barrier::follows (std::shared_ptr<const EventCursor> event_cursor) {
+  if (strategy_->blocking ()) {
+    event_cursor->signal ().add_blocking_follower ();
+  }
   limit_seq_.push_back (std::move (event_cursor));
 }
 
+inline void Barrier::set_wait_strategy (WaitStrategySPtr strategy) {
+  assert (strategy);
+  if (strategy->blocking () && !strategy_->blocking ()) {
+    for (auto itr = limit_seq_.begin (); itr != limit_seq_.end (); ++itr) {
+      (*itr)->signal ().add_blocking_follower ();
+    }
+  }
+  strategy_ = std::move (strategy);
+}
+
 inline int64_t Barrier::get_min() {
   int64_t min_pos = kMaxInt64Value;
+  int64_t from = last_min_ == kMinInt64Value ? 0 : last_min_ + 1;
   for (auto itr = limit_seq_.begin(); itr != limit_seq_.end(); ++itr) {
-    auto itr_pos = (*itr)->pos().aquire();
+    auto itr_pos = (*itr)->highest_published(from);
     if (itr_pos < min_pos) {
       min_pos = itr_pos;
     }
@@ -521,40 +902,29 @@ inline int64_t Barrier::wait_for (int64_t pos) const
     return last_min_;
   }
 
+  return last_min_ = wait_for_concurrent (pos);
+}
+
+inline int64_t Barrier::wait_for_concurrent (int64_t pos) const
+{
   int64_t min_pos = kMaxInt64Value;
   for (auto itr = limit_seq_.begin (); itr != limit_seq_.end (); ++itr) {
     int64_t itr_pos = 0;
-    itr_pos = (*itr)->pos().aquire();
-
-    // spin for a bit 
-    for (int i = 0; itr_pos < pos && i < 1000; ++i) {
-      itr_pos = (*itr)->pos().aquire();
-      if ((*itr)->pos().alert()) break;
-    }
-
-    // yield for a while, queue slowing down
-    for (int y = 0; itr_pos < pos && y < 1000; ++y) {
-      usleep(0);
+    itr_pos = (*itr)->highest_published(pos);
 
-      itr_pos = (*itr)->pos().aquire();
+    for (int64_t tries = 0; itr_pos < pos; ++tries) {
       if ((*itr)->pos().alert()) break;
-    }
-
-    // queue stalled, don't peg the CPU but don't wait too long either...
-    while (itr_pos < pos) {
-      usleep (10 * 1000); // 10ms
-
-      itr_pos = (*itr)->pos ().aquire ();
-      if ((*itr)->pos ().alert ()) break;
+      strategy_->idle (**itr, pos, tries);
+      itr_pos = (*itr)->highest_published(pos);
     }
 
     if ((*itr)->pos ().alert ()) {
       (*itr)->check_alert ();
 
-      if (itr_pos > pos) {
-        // process everything up to itr_pos
-        return itr_pos - 1;
-      } else {
+      // eof, whatever was published before it is still to be processed
+      // and the other cursors must be waited for as usual
+      itr_pos = (*itr)->highest_published(pos);
+      if (itr_pos < pos) {
         throw Eof();
       }
     }
@@ -565,7 +935,23 @@ inline int64_t Barrier::wait_for (int64_t pos) const
   }
 
   assert (min_pos != kMaxInt64Value);
-  return last_min_ = min_pos;
+  return min_pos;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// WaitStrategy function define
+//
+inline void BlockingWaitStrategy::idle (const EventCursor& cursor, int64_t pos, int64_t tries) const {
+  if (tries < spin_tries_) {
+    cpu_relax ();
+    return;
+  }
+
+  // the timeout only bounds the damage of a publisher not using publish()
+  cursor.signal ().wait ([&cursor, pos] () {
+    return cursor.highest_published (pos) >= pos || cursor.pos ().alert ();
+  }, 100 * 1000 * 1000);
 }
 
 } // namespace disruptor
@@ -0,0 +1,171 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SWIFT_DISRUPTOR_DYNAMIC_RINGBUFFER_HPP__
+#define __SWIFT_DISRUPTOR_DYNAMIC_RINGBUFFER_HPP__
+
+#include <new>
+#include <memory>
+#include <stdexcept>
+
+#include "swift/base/memorymapping.h"
+
+namespace swift {
+namespace disruptor {
+
+/**
+ *  RingBuffer with a capacity chosen at runtime. The events live in an
+ *  anonymous mapping, which is page (and so cache line) aligned and may
+ *  be backed by 2MB huge pages and locked in memory, so that rings of
+ *  millions of slots do not take TLB misses or page faults on the hot
+ *  path. Every event is constructed once up front and reused in place,
+ *  publishers overwrite the fields instead of constructing new events.
+ *
+ *  @code
+ *  DynamicRingBuffer<Event>::Options opt;
+ *  opt.huge_pages = true;
+ *  opt.lock = true;
+ *  DynamicRingBuffer<Event> ring(config.ring_size, opt);
+ *  auto writer = std::make_shared<WriteCursor>(ring.get_buffer_size());
+ *  @endcode
+ */
+template<typename EventType>
+class DynamicRingBuffer
+{
+ public:
+  typedef EventType event_type;
+
+  struct Options {
+    Options()
+      : huge_pages(false)
+      , lock(false)
+      , prefault(true) {
+    }
+
+    bool huge_pages;  // back the events with huge pages
+    bool lock;        // mlock the events, fails softly without the rlimit
+    bool prefault;    // populate the pages while mapping
+  };
+
+  /**
+   * @param capacity - rounded up to a power of 2
+   */
+  explicit DynamicRingBuffer(uint64_t capacity, const Options& opt = Options())
+    : mask_(round_up(capacity) - 1)
+    , events_(nullptr)
+    , mapping_(map(mask_ + 1, opt)) {
+    construct([] (void* addr) { new (addr) EventType(); });
+  }
+
+  /**
+   * @param factory - returns the initial value of every event
+   */
+  template<typename Factory>
+  DynamicRingBuffer(uint64_t capacity, const Options& opt, Factory factory)
+    : mask_(round_up(capacity) - 1)
+    , events_(nullptr)
+    , mapping_(map(mask_ + 1, opt)) {
+    construct([&factory] (void* addr) { new (addr) EventType(factory()); });
+  }
+
+  ~DynamicRingBuffer() {
+    for (uint64_t i = 0; i <= mask_; ++i) {
+      events_[i].~EventType();
+    }
+  }
+
+  /**
+   * @return a read-only reference to the event at pos
+   */
+  const EventType& at(int64_t pos) const {
+    return events_[pos & mask_];
+  }
+
+  /**
+   * @return a reference to the event at pos
+   */
+  EventType& at(int64_t pos) {
+    return events_[pos & mask_];
+  }
+
+  int64_t get_buffer_index(int64_t pos) const {
+    return pos & mask_;
+  }
+
+  int64_t get_buffer_size() const {
+    return mask_ + 1;
+  }
+
+  /**
+   * true if the events are locked in memory
+   */
+  bool locked() const {
+    return mapping_->IsLocked();
+  }
+
+ private:
+  DynamicRingBuffer(const DynamicRingBuffer&);
+  DynamicRingBuffer& operator=(const DynamicRingBuffer&);
+
+  static uint64_t round_up(uint64_t capacity) {
+    uint64_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  static MemoryMapping* map(uint64_t size, const Options& opt) {
+    MemoryMapping::Options options;
+    options.SetWritable(true)
+        .SetShared(false)
+        .SetPrefault(opt.prefault)
+        .SetHugePages(opt.huge_pages);
+
+    std::unique_ptr<MemoryMapping> mapping(new MemoryMapping(
+        MemoryMapping::AnonymousType::ANONYMOUS_TYPE, sizeof(EventType) * size, options));
+    if (opt.lock) {
+      mapping->mlock(MemoryMapping::LockMode::LOCK_MODE_TRY_LOCK);
+    }
+    return mapping.release();
+  }
+
+  template<typename Construct>
+  void construct(Construct construct_at) {
+    static_assert(alignof(EventType) <= 4096, "events must fit the page alignment");
+    events_ = mapping_->AsWritableBuffer<EventType>().buf;
+
+    uint64_t i = 0;
+    try {
+      for (; i <= mask_; ++i) {
+        construct_at(&events_[i]);
+      }
+    } catch (...) {
+      while (i > 0) {
+        events_[--i].~EventType();
+      }
+      throw;
+    }
+  }
+
+ private:
+  const uint64_t                 mask_;
+  EventType*                     events_;
+  std::unique_ptr<MemoryMapping> mapping_;
+};
+
+} // namespace disruptor
+} // namespace swift
+
+#endif // __SWIFT_DISRUPTOR_DYNAMIC_RINGBUFFER_HPP__
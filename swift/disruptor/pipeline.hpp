@@ -0,0 +1,337 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SWIFT_DISRUPTOR_PIPELINE_HPP__
+#define __SWIFT_DISRUPTOR_PIPELINE_HPP__
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <utility>
+#include <exception>
+#include <stdexcept>
+#include <functional>
+
+#include "swift/disruptor/disruptor.hpp"
+
+namespace swift {
+namespace disruptor {
+
+/**
+ *  Builds and runs a pipeline of handler stages on one ring buffer. Stages
+ *  added with handle_with() see every event right after it was published,
+ *  each then() adds a group of stages that see it after all stages of the
+ *  previous group are done with it. Every handler runs on its own thread
+ *  and is called in batches, end_of_batch is true for the last event of
+ *  the batch.
+ *
+ *  @code
+ *  Disruptor<LogLine> pipeline;
+ *  pipeline.handle_with(parse, count).then(write).start();
+ *
+ *  pipeline.publish([&](LogLine& line, int64_t) { line.assign(...); });
+ *  ...
+ *  pipeline.stop();    // drains the ring, rethrows a handler failure
+ *  @endcode
+ */
+template<typename EventType, uint64_t Size = 1024>
+class Disruptor
+{
+ public:
+  typedef RingBuffer<EventType, Size> ring_type;
+  typedef std::function<void (EventType& event, int64_t sequence, bool end_of_batch)> Handler;
+
+  struct StageMetrics {
+    std::string name;         // "<group>.<index>"
+    int64_t     processed;    // events handled
+    int64_t     batches;      // batches handled, processed / batches is the average batch size
+    double      throughput;   // events per second since start()
+    int64_t     lag;          // events published (or claimed) but not handled yet
+  };
+
+  /**
+   * @param multi_producer - publish() may be called from several threads
+   */
+  explicit Disruptor(bool multi_producer = false)
+    : ring_(std::make_shared<ring_type>())
+    , strategy_(std::make_shared<TimedParkWaitStrategy>())
+    , next_(0)
+    , end_(0)
+    , started_(false)
+    , stopped_(false) {
+    if (multi_producer) {
+      multi_writer_ = std::make_shared<MultiWriteCursor>("writer", Size);
+      writer_ = multi_writer_;
+    } else {
+      single_writer_ = std::make_shared<WriteCursor>("writer", Size);
+      writer_ = single_writer_;
+    }
+  }
+
+  ~Disruptor() {
+    if (started_ && !stopped_) {
+      try {
+        stop();
+      } catch (...) {
+      }
+    }
+  }
+
+  /**
+   * adds handlers that process events as soon as they are published
+   */
+  template<typename... Handlers>
+  Disruptor& handle_with(Handlers... handlers) {
+    if (stages_.empty()) {
+      stages_.resize(1);
+    }
+    add_stages(0, std::vector<Handler>{Handler(handlers)...});
+    return *this;
+  }
+
+  /**
+   * adds handlers that process events after every handler added so far
+   */
+  template<typename... Handlers>
+  Disruptor& then(Handlers... handlers) {
+    if (stages_.empty()) {
+      throw std::logic_error("Disruptor::then without handle_with");
+    }
+    stages_.resize(stages_.size() + 1);
+    add_stages(stages_.size() - 1, std::vector<Handler>{Handler(handlers)...});
+    return *this;
+  }
+
+  /**
+   * how every cursor of the pipeline waits, must be called before start()
+   */
+  Disruptor& set_wait_strategy(WaitStrategySPtr strategy) {
+    strategy_ = std::move(strategy);
+    return *this;
+  }
+
+  /**
+   * wires the cursors and starts one thread per handler
+   */
+  void start() {
+    if (started_) {
+      throw std::logic_error("Disruptor already started");
+    }
+    if (stages_.empty()) {
+      throw std::logic_error("Disruptor without handlers");
+    }
+
+    writer_->set_wait_strategy(strategy_);
+    for (size_t group = 0; group < stages_.size(); ++group) {
+      for (auto& stage : stages_[group]) {
+        stage->cursor->set_wait_strategy(strategy_);
+        if (group == 0) {
+          stage->cursor->follows(writer_);
+        } else {
+          for (auto& prev : stages_[group - 1]) {
+            stage->cursor->follows(prev->cursor);
+          }
+        }
+      }
+    }
+    for (auto& stage : stages_.back()) {
+      writer_->follows(stage->cursor);
+    }
+
+    end_ = writer_->end();
+    start_time_ = std::chrono::steady_clock::now();
+    started_ = true;
+    for (auto& group : stages_) {
+      for (auto& stage : group) {
+        Stage* s = stage.get();
+        s->thread = std::thread([this, s] () { run(s); });
+      }
+    }
+  }
+
+  /**
+   * claims the next slot, lets translator(event, sequence) fill it in
+   * and publishes it. Throws the alert of a failed handler.
+   */
+  template<typename Translator>
+  void publish(Translator translator) {
+    publish_batch(1, translator);
+  }
+
+  /**
+   * same as publish() for n consecutive slots, translator is called
+   * once per slot. n must not exceed the ring size.
+   */
+  template<typename Translator>
+  void publish_batch(size_t n, Translator translator) {
+    assert(started_ && !stopped_);
+    assert(n > 0 && n <= Size);
+    if (multi_writer_) {
+      int64_t first = multi_writer_->claim(n);
+      int64_t last = first + n - 1;
+      for (int64_t pos = first; pos <= last; ++pos) {
+        translator(ring_->at(pos), pos);
+      }
+      multi_writer_->publish(first, last);
+      return;
+    }
+
+    int64_t first = next_;
+    int64_t last = first + n - 1;
+    if (last >= end_) {
+      end_ = single_writer_->wait_for(last);
+    }
+    for (int64_t pos = first; pos <= last; ++pos) {
+      translator(ring_->at(pos), pos);
+    }
+    single_writer_->publish(last);
+    next_ = last + 1;
+  }
+
+  /**
+   * Marks the end of the stream and waits until every handler processed
+   * every published event. Rethrows the first handler failure.
+   */
+  void stop() {
+    if (!started_ || stopped_) {
+      return;
+    }
+
+    stopped_ = true;
+    writer_->set_eof();
+    std::exception_ptr error;
+    for (auto& group : stages_) {
+      for (auto& stage : group) {
+        stage->thread.join();
+        if (!error && stage->error) {
+          error = stage->error;
+        }
+      }
+    }
+
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  /**
+   * a snapshot of every stage, in the order they were added
+   */
+  std::vector<StageMetrics> metrics() const {
+    std::vector<StageMetrics> result;
+    double seconds = started_ ? std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time_).count() : 0;
+    int64_t published = writer_->pos().aquire();
+    for (auto& group : stages_) {
+      for (auto& stage : group) {
+        StageMetrics m;
+        m.name = stage->name;
+        m.processed = stage->processed.load(std::memory_order_relaxed);
+        m.batches = stage->batches.load(std::memory_order_relaxed);
+        m.throughput = seconds > 0 ? m.processed / seconds : 0;
+        m.lag = published + 1 - m.processed;
+        if (m.lag < 0) {
+          m.lag = 0;
+        }
+        result.push_back(m);
+      }
+    }
+
+    return result;
+  }
+
+  ring_type& ring() {
+    return *ring_;
+  }
+
+ private:
+  Disruptor(const Disruptor&);
+  Disruptor& operator=(const Disruptor&);
+
+  struct Stage {
+    Stage(std::string stage_name, Handler h)
+      : name(std::move(stage_name))
+      , handler(std::move(h))
+      , cursor(std::make_shared<ReadCursor>(name.c_str()))
+      , processed(0)
+      , batches(0) {
+    }
+
+    std::string           name;
+    Handler               handler;
+    ReadCursorSPtr        cursor;
+    std::atomic<int64_t>  processed;
+    std::atomic<int64_t>  batches;
+    std::exception_ptr    error;
+    std::thread           thread;
+  };
+
+  void add_stages(size_t group, const std::vector<Handler>& handlers) {
+    if (started_) {
+      throw std::logic_error("Disruptor already started");
+    }
+    for (auto& handler : handlers) {
+      std::string name = std::to_string(group) + "." + std::to_string(stages_[group].size());
+      stages_[group].push_back(std::unique_ptr<Stage>(new Stage(name, handler)));
+    }
+  }
+
+  void run(Stage* stage) {
+    ReadCursor& cursor = *stage->cursor;
+    int64_t pos = cursor.begin();
+    try {
+      while (true) {
+        int64_t end = cursor.wait_for(pos);
+        int64_t count = end - pos;
+        for (; pos < end; ++pos) {
+          stage->handler(ring_->at(pos), pos, pos + 1 == end);
+        }
+
+        cursor.publish(end - 1);
+        // only this thread writes the counters
+        stage->processed.store(stage->processed.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+        stage->batches.store(stage->batches.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      }
+    } catch (const Eof&) {
+      // upstream is done and everything before it was handled
+    } catch (...) {
+      // a handler failed or an upstream cursor was alerted, the alert
+      // stops the stages after us and the publisher
+      stage->error = std::current_exception();
+      if (!cursor.alert()) {
+        cursor.set_alert(stage->error);
+      }
+    }
+  }
+
+ private:
+  std::shared_ptr<ring_type>                        ring_;
+  WaitStrategySPtr                                  strategy_;
+  std::shared_ptr<EventCursor>                      writer_;
+  WriteCursorSPtr                                   single_writer_;
+  MultiWriteCursorSPtr                              multi_writer_;
+  std::vector<std::vector<std::unique_ptr<Stage> > > stages_;
+  int64_t                                           next_;
+  int64_t                                           end_;
+  bool                                              started_;
+  bool                                              stopped_;
+  std::chrono::steady_clock::time_point             start_time_;
+};
+
+} // namespace disruptor
+} // namespace swift
+
+#endif // __SWIFT_DISRUPTOR_PIPELINE_HPP__
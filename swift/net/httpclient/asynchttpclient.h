@@ -0,0 +1,98 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SWIFT_NET_HTTP_CLIENT_ASYNC_HTTP_CLIENT_H__
+#define __SWIFT_NET_HTTP_CLIENT_ASYNC_HTTP_CLIENT_H__
+
+#include "swift/base/coroutine.h"
+
+#ifdef SWIFT_HAS_COROUTINE
+
+#include <memory>
+#include <functional>
+
+#include "swift/base/threadpool.h"
+#include "swift/base/noncopyable.hpp"
+#include "swift/net/httpclient/httpclient.h"
+
+namespace swift {
+
+// Awaitable requests for coroutines (needs -std=c++20):
+//
+//  Task<void> Download(AsyncHttpClient& http, const Request* req) {
+//      std::shared_ptr<Response> resp = co_await http.Get(req);
+//      ...
+//  }
+//
+// The curl calls still block, they run on io_pool and the coroutine
+// continues on that pool when the response is in. The number of requests
+// in flight is bounded by the size of io_pool instead of one thread
+// per caller.
+class AsyncHttpClient : swift::noncopyable
+{
+public:
+    typedef std::function<std::shared_ptr<Response>()> Call;
+    typedef Offload<Call> Awaitable;
+
+    AsyncHttpClient(const HttpClient& client, ThreadPool& io_pool)
+        : client_(client), io_pool_(io_pool)
+    {
+    }
+
+    // req must stay alive until the awaitable completes
+    Awaitable Get(const Request* req) const
+    {
+        const HttpClient* client = &client_;
+        return Awaitable(io_pool_, [client, req]() { return client->Get(req); });
+    }
+
+    Awaitable Head(const Request* req) const
+    {
+        const HttpClient* client = &client_;
+        return Awaitable(io_pool_, [client, req]() { return client->Head(req); });
+    }
+
+    Awaitable Put(const Request* req) const
+    {
+        const HttpClient* client = &client_;
+        return Awaitable(io_pool_, [client, req]() { return client->Put(req); });
+    }
+
+    Awaitable Post(const Request* req) const
+    {
+        const HttpClient* client = &client_;
+        return Awaitable(io_pool_, [client, req]() { return client->Post(req); });
+    }
+
+    Awaitable Copy(const Request* req) const
+    {
+        const HttpClient* client = &client_;
+        return Awaitable(io_pool_, [client, req]() { return client->Copy(req); });
+    }
+
+    Awaitable Delete(const Request* req) const
+    {
+        const HttpClient* client = &client_;
+        return Awaitable(io_pool_, [client, req]() { return client->Delete(req); });
+    }
+
+private:
+    const HttpClient& client_;
+    ThreadPool& io_pool_;
+};
+
+} // namespace swift
+
+#endif // SWIFT_HAS_COROUTINE
+#endif // __SWIFT_NET_HTTP_CLIENT_ASYNC_HTTP_CLIENT_H__
@@ -20,7 +20,7 @@
 #include <vector>
 #include <memory>
 
-#include "swift/base/rwspinlock.h"
+#include "swift/base/distributedrwlock.h"
 #include "swift/base/noncopyable.hpp"
 #include "swift/net/httpclient/easycurl.h"
 
@@ -48,9 +48,9 @@ private:
         std::atomic<bool> used_;
     };
 
-    typedef RWTicketSpinLock64 LockType;
-    typedef typename RWTicketSpinLock64::ReadHolder ReadLockGuard;
-    typedef typename RWTicketSpinLock64::WriteHolder WriteLockGuard;
+    typedef DistributedRWLock LockType;
+    typedef LockType::ReadHolder ReadLockGuard;
+    typedef LockType::WriteHolder WriteLockGuard;
 
 public:
     typedef std::shared_ptr<EasyCurlHandler> EasyCurlHandlerSPtrType;
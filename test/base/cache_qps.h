@@ -0,0 +1,41 @@
+#ifndef __SWIFT_TEST_BASE_CACHE_QPS_H__
+#define __SWIFT_TEST_BASE_CACHE_QPS_H__
+
+#include <vector>
+#include <thread>
+#include <sys/time.h>
+
+// Operations per second of thread_num threads doing run_times operations each
+// on cache over 4000 keys, one in write_every a Set and the others Get.
+// CacheType has Set (key, value) and Get (key, value&) on size_t.
+template<typename CacheType>
+double CacheQps(CacheType& cache, size_t thread_num, size_t run_times, size_t write_every)
+{
+    timeval t1, t2;
+    gettimeofday(&t1, NULL);
+
+    std::vector<std::thread> thread_pool;
+    for (size_t t = 0; t < thread_num; ++t) {
+        thread_pool.push_back(std::thread([&cache, run_times, write_every, t]() {
+            size_t value;
+            for (size_t i = 0; i < run_times; ++i) {
+                size_t key = (i * 7 + t * 13) % 4000;
+                if (i % write_every == 0) {
+                    cache.Set(key, i);
+                } else {
+                    cache.Get(key, value);
+                }
+            }
+        }));
+    }
+
+    for (auto& t : thread_pool) {
+        t.join();
+    }
+
+    gettimeofday(&t2, NULL);
+    time_t time_cost = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
+    return double(thread_num * run_times) / (double(time_cost) / 1000000);
+}
+
+#endif // __SWIFT_TEST_BASE_CACHE_QPS_H__
@@ -1,6 +1,8 @@
 #include <iostream>
 #include <thread>
 #include <future>
+#include <chrono>
+#include <vector>
 #include <memory>
 #include <string>
 #include <algorithm>
@@ -179,3 +181,93 @@ TEST_F (test_BlockingQueue, Structure)
     ASSERT_EQ (a.GetSize (), 0);
     ASSERT_EQ (strlen (r.GetData ()), r.GetSize ());
 }
+
+
+TEST_F (test_BlockingQueue, Batch)
+{
+    swift::BlockingQueue<int> q;
+    std::vector<int> v = {1, 2, 3, 4, 5};
+    ASSERT_TRUE (q.PutAll (v.begin (), v.end ()));
+    ASSERT_EQ (q.Size (), 5);
+
+    std::deque<int> some = q.TakeUpTo (2);
+    ASSERT_EQ (some.size (), 2);
+    ASSERT_EQ (some.front (), 1);
+    std::deque<int> all = q.TakeAll ();
+    ASSERT_EQ (all.size (), 3);
+    ASSERT_EQ (all.front (), 3);
+    ASSERT_TRUE (q.IsEmpty ());
+
+    // returns at once on an empty open queue instead of waiting for a put
+    ASSERT_TRUE (q.TakeUpTo (0).empty ());
+    ASSERT_FALSE (q.IsClosed ());
+
+    int x = 0;
+    ASSERT_FALSE (q.TryTake (x));
+    ASSERT_FALSE (q.TakeFor (x, std::chrono::milliseconds (1)));
+    q.Put (6);
+    ASSERT_TRUE (q.TakeFor (x, std::chrono::milliseconds (1)));
+    ASSERT_EQ (x, 6);
+}
+
+TEST_F (test_BlockingQueue, Close)
+{
+    swift::BlockingQueue<int> q;
+    auto consumer = std::async (std::launch::async, [&q] () {
+        int sum = 0;
+        int x = 0;
+        while (q.Take (x)) {
+            sum += x;
+        }
+        return sum;
+    });
+
+    auto batch_consumer = std::async (std::launch::async, [&q] () {
+        int sum = 0;
+        while (true) {
+            std::deque<int> all = q.TakeAll ();
+            if (all.empty ()) {
+                break;
+            }
+            for (auto x : all) {
+                sum += x;
+            }
+        }
+        return sum;
+    });
+
+    for (int i = 1; i <= 100; ++i) {
+        ASSERT_TRUE (q.Put (i));
+    }
+    q.Close ();
+    ASSERT_TRUE (q.IsClosed ());
+    ASSERT_FALSE (q.Put (101));
+
+    ASSERT_EQ (consumer.get () + batch_consumer.get (), 5050);
+    ASSERT_THROW (q.Take (), std::runtime_error);
+    ASSERT_TRUE (q.TakeUpTo (10).empty ());
+}
+
+TEST_F (test_BlockingQueue, TakeOrNotify)
+{
+    swift::BlockingQueue<int> q;
+    int notified = 0;
+    int x = 0;
+    bool drained = false;
+
+    // an empty queue keeps the notifier for the next put
+    ASSERT_FALSE (q.TakeOrNotify (x, &drained, [&notified] () { ++notified; }));
+    ASSERT_FALSE (q.TakeOrNotify (x, &drained, [&notified] () { ++notified; }));
+    q.Put (1);
+    ASSERT_EQ (notified, 1);
+    ASSERT_TRUE (q.TakeOrNotify (x, &drained, [&notified] () { ++notified; }));
+    ASSERT_FALSE (drained);
+    ASSERT_EQ (x, 1);
+
+    // close wakes every one left, then the queue reads as drained
+    q.Close ();
+    ASSERT_EQ (notified, 2);
+    ASSERT_TRUE (q.TakeOrNotify (x, &drained, [&notified] () { ++notified; }));
+    ASSERT_TRUE (drained);
+    ASSERT_EQ (notified, 2);
+}
@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+#include <thread>
+#include <iostream>
+#include <swift/base/cache_metrics.hpp>
+#include <swift/base/lru_cache.hpp>
+#include <swift/base/clock_cache.hpp>
+
+class test_CacheMetrics : public testing::Test
+{
+public:
+    test_CacheMetrics() {}
+    ~test_CacheMetrics() {}
+};
+
+namespace {
+
+// keys of a zipf like popularity, seeded for repeatable runs
+std::vector<int> Trace(size_t keys, size_t accesses)
+{
+    std::vector<double> weights;
+    for (size_t i = 0; i < keys; ++i) {
+        weights.push_back(1.0 / std::pow(i + 1.0, 0.8));
+    }
+    std::discrete_distribution<int> distribution(weights.begin(), weights.end());
+    std::mt19937 generator(12345);
+
+    std::vector<int> trace;
+    for (size_t i = 0; i < accesses; ++i) {
+        // scatter the popular keys over the key space
+        trace.push_back(distribution(generator) * 7919 % static_cast<int>(keys));
+    }
+    return trace;
+}
+
+// the miss ratio of a real LRU cache of size entries
+double LruMissRatio(const std::vector<int>& trace, size_t size)
+{
+    swift::LruCache<int, int> cache(size);
+    int value;
+    for (int key : trace) {
+        if (!cache.Get(key, value)) {
+            cache.Set(key, key);
+        }
+    }
+    swift::CacheMetrics<int>::Stats stats = cache.Metrics().GetStats();
+    return 1.0 - stats.HitRatio();
+}
+} // anonymous namespace
+
+TEST_F(test_CacheMetrics, Counters)
+{
+    swift::LruCache<int, int> cache(2);
+    int value;
+    cache.Set(1, 1);
+    cache.Set(2, 2);
+    cache.Get(1, value);
+    cache.Get(3, value);
+    cache.Set(3, 3);
+
+    swift::CacheMetrics<int>::Stats stats = cache.Metrics().GetStats();
+    EXPECT_EQ(1u, stats.hits);
+    EXPECT_EQ(1u, stats.misses);
+    EXPECT_EQ(1u, stats.evictions);
+    EXPECT_DOUBLE_EQ(0.5, stats.HitRatio());
+    EXPECT_TRUE(nullptr == cache.Metrics().Curve());
+
+    // counted in stripes shared by the threads, nothing is lost when they exit
+    swift::ClockCache<int, int> clock_cache(100);
+    for (int i = 0; i < 100; ++i) {
+        clock_cache.Set(i, i);
+    }
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.push_back(std::thread([&clock_cache]() {
+            int value;
+            for (int i = 0; i < 10000; ++i) {
+                clock_cache.Get(i % 200, value);
+            }
+        }));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    swift::CacheMetrics<int>::Stats clock_stats = clock_cache.Metrics().GetStats();
+    EXPECT_EQ(20000u, clock_stats.hits);
+    EXPECT_EQ(20000u, clock_stats.misses);
+}
+
+TEST_F(test_CacheMetrics, ManyCaches)
+{
+    // more caches than ThreadLocalPtr has ids for three counters each
+    std::vector<std::unique_ptr<swift::CacheMetrics<int> > > metrics;
+    for (int i = 0; i < 25000; ++i) {
+        metrics.push_back(std::unique_ptr<swift::CacheMetrics<int> >(new swift::CacheMetrics<int>()));
+        metrics.back()->Hit(i);
+    }
+    std::thread thread([&metrics]() {
+        for (auto& m : metrics) {
+            m->Miss(0);
+            m->Evict();
+        }
+    });
+    thread.join();
+
+    for (auto& m : metrics) {
+        swift::CacheMetrics<int>::Stats stats = m->GetStats();
+        EXPECT_EQ(1u, stats.hits);
+        EXPECT_EQ(1u, stats.misses);
+        EXPECT_EQ(1u, stats.evictions);
+    }
+}
+
+TEST_F(test_CacheMetrics, Loop)
+{
+    // 100 keys in a loop: every reuse is 99 keys away
+    swift::MissRatioCurve<int> curve(1.0);
+    EXPECT_EQ(0, curve.MissRatio(10));
+    for (int round = 0; round < 100; ++round) {
+        for (int key = 0; key < 100; ++key) {
+            curve.Access(key);
+        }
+    }
+
+    EXPECT_DOUBLE_EQ(1.0, curve.MissRatio(50));
+    EXPECT_DOUBLE_EQ(0.01, curve.MissRatio(100));
+    EXPECT_DOUBLE_EQ(0.01, curve.MissRatio(1000));
+}
+
+TEST_F(test_CacheMetrics, Accuracy)
+{
+    std::vector<int> trace = Trace(100000, 1000000);
+
+    // a tenth of the keys, and a bounded sample which has to lower its rate
+    swift::MissRatioCurve<int> curve(0.1, 100000);
+    swift::MissRatioCurve<int> small(0.1, 1000);
+    for (int key : trace) {
+        curve.Access(key);
+        small.Access(key);
+    }
+    EXPECT_GT(0.1, small.Rate());
+
+    for (size_t size : { 1000, 4000, 16000, 64000 }) {
+        double exact = LruMissRatio(trace, size);
+        std::cout << "size[" << size << "] lru miss ratio:" << exact
+                  << " estimated:" << curve.MissRatio(size)
+                  << " estimated at rate " << small.Rate() << ":" << small.MissRatio(size) << std::endl;
+        EXPECT_NEAR(exact, curve.MissRatio(size), 0.02);
+        EXPECT_NEAR(exact, small.MissRatio(size), 0.05);
+    }
+}
+
+TEST_F(test_CacheMetrics, Sizing)
+{
+    // what the service reports: the hit ratio of other cache sizes
+    std::vector<int> trace = Trace(100000, 500000);
+    swift::LruCache<int, int> cache(8000);
+    cache.Metrics().EnableMissRatioCurve(0.05);
+    int value;
+    for (int key : trace) {
+        if (!cache.Get(key, value)) {
+            cache.Set(key, key);
+        }
+    }
+
+    const swift::MissRatioCurve<int>* curve = cache.Metrics().Curve();
+    ASSERT_TRUE(nullptr != curve);
+    EXPECT_NEAR(cache.Metrics().GetStats().HitRatio(), 1.0 - curve->MissRatio(8000), 0.03);
+    for (double scale : { 0.5, 1.0, 2.0, 4.0 }) {
+        std::cout << "hit ratio at " << scale << "x capacity:"
+                  << 1.0 - curve->MissRatio(static_cast<size_t>(8000 * scale)) << std::endl;
+    }
+    EXPECT_LT(curve->MissRatio(32000), curve->MissRatio(4000));
+}
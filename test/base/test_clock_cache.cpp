@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <iostream>
+#include <swift/base/clock_cache.hpp>
+#include <swift/base/lru_cache.hpp>
+#include "cache_qps.h"
+
+class test_ClockCache : public testing::Test
+{
+public:
+    test_ClockCache() {}
+    ~test_ClockCache() {}
+};
+
+TEST_F(test_ClockCache, SetGet)
+{
+    swift::ClockCache<int, std::string> cache(3);
+    std::string value;
+    EXPECT_FALSE(cache.Get(1, value));
+
+    cache.Set(1, "a");
+    cache.Set(2, "b");
+    ASSERT_TRUE(cache.Get(1, value));
+    EXPECT_EQ("a", value);
+
+    cache.Set(1, "aa");
+    ASSERT_TRUE(cache.Get(1, value));
+    EXPECT_EQ("aa", value);
+    EXPECT_EQ(2u, cache.Size());
+
+    EXPECT_TRUE(cache.Erase(2));
+    EXPECT_FALSE(cache.Erase(2));
+    EXPECT_FALSE(cache.Get(2, value));
+    EXPECT_EQ(1u, cache.Size());
+}
+
+TEST_F(test_ClockCache, SecondChance)
+{
+    swift::ClockCache<int, int> cache(4);
+    for (int i = 0; i < 4; ++i) {
+        cache.Set(i, i);
+    }
+
+    // every entry but 2 is referenced, the hand passes them and evicts 2
+    int value;
+    for (int i = 0; i < 4; ++i) {
+        if (2 != i) {
+            ASSERT_TRUE(cache.Get(i, value));
+        }
+    }
+    cache.Set(4, 4);
+    EXPECT_EQ(4u, cache.Size());
+    EXPECT_FALSE(cache.Get(2, value));
+    for (int i : { 0, 1, 3, 4 }) {
+        EXPECT_TRUE(cache.Get(i, value));
+        EXPECT_EQ(i, value);
+    }
+}
+
+TEST_F(test_ClockCache, Churn)
+{
+    // far more keys than slots, so tombstones force table rebuilds
+    swift::ClockCache<int, int> cache(100);
+    for (int i = 0; i < 100000; ++i) {
+        cache.Set(i, i);
+        if (0 == i % 3) {
+            cache.Erase(i - 1);
+        }
+    }
+
+    EXPECT_GE(100u, cache.Size());
+    int value;
+    ASSERT_TRUE(cache.Get(99999, value));
+    EXPECT_EQ(99999, value);
+}
+
+TEST_F(test_ClockCache, Concurrent)
+{
+    swift::ClockCache<int, std::string> cache(64);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.push_back(std::thread([&cache, &stop, t]() {
+            std::string value;
+            for (int i = 0; !stop.load(); ++i) {
+                int key = (i * 7 + t) % 256;
+                if (cache.Get(key, value)) {
+                    ASSERT_EQ(std::to_string(key), value);
+                }
+            }
+        }));
+    }
+    for (int t = 0; t < 2; ++t) {
+        threads.push_back(std::thread([&cache, t]() {
+            for (int i = 0; i < 20000; ++i) {
+                int key = (i * 13 + t) % 256;
+                if (0 == i % 5) {
+                    cache.Erase(key);
+                } else {
+                    cache.Set(key, std::to_string(key));
+                }
+            }
+        }));
+    }
+
+    threads[4].join();
+    threads[5].join();
+    stop = true;
+    for (int t = 0; t < 4; ++t) {
+        threads[t].join();
+    }
+    EXPECT_GE(64u, cache.Size());
+}
+
+TEST_F(test_ClockCache, Benchmark)
+{
+    size_t run_times = 200000;
+    for (size_t thread_num = 1; thread_num <= 8; thread_num *= 2) {
+        swift::LruCache<size_t, size_t> lru_cache(2000);
+        swift::ClockCache<size_t, size_t> clock_cache(2000);
+        // 99% reads
+        double lru_qps = CacheQps(lru_cache, thread_num, run_times, 100);
+        double clock_qps = CacheQps(clock_cache, thread_num, run_times, 100);
+        std::cout << "thread_num[" << thread_num << "] lru_cache qps:" << lru_qps
+                  << " clock_cache qps:" << clock_qps << std::endl;
+    }
+}
@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <iostream>
+#include <swift/base/concurrent_hash_map.hpp>
+#include <swift/base/lru_cache.hpp>
+#include "cache_qps.h"
+
+class test_ConcurrentHashMap : public testing::Test
+{
+public:
+    test_ConcurrentHashMap() {}
+    ~test_ConcurrentHashMap() {}
+};
+
+TEST_F(test_ConcurrentHashMap, FindInsertErase)
+{
+    swift::ConcurrentHashMap<int, std::string> map(4, 2);
+    std::string value;
+    EXPECT_FALSE(map.Find(1, value));
+
+    EXPECT_TRUE(map.Insert(1, "a"));
+    EXPECT_FALSE(map.Insert(1, "b"));
+    ASSERT_TRUE(map.Find(1, value));
+    EXPECT_EQ("a", value);
+
+    EXPECT_FALSE(map.Upsert(1, "c"));
+    EXPECT_TRUE(map.Upsert(2, "d"));
+    ASSERT_TRUE(map.Find(1, value));
+    EXPECT_EQ("c", value);
+    EXPECT_EQ(2u, map.Size());
+
+    EXPECT_TRUE(map.Erase(1));
+    EXPECT_FALSE(map.Erase(1));
+    EXPECT_FALSE(map.Find(1, value));
+    EXPECT_EQ(1u, map.Size());
+
+    map.Clear();
+    EXPECT_EQ(0u, map.Size());
+    EXPECT_FALSE(map.Find(2, value));
+}
+
+TEST_F(test_ConcurrentHashMap, Grow)
+{
+    // starts with 2 buckets and doubles many times
+    swift::ConcurrentHashMap<int, int> map(1, 2);
+    for (int i = 0; i < 10000; ++i) {
+        ASSERT_TRUE(map.Insert(i, i * 2));
+    }
+    for (int i = 0; i < 10000; i += 2) {
+        ASSERT_TRUE(map.Erase(i));
+    }
+
+    EXPECT_EQ(5000u, map.Size());
+    int value;
+    for (int i = 0; i < 10000; ++i) {
+        ASSERT_EQ(1 == i % 2, map.Find(i, value));
+        if (1 == i % 2) {
+            ASSERT_EQ(i * 2, value);
+        }
+    }
+
+    size_t visited = 0;
+    long sum = 0;
+    map.ForEach([&visited, &sum](const int& key, const int& value) {
+        ++visited;
+        sum += value - key * 2;
+    });
+    EXPECT_EQ(5000u, visited);
+    EXPECT_EQ(0, sum);
+}
+
+TEST_F(test_ConcurrentHashMap, Concurrent)
+{
+    // keys below 1000 stay in the map, the others come and go
+    swift::ConcurrentHashMap<int, std::string> map(16, 4);
+    for (int i = 0; i < 1000; ++i) {
+        map.Insert(i, std::to_string(i));
+    }
+
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.push_back(std::thread([&map, &stop, t]() {
+            std::string value;
+            for (int i = 0; !stop.load(); ++i) {
+                int key = (i * 7 + t) % 4000;
+                bool found = map.Find(key, value);
+                if (key < 1000) {
+                    ASSERT_TRUE(found);
+                }
+                if (found) {
+                    ASSERT_EQ(std::to_string(key), value);
+                }
+                if (0 == i % 1000) {
+                    size_t stable = 0;
+                    map.ForEach([&stable](const int& key, const std::string& value) {
+                        ASSERT_EQ(std::to_string(key), value);
+                        stable += key < 1000 ? 1 : 0;
+                    });
+                    ASSERT_EQ(1000u, stable);
+                }
+            }
+        }));
+    }
+    for (int t = 0; t < 2; ++t) {
+        threads.push_back(std::thread([&map, t]() {
+            for (int i = 0; i < 50000; ++i) {
+                int key = 1000 + (i * 13 + t) % 3000;
+                if (0 == i % 3) {
+                    map.Erase(key);
+                } else {
+                    map.Upsert(key, std::to_string(key));
+                }
+            }
+        }));
+    }
+
+    threads[4].join();
+    threads[5].join();
+    stop = true;
+    for (int t = 0; t < 4; ++t) {
+        threads[t].join();
+    }
+
+    size_t count = 0;
+    map.ForEach([&count](const int&, const std::string&) { ++count; });
+    EXPECT_EQ(count, map.Size());
+}
+
+namespace {
+
+// a shared index: Get is Find, Set is Upsert
+template<typename KeyType, typename ValueType>
+struct MapCache {
+  MapCache(size_t capacity) : map(capacity) {}
+
+  void Set(const KeyType& key, const ValueType& value) {
+    map.Upsert(key, value);
+  }
+
+  bool Get(const KeyType& key, ValueType& value) {
+    return map.Find(key, value);
+  }
+
+  swift::ConcurrentHashMap<KeyType, ValueType> map;
+};
+} // anonymous namespace
+
+TEST_F(test_ConcurrentHashMap, Benchmark)
+{
+    size_t run_times = 100000;
+    for (size_t thread_num = 1; thread_num <= 32; thread_num *= 2) {
+        swift::LruCache<size_t, size_t> lru_cache(4000);
+        MapCache<size_t, size_t> map_cache(4000);
+        double lru_qps = CacheQps(lru_cache, thread_num, run_times, 10);
+        double map_qps = CacheQps(map_cache, thread_num, run_times, 10);
+        std::cout << "thread_num[" << thread_num << "] lru_cache qps:" << lru_qps
+                  << " concurrent_hash_map qps:" << map_qps << std::endl;
+    }
+}
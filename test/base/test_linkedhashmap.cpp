@@ -1,5 +1,14 @@
 #include <iostream>
+#include <chrono>
+#include <vector>
+#include <cstdio>
+#include <random>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <swift/base/linkedhashmap.h>
+#include <swift/base/flatlinkedhashmap.h>
 
 #include <gtest/gtest.h>
 
@@ -64,3 +73,440 @@ TEST_F (test_LinkedHashMap, All)
     ASSERT_TRUE (100 == bigMap.LastValue ());
 }
 
+
+TEST_F (test_LinkedHashMap, Rehash)
+{
+    typedef swift::LinkedHashMap<int, int> MapType;
+    MapType lhm (7);
+    MapType other (3);
+
+    // grows many times over, every operation runs while some rehash is going
+    for (int i = 0; i < 100000; ++i) {
+        lhm.Set (i, i, MapType::MM_LAST);
+        if (0 == i % 7) {
+            ASSERT_TRUE (lhm.Remove (i / 2));
+        }
+        if (0 == i % 11 && i / 3 % 7 != 0 && lhm.Find (i / 3) != lhm.End ()) {
+            ASSERT_EQ (i / 3, *lhm.Migrate (i / 3, &other, MapType::MM_LAST));
+        }
+    }
+
+    size_t count = 0;
+    int prev = -1;
+    for (auto it = lhm.Begin (); it != lhm.End (); ++it) {
+        ASSERT_LT (prev, it.Key ());
+        ASSERT_TRUE (nullptr != lhm.Get (it.Key (), MapType::MM_CURRENT));
+        ASSERT_TRUE (nullptr == other.Get (it.Key (), MapType::MM_CURRENT));
+        prev = it.Key ();
+        ++count;
+    }
+    ASSERT_EQ (lhm.Count (), count);
+    for (auto it = other.Begin (); it != other.End (); ++it) {
+        ASSERT_EQ (it.Key (), *other.Get (it.Key (), MapType::MM_CURRENT));
+    }
+
+    lhm.Clear ();
+    ASSERT_EQ (0u, lhm.Count ());
+    ASSERT_TRUE (nullptr == lhm.Get (99999, MapType::MM_CURRENT));
+
+    lhm.Reserve (1000);
+    for (int i = 0; i < 1000; ++i) {
+        lhm.Set (i, i, MapType::MM_FIRST);
+    }
+    ASSERT_EQ (999, lhm.FirstKey ());
+    ASSERT_EQ (0, lhm.LastKey ());
+}
+
+namespace {
+
+int kLiveRecords = 0;
+
+// std::allocator that counts the records it hands out
+template <class T>
+struct CountingAllocator : public std::allocator<T>
+{
+    template <class U>
+    struct rebind
+    {
+        typedef CountingAllocator<U> other;
+    };
+
+    CountingAllocator () {}
+    template <class U>
+    CountingAllocator (const CountingAllocator<U>&) {}
+
+    T* allocate (size_t num)
+    {
+        ++kLiveRecords;
+        return std::allocator<T>::allocate (num);
+    }
+
+    void deallocate (T* ptr, size_t num)
+    {
+        --kLiveRecords;
+        std::allocator<T>::deallocate (ptr, num);
+    }
+};
+} // anonymous namespace
+
+TEST_F (test_LinkedHashMap, Emplace)
+{
+    typedef swift::LinkedHashMap<std::string, std::unique_ptr<std::string> > MapType;
+    MapType lhm;
+
+    // move only values go in with Emplace and the rvalue Set
+    auto result = lhm.Emplace ("a", MapType::MM_LAST, new std::string ("1"));
+    ASSERT_TRUE (result.second);
+    ASSERT_EQ ("1", **result.first);
+    std::unique_ptr<std::string> unused (new std::string ("2"));
+    result = lhm.Emplace ("a", MapType::MM_LAST, std::move (unused));
+    ASSERT_FALSE (result.second);
+    ASSERT_EQ ("1", **result.first);
+    ASSERT_TRUE (nullptr != unused.get ());
+
+    std::unique_ptr<std::string> value (new std::string ("3"));
+    lhm.Set ("b", std::move (value), MapType::MM_LAST);
+    ASSERT_TRUE (nullptr == value.get ());
+    std::string key ("c");
+    lhm.Set (std::move (key), std::unique_ptr<std::string> (new std::string ("4")), MapType::MM_FIRST);
+    ASSERT_EQ ("c", lhm.FirstKey ());
+    ASSERT_EQ ("b", lhm.LastKey ());
+
+    // Set moves an existing record too
+    lhm.Set ("c", std::unique_ptr<std::string> (new std::string ("5")), MapType::MM_LAST);
+    ASSERT_EQ ("c", lhm.LastKey ());
+    ASSERT_EQ ("5", *lhm.LastValue ());
+    ASSERT_EQ ("a", lhm.FirstKey ());
+    ASSERT_EQ (3u, lhm.Count ());
+
+    MapType other;
+    ASSERT_EQ ("3", **lhm.Migrate ("b", &other, MapType::MM_FIRST));
+    ASSERT_EQ (2u, lhm.Count ());
+    ASSERT_EQ ("b", other.FirstKey ());
+}
+
+TEST_F (test_LinkedHashMap, Allocator)
+{
+    typedef swift::LinkedHashMap<int, int, std::hash<int>, std::equal_to<int>,
+                                 CountingAllocator<int> > MapType;
+    {
+        MapType lhm (7);
+        MapType other (7);
+        for (int i = 0; i < 100; ++i) {
+            lhm.Set (i, i, MapType::MM_LAST);
+        }
+        ASSERT_EQ (100, kLiveRecords);
+        lhm.Remove (0);
+        lhm.Migrate (1, &other, MapType::MM_LAST);
+        ASSERT_EQ (99, kLiveRecords);
+        other.Clear ();
+        ASSERT_EQ (98, kLiveRecords);
+    }
+    ASSERT_EQ (0, kLiveRecords);
+
+    // records freed to the slab pool are reused
+    swift::SlabAllocator<int64_t> slab;
+    int64_t* a = slab.allocate (1);
+    int64_t* b = slab.allocate (1);
+    slab.deallocate (a, 1);
+    ASSERT_EQ (a, slab.allocate (1));
+    int64_t* many = slab.allocate (100);
+    slab.deallocate (many, 100);
+    slab.deallocate (a, 1);
+    slab.deallocate (b, 1);
+
+    // copies and rebinds share the pool, memory goes back through any of them
+    swift::SlabAllocator<int64_t> copy (slab);
+    swift::SlabAllocator<char> rebound (slab);
+    ASSERT_TRUE (copy == slab);
+    ASSERT_TRUE (rebound == slab);
+    ASSERT_TRUE (swift::SlabAllocator<int64_t> (rebound) == slab);
+    ASSERT_TRUE (swift::SlabAllocator<int64_t> () != slab);
+    a = copy.allocate (1);
+    slab.deallocate (a, 1);
+    ASSERT_EQ (a, copy.allocate (1));
+    copy.deallocate (a, 1);
+}
+
+namespace {
+
+bool kThrowOnCopy = false;
+
+// a value whose move may throw, so Migrate copies it
+struct ThrowingValue
+{
+    ThrowingValue (int v) : value (v) {}
+    ThrowingValue (const ThrowingValue& other) : value (other.value)
+    {
+        if (kThrowOnCopy) throw std::bad_alloc ();
+    }
+    ThrowingValue (ThrowingValue&& other) : value (other.value) {}
+    ThrowingValue& operator= (const ThrowingValue& other)
+    {
+        value = other.value;
+        return *this;
+    }
+
+    int value;
+};
+} // anonymous namespace
+
+TEST_F (test_LinkedHashMap, MigrateThrow)
+{
+    typedef swift::LinkedHashMap<int, ThrowingValue> MapType;
+    MapType lhm (7);
+    MapType other (7);
+    lhm.Set (1, ThrowingValue (10), MapType::MM_LAST);
+    lhm.Set (2, ThrowingValue (20), MapType::MM_LAST);
+
+    // the record stays where it was
+    kThrowOnCopy = true;
+    ASSERT_THROW (lhm.Migrate (1, &other, MapType::MM_LAST), std::bad_alloc);
+    kThrowOnCopy = false;
+    ASSERT_EQ (2u, lhm.Count ());
+    ASSERT_EQ (0u, other.Count ());
+    ASSERT_EQ (10, lhm.Get (1, MapType::MM_CURRENT)->value);
+
+    ASSERT_EQ (10, lhm.Migrate (1, &other, MapType::MM_LAST)->value);
+    ASSERT_EQ (1u, lhm.Count ());
+    ASSERT_EQ (10, other.Get (1, MapType::MM_CURRENT)->value);
+
+    // to the map itself only moves the record
+    ASSERT_EQ (20, lhm.Migrate (2, &lhm, MapType::MM_FIRST)->value);
+    ASSERT_EQ (1u, lhm.Count ());
+}
+
+TEST_F (test_LinkedHashMap, Flat)
+{
+    typedef swift::FlatLinkedHashMap<int, int> MapType;
+    MapType fhm;
+
+    ASSERT_TRUE (0 == fhm.Count ());
+    fhm.Set (100, 100, MapType::MM_FIRST);
+    fhm.Set (101, 101, MapType::MM_FIRST);
+    fhm.Set (102, 102, MapType::MM_LAST);
+    fhm.Set (103, 103, MapType::MM_CURRENT);
+    // 101 100 102 103
+    ASSERT_EQ (101, fhm.FirstKey ());
+    ASSERT_EQ (103, fhm.LastKey ());
+
+    ASSERT_EQ (100, *fhm.Get (100, MapType::MM_LAST));
+    ASSERT_EQ (100, fhm.LastKey ());
+    ASSERT_EQ (103, *fhm.Get (103, MapType::MM_FIRST));
+    ASSERT_EQ (103, fhm.FirstValue ());
+    fhm.Set (101, 1, MapType::MM_LAST);
+    ASSERT_EQ (1, fhm.LastValue ());
+
+    int expected[] = { 103, 102, 100, 101 };
+    int count = 0;
+    for (auto it = fhm.Begin (); it != fhm.End (); ++it) {
+        ASSERT_EQ (expected[count++], it.Key ());
+    }
+    ASSERT_EQ (4, count);
+    auto last = fhm.End ();
+    --last;
+    ASSERT_EQ (101, last.Key ());
+
+    auto it = fhm.Find (102);
+    ASSERT_EQ (102, it.Key ());
+    ASSERT_EQ (102, it.Value ());
+    ASSERT_TRUE (fhm.End () == fhm.Find (104));
+
+    ASSERT_TRUE (fhm.Remove (102));
+    ASSERT_FALSE (fhm.Remove (102));
+    ASSERT_TRUE (nullptr == fhm.Get (102, MapType::MM_LAST));
+    ASSERT_EQ (3u, fhm.Count ());
+
+    MapType other;
+    ASSERT_EQ (103, *fhm.Migrate (103, &other, MapType::MM_FIRST));
+    ASSERT_TRUE (nullptr == fhm.Migrate (103, &other, MapType::MM_FIRST));
+    ASSERT_EQ (103, other.FirstKey ());
+    ASSERT_EQ (2u, fhm.Count ());
+
+    fhm.Clear ();
+    ASSERT_EQ (0u, fhm.Count ());
+    ASSERT_TRUE (fhm.Begin () == fhm.End ());
+}
+
+TEST_F (test_LinkedHashMap, FlatChurn)
+{
+    // grows past the mmap threshold, removals reuse records and shift slots
+    swift::FlatLinkedHashMap<int, int> fhm;
+    for (int i = 0; i < 100000; ++i) {
+        fhm.Set (i, i, swift::FlatLinkedHashMap<int, int>::MM_LAST);
+        if (0 == i % 3) {
+            ASSERT_TRUE (fhm.Remove (i / 2));
+        }
+    }
+
+    size_t count = 0;
+    int prev = -1;
+    for (auto it = fhm.Begin (); it != fhm.End (); ++it) {
+        ASSERT_LT (prev, it.Key ());
+        ASSERT_EQ (it.Key (), *fhm.Get (it.Key (), swift::FlatLinkedHashMap<int, int>::MM_CURRENT));
+        prev = it.Key ();
+        ++count;
+    }
+    ASSERT_EQ (fhm.Count (), count);
+}
+
+TEST_F (test_LinkedHashMap, FlatAlias)
+{
+    // the value lives in the map and the Set grows it
+    typedef swift::FlatLinkedHashMap<std::string, std::string> MapType;
+    MapType fhm;
+    fhm.Set ("0", std::string (64, 'x'), MapType::MM_LAST);
+    for (int i = 1; i < 1000; ++i) {
+        fhm.Set (std::to_string (i), fhm.FirstValue (), MapType::MM_LAST);
+        ASSERT_EQ (std::string (64, 'x'), fhm.LastValue ());
+    }
+    ASSERT_EQ (1000u, fhm.Count ());
+}
+
+namespace {
+
+struct alignas (16) Wide
+{
+    int64_t v[2];
+};
+} // anonymous namespace
+
+TEST_F (test_LinkedHashMap, FlatAlignment)
+{
+    // large tables are mmapped, records must keep their alignment there too
+    swift::FlatLinkedHashMap<int, Wide> fhm;
+    Wide wide = { { 1, 2 } };
+    for (int i = 0; i < 40000; ++i) {
+        Wide* value = fhm.Set (i, wide, swift::FlatLinkedHashMap<int, Wide>::MM_LAST);
+        ASSERT_EQ (0u, reinterpret_cast<uintptr_t> (value) % alignof (Wide));
+    }
+}
+
+namespace {
+
+template <typename Func>
+double Elapsed (Func func)
+{
+    auto start = std::chrono::steady_clock::now ();
+    func ();
+    return std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - start).count ();
+}
+
+// Insert n keys, look every one up in random order, moving it to the end
+// like an LRU hit, then remove them all.
+template <typename MapType>
+void RunLinked (const char* name, MapType& map, const std::vector<int>& keys, const std::vector<int>& order)
+{
+    int64_t sum = 0;
+    double set = Elapsed ([&] () {
+        for (int key : keys) {
+            map.Set (key, key, MapType::MM_LAST);
+        }
+    });
+    double get = Elapsed ([&] () {
+        for (int key : order) {
+            sum += *map.Get (key, MapType::MM_LAST);
+        }
+    });
+    double remove = Elapsed ([&] () {
+        for (int key : order) {
+            map.Remove (key);
+        }
+    });
+    printf ("%24s %12.2f %12.2f %12.2f\n", name, set, get, remove);
+    ASSERT_NE (0, sum);
+}
+} // anonymous namespace
+
+TEST_F (test_LinkedHashMap, Benchmark)
+{
+    for (int n = 1000; n <= 1000000; n *= 10) {
+        std::mt19937 rand (n);
+        std::vector<int> keys;
+        for (int i = 0; i < n; ++i) {
+            keys.push_back (static_cast<int> (rand ()));
+        }
+        std::vector<int> order (keys);
+        std::shuffle (order.begin (), order.end (), rand);
+
+        printf ("%d keys, ms\n%24s %12s %12s %12s\n", n, "", "set", "get", "remove");
+        {
+            // sized for n up front, the next one grows from the default size
+            swift::LinkedHashMap<int, int> map (n);
+            RunLinked ("LinkedHashMap", map, keys, order);
+        }
+        {
+            swift::LinkedHashMap<int, int> map;
+            RunLinked ("LinkedHashMap grown", map, keys, order);
+        }
+        {
+            swift::FlatLinkedHashMap<int, int> map (n);
+            RunLinked ("FlatLinkedHashMap", map, keys, order);
+        }
+        {
+            std::unordered_map<int, int> map (n);
+            int64_t sum = 0;
+            double set = Elapsed ([&] () {
+                for (int key : keys) {
+                    map[key] = key;
+                }
+            });
+            double get = Elapsed ([&] () {
+                for (int key : order) {
+                    sum += map.find (key)->second;
+                }
+            });
+            double remove = Elapsed ([&] () {
+                for (int key : order) {
+                    map.erase (key);
+                }
+            });
+            printf ("%24s %12.2f %12.2f %12.2f\n", "std::unordered_map", set, get, remove);
+            ASSERT_NE (0, sum);
+        }
+    }
+}
+
+// The slowest single Set while growing from the default size to 1M records,
+// the incremental rehash keeps it far below the cost of moving every record.
+TEST_F (test_LinkedHashMap, RehashLatency)
+{
+    swift::LinkedHashMap<int, int> map;
+    double worst = 0;
+    for (int i = 0; i < 1000000; ++i) {
+        double elapsed = Elapsed ([&] () {
+            map.Set (i, i, swift::LinkedHashMap<int, int>::MM_LAST);
+        });
+        worst = std::max (worst, elapsed);
+    }
+    printf ("slowest Set of 1000000: %.3f ms\n", worst);
+}
+
+// LRU style churn, every Set of a new key removes the oldest one
+TEST_F (test_LinkedHashMap, AllocatorChurn)
+{
+    typedef swift::LinkedHashMap<int, std::string, std::hash<int>, std::equal_to<int>,
+                                 std::allocator<int> > MallocMap;
+    typedef swift::LinkedHashMap<int, std::string> SlabMap;
+
+    const int n = 2000000;
+    MallocMap malloc_map (10000);
+    SlabMap slab_map (10000);
+    double malloc_ms = Elapsed ([&] () {
+        for (int i = 0; i < n; ++i) {
+            malloc_map.Set (i, std::string ("value"), MallocMap::MM_LAST);
+            if (malloc_map.Count () > 10000) {
+                malloc_map.Remove (malloc_map.FirstKey ());
+            }
+        }
+    });
+    double slab_ms = Elapsed ([&] () {
+        for (int i = 0; i < n; ++i) {
+            slab_map.Set (i, std::string ("value"), SlabMap::MM_LAST);
+            if (slab_map.Count () > 10000) {
+                slab_map.Remove (slab_map.FirstKey ());
+            }
+        }
+    });
+    printf ("churn of %d: std::allocator %.2f ms, SlabAllocator %.2f ms\n", n, malloc_ms, slab_ms);
+}
@@ -2,7 +2,10 @@
 #include <iostream>
 #include <sys/time.h>
 #include <swift/base/lru_cache.hpp>
+#include <swift/base/sharded_lru_cache.hpp>
+#include <memory>
 #include <thread>
+#include "cache_qps.h"
 
 class test_LruCache : public testing::Test
 {
@@ -64,4 +67,81 @@ TEST_F(test_LruCache, All)
     double total_num = double(thread_num * run_times);
     double qps = total_num / time_in_sec;
     std::cout << "lru_cache: thread_num[" << thread_num << "] qps:" << qps << std::endl;
-}
\ No newline at end of file
+}
+
+TEST_F(test_LruCache, Sharded)
+{
+    // one shard is an exact LRU
+    swift::ShardedLruCache<size_t, size_t> lru_cache(3, 1);
+    EXPECT_EQ(3u, lru_cache.Capacity());
+    lru_cache.Set(1, 1);
+    lru_cache.Set(2, 2);
+    lru_cache.Set(3, 3);
+
+    size_t value = 0;
+    ASSERT_TRUE(lru_cache.Get(1, value));
+    EXPECT_EQ(1u, value);
+
+    // order 1, 3, 2  erase 2
+    lru_cache.Set(4, 4);
+    ASSERT_FALSE(lru_cache.Get(2, value));
+    EXPECT_EQ(3u, lru_cache.Size());
+
+    // replace
+    lru_cache.Set(3, 30);
+    ASSERT_TRUE(lru_cache.Get(3, value));
+    EXPECT_EQ(30u, value);
+    EXPECT_EQ(3u, lru_cache.Size());
+
+    EXPECT_TRUE(lru_cache.Erase(3));
+    EXPECT_FALSE(lru_cache.Erase(3));
+    EXPECT_EQ(2u, lru_cache.Size());
+    EXPECT_FALSE(lru_cache.Get(3));
+
+    // capacity is split between the shards
+    swift::ShardedLruCache<size_t, size_t> sharded(100, 5);
+    EXPECT_EQ(104u, sharded.Capacity());
+    for (size_t i = 0; i < 1000; ++i) {
+        sharded.Set(i, i);
+    }
+    EXPECT_GE(sharded.Capacity(), sharded.Size());
+    ASSERT_TRUE(sharded.Get(999, value));
+    EXPECT_EQ(999u, value);
+}
+
+TEST_F(test_LruCache, ShardedPinnedHandle)
+{
+    typedef swift::ShardedLruCache<int, std::shared_ptr<std::string> > CacheType;
+    CacheType lru_cache(1, 1);
+    std::shared_ptr<std::string> first(new std::string("first"));
+    lru_cache.Set(1, first);
+
+    CacheType::Handle handle = lru_cache.Get(1);
+    ASSERT_TRUE(static_cast<bool>(handle));
+    EXPECT_EQ(1, handle.Key());
+    EXPECT_EQ("first", **handle);
+
+    // evicted, but the handle keeps the value alive
+    lru_cache.Set(2, std::shared_ptr<std::string>(new std::string("second")));
+    EXPECT_FALSE(lru_cache.Get(1));
+    EXPECT_EQ("first", *handle.Value());
+    EXPECT_EQ(2, first.use_count());
+
+    CacheType::Handle moved(std::move(handle));
+    EXPECT_FALSE(static_cast<bool>(handle));
+    moved.Reset();
+    EXPECT_EQ(1, first.use_count());
+}
+
+TEST_F(test_LruCache, ShardedBenchmark)
+{
+    size_t run_times = 200000;
+    for (size_t thread_num = 1; thread_num <= 8; thread_num *= 2) {
+        swift::LruCache<size_t, size_t> lru_cache(2000);
+        swift::ShardedLruCache<size_t, size_t> sharded(2000);
+        double lru_qps = CacheQps(lru_cache, thread_num, run_times, 10);
+        double sharded_qps = CacheQps(sharded, thread_num, run_times, 10);
+        std::cout << "thread_num[" << thread_num << "] lru_cache qps:" << lru_qps
+                  << " sharded_lru_cache qps:" << sharded_qps << std::endl;
+    }
+}
@@ -0,0 +1,214 @@
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include <swift/base/mappedhashtable.h>
+
+class test_MappedHashTable : public testing::Test
+{
+public:
+    test_MappedHashTable () : path_ ("./test_mappedhashtable." + std::to_string (::getpid ())) {}
+    ~test_MappedHashTable () {}
+
+    virtual void SetUp (void)
+    {
+        ::unlink (path_.c_str ());
+    }
+
+    virtual void TearDown (void)
+    {
+        ::unlink (path_.c_str ());
+    }
+
+protected:
+    std::string path_;
+};
+
+TEST_F (test_MappedHashTable, Fixed)
+{
+    swift::MappedHashTable::Options options;
+    options.slot_num = 64;
+    options.key_size = 8;
+    options.value_size = 16;
+
+    swift::MappedHashTable table;
+    ASSERT_TRUE (table.Open (path_, options));
+    EXPECT_FALSE (table.IsWarm ());
+
+    EXPECT_TRUE (table.Set ("a", "1"));
+    EXPECT_TRUE (table.Set ("b", "22"));
+    EXPECT_TRUE (table.Set ("a", "333"));
+    EXPECT_FALSE (table.Set ("too long key", "x"));
+    EXPECT_FALSE (table.Set ("c", "a value longer than 16"));
+    EXPECT_EQ (2u, table.Count ());
+
+    std::string value;
+    ASSERT_TRUE (table.Get ("a", &value));
+    EXPECT_EQ ("333", value);
+    EXPECT_TRUE (table.Remove ("b"));
+    EXPECT_FALSE (table.Remove ("b"));
+    EXPECT_FALSE (table.Get ("b", &value));
+
+    // at most 3/4 of the slots are used, tombstones are rebuilt away
+    for (int round = 0; round < 10; ++round) {
+        for (int i = 0; i < 47; ++i) {
+            ASSERT_TRUE (table.Set (std::to_string (i), std::to_string (round)));
+        }
+        EXPECT_FALSE (table.Set ("full", "x"));
+        for (int i = 0; i < 47; ++i) {
+            ASSERT_TRUE (table.Get (std::to_string (i), &value));
+            ASSERT_EQ (std::to_string (round), value);
+            ASSERT_TRUE (table.Remove (std::to_string (i)));
+        }
+    }
+    EXPECT_EQ (1u, table.Count ());
+
+    table.Clear ();
+    EXPECT_EQ (0u, table.Count ());
+    EXPECT_FALSE (table.Get ("a", &value));
+}
+
+TEST_F (test_MappedHashTable, NotOpen)
+{
+    swift::MappedHashTable table;
+    std::string value;
+    EXPECT_FALSE (table.Set ("a", "1"));
+    EXPECT_FALSE (table.Get ("a", &value));
+    EXPECT_FALSE (table.Remove ("a"));
+    table.Clear ();
+    EXPECT_EQ (0u, table.Count ());
+
+    swift::MappedHashTable::Options options;
+    options.slot_num = 64;
+    options.key_size = 8;
+    options.value_size = 16;
+    ASSERT_TRUE (table.Open (path_, options));
+    EXPECT_TRUE (table.Set ("a", "1"));
+    table.Close ();
+    EXPECT_FALSE (table.Set ("b", "2"));
+    EXPECT_FALSE (table.Get ("a", &value));
+    EXPECT_FALSE (table.Remove ("a"));
+    EXPECT_EQ (0u, table.Count ());
+}
+
+TEST_F (test_MappedHashTable, Warm)
+{
+    swift::MappedHashTable::Options options;
+    options.slot_num = 1024;
+    options.heap_size = 64 * 1024;
+    {
+        swift::MappedHashTable table;
+        ASSERT_TRUE (table.Open (path_, options));
+        for (int i = 0; i < 500; ++i) {
+            ASSERT_TRUE (table.Set ("key" + std::to_string (i), std::string (i % 50, 'v')));
+        }
+        ASSERT_TRUE (table.Set ("key0", "grown past the old record"));
+        ASSERT_TRUE (table.Set ("empty", ""));
+    }
+
+    swift::MappedHashTable table;
+    options.verify_data = true;
+    ASSERT_TRUE (table.Open (path_, options));
+    EXPECT_TRUE (table.IsWarm ());
+    EXPECT_EQ (501u, table.Count ());
+
+    std::string value;
+    for (int i = 1; i < 500; ++i) {
+        ASSERT_TRUE (table.Get ("key" + std::to_string (i), &value));
+        ASSERT_EQ (std::string (i % 50, 'v'), value);
+    }
+    ASSERT_TRUE (table.Get ("key0", &value));
+    EXPECT_EQ ("grown past the old record", value);
+    ASSERT_TRUE (table.Get ("empty", &value));
+    EXPECT_EQ ("", value);
+
+    // the heap is full
+    EXPECT_FALSE (table.Set ("big", std::string (64 * 1024, 'x')));
+    table.Close ();
+
+    // another layout starts cold
+    options.slot_num = 2048;
+    ASSERT_TRUE (table.Open (path_, options));
+    EXPECT_FALSE (table.IsWarm ());
+    EXPECT_EQ (0u, table.Count ());
+}
+
+TEST_F (test_MappedHashTable, Crash)
+{
+    swift::MappedHashTable::Options options;
+
+    // dies after a Sync, before any other change: warm
+    pid_t pid = ::fork ();
+    if (0 == pid) {
+        swift::MappedHashTable table;
+        table.Open (path_, options);
+        table.Set ("synced", "1");
+        table.Sync ();
+        ::_exit (0);
+    }
+    ::waitpid (pid, nullptr, 0);
+    {
+        swift::MappedHashTable table;
+        ASSERT_TRUE (table.Open (path_, options));
+        EXPECT_TRUE (table.IsWarm ());
+        std::string value;
+        EXPECT_TRUE (table.Get ("synced", &value));
+    }
+
+    // dies in the middle of changes: the dirty flag resets the table
+    pid = ::fork ();
+    if (0 == pid) {
+        swift::MappedHashTable table;
+        table.Open (path_, options);
+        table.Set ("unsynced", "2");
+        ::_exit (0);
+    }
+    ::waitpid (pid, nullptr, 0);
+    {
+        swift::MappedHashTable table;
+        ASSERT_TRUE (table.Open (path_, options));
+        EXPECT_FALSE (table.IsWarm ());
+        EXPECT_EQ (0u, table.Count ());
+        table.Set ("a", "1");
+    }
+
+    // a damaged header fails its checksum
+    {
+        FILE* file = ::fopen (path_.c_str (), "r+");
+        ASSERT_TRUE (nullptr != file);
+        ::fseek (file, 40, SEEK_SET);
+        ::fputc (0x7f, file);
+        ::fclose (file);
+    }
+    swift::MappedHashTable table;
+    ASSERT_TRUE (table.Open (path_, options));
+    EXPECT_FALSE (table.IsWarm ());
+}
+
+// How long a restart takes to map a warm table back
+TEST_F (test_MappedHashTable, Reopen)
+{
+    swift::MappedHashTable::Options options;
+    options.slot_num = 1 << 20;
+    options.heap_size = 64 << 20;
+    {
+        swift::MappedHashTable table;
+        ASSERT_TRUE (table.Open (path_, options));
+        for (int i = 0; i < 500000; ++i) {
+            ASSERT_TRUE (table.Set ("/v1/account/container/object" + std::to_string (i), "etag,size,mtime"));
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now ();
+    swift::MappedHashTable table;
+    ASSERT_TRUE (table.Open (path_, options));
+    double elapsed = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - start).count ();
+    ASSERT_TRUE (table.IsWarm ());
+
+    std::string value;
+    ASSERT_TRUE (table.Get ("/v1/account/container/object12345", &value));
+    printf ("reopened %lu records in %.3f ms\n", static_cast<unsigned long> (table.Count ()), elapsed);
+}
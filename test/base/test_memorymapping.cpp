@@ -71,6 +71,24 @@ TEST(test_MemoryMapping, Basic)
     }
 }
 
+TEST(test_MemoryMapping, HugePages)
+{
+    // falls back to normal pages when no huge pages are reserved
+    swift::MemoryMapping::Options opt;
+    opt.SetWritable(true).SetShared(false).SetHugePages(true);
+    swift::MemoryMapping m(swift::MemoryMapping::AnonymousType::ANONYMOUS_TYPE,
+                           3 * 1024 * 1024,
+                           opt);
+    EXPECT_EQ(3 * 1024 * 1024, m.GetData().size());
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(m.GetData().data()) % 64);
+
+    swift::MemoryMapping::Buffer<int> buffer = m.AsWritableBuffer<int>();
+    for (size_t i = 0; i < buffer.length; ++i) {
+        buffer.buf[i] = static_cast<int>(i);
+    }
+    EXPECT_EQ(static_cast<int>(buffer.length - 1), buffer.buf[buffer.length - 1]);
+}
+
 TEST(test_MemoryMapping, Lock)
 {
     swift::File f = swift::File::Temporary();
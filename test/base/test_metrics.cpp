@@ -0,0 +1,164 @@
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <gtest/gtest.h>
+#include <swift/base/metrics.h>
+
+class test_Metrics : public testing::Test
+{
+public:
+    test_Metrics () {}
+    ~test_Metrics () {}
+
+    virtual void SetUp (void)
+    {
+    }
+
+    virtual void TearDown (void)
+    {
+    }
+};
+
+TEST_F (test_Metrics, Counter)
+{
+    swift::Counter counter;
+    EXPECT_EQ (0, counter.Value ());
+    counter.Increment ();
+    counter.Increment (9);
+    EXPECT_EQ (10, counter.Value ());
+
+    // threads exit before the read, their cells are folded into the base
+    const int kThreads = 8;
+    const int kCount = 100000;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; ++i) {
+        threads.push_back (std::thread ([&counter] () {
+            for (int j = 0; j < kCount; ++j) {
+                counter.Increment ();
+            }
+        }));
+    }
+    for (auto& t : threads) {
+        t.join ();
+    }
+    EXPECT_EQ (10 + kThreads * kCount, counter.Value ());
+    EXPECT_EQ (10 + kThreads * kCount, counter.Value ());
+
+    counter.Increment (-10);
+    EXPECT_EQ (kThreads * kCount, counter.Value ());
+}
+
+TEST_F (test_Metrics, CounterConcurrentRead)
+{
+    swift::Counter counter;
+    std::atomic<bool> done (false);
+    std::thread reader ([&counter, &done] () {
+        int64_t last = 0;
+        while (!done.load ()) {
+            int64_t value = counter.Value ();
+            EXPECT_LE (last, value);
+            last = value;
+        }
+    });
+
+    for (int round = 0; round < 4; ++round) {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.push_back (std::thread ([&counter] () {
+                for (int j = 0; j < 10000; ++j) {
+                    counter.Increment ();
+                }
+            }));
+        }
+        for (auto& t : threads) {
+            t.join ();
+        }
+    }
+
+    done = true;
+    reader.join ();
+    EXPECT_EQ (4 * 4 * 10000, counter.Value ());
+}
+
+TEST_F (test_Metrics, DestroyedBeforeWriters)
+{
+    // the writers are still alive when the counter goes, and exit after it
+    for (int round = 0; round < 50; ++round) {
+        swift::Counter* counter = new swift::Counter ();
+        std::atomic<int> written (0);
+        std::atomic<bool> destroyed (false);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.push_back (std::thread ([counter, &written, &destroyed] () {
+                counter->Increment ();
+                ++written;
+                while (!destroyed.load ()) {
+                    std::this_thread::yield ();
+                }
+            }));
+        }
+        while (written.load () < 4) {
+            std::this_thread::yield ();
+        }
+        EXPECT_EQ (4, counter->Value ());
+        delete counter;
+        destroyed = true;
+        for (auto& t : threads) {
+            t.join ();
+        }
+    }
+}
+
+TEST_F (test_Metrics, Gauge)
+{
+    swift::Gauge gauge;
+    gauge.Add (5);
+    gauge.Sub (2);
+    EXPECT_EQ (3, gauge.Value ());
+
+    std::thread t ([&gauge] () {
+        gauge.Add (10);
+    });
+    t.join ();
+    EXPECT_EQ (13, gauge.Value ());
+
+    gauge.Set (100);
+    EXPECT_EQ (100, gauge.Value ());
+    gauge.Sub (1);
+    EXPECT_EQ (99, gauge.Value ());
+    gauge.Set (-1);
+    EXPECT_EQ (-1, gauge.Value ());
+}
+
+TEST_F (test_Metrics, Histogram)
+{
+    swift::Histogram histogram;
+    swift::Histogram::Snapshot empty = histogram.GetSnapshot ();
+    EXPECT_EQ (0u, empty.count);
+    EXPECT_EQ (0u, empty.Percentile (50));
+    EXPECT_EQ (0.0, empty.Average ());
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.push_back (std::thread ([&histogram] () {
+            for (uint64_t v = 1; v <= 1000; ++v) {
+                histogram.Record (v);
+            }
+        }));
+    }
+    for (auto& t : threads) {
+        t.join ();
+    }
+    histogram.Record (0);
+
+    swift::Histogram::Snapshot snapshot = histogram.GetSnapshot ();
+    EXPECT_EQ (4001u, snapshot.count);
+    EXPECT_EQ (4u * 500500u, snapshot.sum);
+    EXPECT_EQ (1u, snapshot.buckets[0]);
+    EXPECT_EQ (4u, snapshot.buckets[1]);
+    EXPECT_EQ (4u * 489u, snapshot.buckets[10]);
+    EXPECT_EQ (511u, snapshot.Percentile (50));
+    EXPECT_EQ (1023u, snapshot.Percentile (99));
+    EXPECT_EQ (0u, snapshot.Percentile (0));
+    EXPECT_NEAR (500.375, snapshot.Average (), 0.01);
+}
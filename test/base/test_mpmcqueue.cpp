@@ -0,0 +1,179 @@
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <iostream>
+#include <iterator>
+#include <sys/time.h>
+#include <gtest/gtest.h>
+#include <swift/base/mpmcqueue.h>
+#include <swift/base/blockingqueue.h>
+
+class test_MPMCQueue : public testing::Test
+{
+public:
+    test_MPMCQueue () {}
+    ~test_MPMCQueue () {}
+
+    virtual void SetUp (void)
+    {
+
+    }
+
+    virtual void TearDown (void)
+    {
+
+    }
+};
+
+TEST_F (test_MPMCQueue, Single)
+{
+    swift::MPMCQueue<std::string> q (3);
+    ASSERT_EQ (q.Capacity (), 4);
+    ASSERT_TRUE (q.IsEmpty ());
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE (q.TryPut (std::to_string (i)));
+    }
+    ASSERT_FALSE (q.TryPut ("full"));
+    ASSERT_FALSE (q.PutFor ("full", std::chrono::milliseconds (1)));
+    ASSERT_EQ (q.Size (), 4);
+
+    std::string s;
+    ASSERT_TRUE (q.TryTake (s));
+    ASSERT_EQ (s, "0");
+    ASSERT_EQ (q.Take (), "1");
+    ASSERT_TRUE (q.TakeFor (s, std::chrono::milliseconds (1)));
+    ASSERT_EQ (s, "2");
+    ASSERT_TRUE (q.TryTake (s));
+    ASSERT_FALSE (q.TryTake (s));
+    ASSERT_FALSE (q.TakeFor (s, std::chrono::milliseconds (1)));
+
+    // left over values are destroyed with the queue
+    std::shared_ptr<int> p (new int (1));
+    {
+        swift::MPMCQueue<std::shared_ptr<int> > sq (4);
+        sq.Put (p);
+        sq.Put (p);
+        ASSERT_EQ (p.use_count (), 3);
+    }
+    ASSERT_EQ (p.use_count (), 1);
+}
+
+TEST_F (test_MPMCQueue, Batch)
+{
+    swift::MPMCQueue<int> q (8);
+    std::vector<int> in;
+    for (int i = 0; i < 10; ++i) {
+        in.push_back (i);
+    }
+
+    ASSERT_EQ (q.TryPutN (in.begin (), in.size ()), 8);
+    std::vector<int> out;
+    ASSERT_EQ (q.TryTakeN (std::back_inserter (out), 5), 5);
+    ASSERT_EQ (q.TakeN (std::back_inserter (out), 10), 3);
+    ASSERT_EQ (q.TryTakeN (std::back_inserter (out), 10), 0);
+    for (int i = 0; i < 8; ++i) {
+        ASSERT_EQ (out[i], i);
+    }
+
+    // wraps around the ring
+    q.PutN (in.begin (), 6);
+    out.clear ();
+    ASSERT_EQ (q.TakeN (std::back_inserter (out), 6), 6);
+    ASSERT_EQ (out[5], 5);
+}
+
+TEST_F (test_MPMCQueue, MultiThread)
+{
+    const int kThreads = 4;
+    const int kCount = 20000;
+    swift::MPMCQueue<int> q (64);
+    std::atomic<long> sum (0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.push_back (std::thread ([&q]() {
+            for (int i = 1; i <= kCount; ++i) {
+                q.Put (i);
+            }
+        }));
+        threads.push_back (std::thread ([&q, &sum]() {
+            int buf[16];
+            int taken = 0;
+            while (taken < kCount) {
+                size_t n = q.TakeN (buf, std::min (16, kCount - taken));
+                for (size_t i = 0; i < n; ++i) {
+                    sum += buf[i];
+                }
+                taken += static_cast<int>(n);
+            }
+        }));
+    }
+
+    for (auto& t : threads) {
+        t.join ();
+    }
+
+    ASSERT_TRUE (q.IsEmpty ());
+    ASSERT_EQ (sum, static_cast<long>(kThreads) * kCount * (kCount + 1) / 2);
+}
+
+namespace {
+
+template <typename Queue>
+double Benchmark (Queue& q, int threads, int count)
+{
+    int pairs = threads / 2;
+    timeval t1, t2;
+    gettimeofday (&t1, NULL);
+
+    std::vector<std::thread> workers;
+    if (1 == threads) {
+        // uncontended put + take
+        pairs = 1;
+        workers.push_back (std::thread ([&q, count]() {
+            for (int i = 0; i < count; ++i) {
+                q.Put (i);
+                q.Take ();
+            }
+        }));
+    }
+
+    for (int t = 0; t < pairs && threads > 1; ++t) {
+        workers.push_back (std::thread ([&q, count]() {
+            for (int i = 0; i < count; ++i) {
+                q.Put (i);
+            }
+        }));
+        workers.push_back (std::thread ([&q, count]() {
+            for (int i = 0; i < count; ++i) {
+                q.Take ();
+            }
+        }));
+    }
+
+    for (auto& t : workers) {
+        t.join ();
+    }
+
+    gettimeofday (&t2, NULL);
+    double cost = (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec) / 1000000.0;
+    return pairs * count / cost;
+}
+
+} // namespace
+
+TEST_F (test_MPMCQueue, Benchmark)
+{
+    const int kTotal = 200000;
+    for (int threads = 1; threads <= 32; threads *= 2) {
+        int count = kTotal / (threads > 1 ? threads / 2 : 1);
+        swift::MPMCQueue<int> mpmc (1024);
+        swift::BlockingQueue<int> blocking;
+        double mpmc_qps = Benchmark (mpmc, threads, count);
+        double blocking_qps = Benchmark (blocking, threads, count);
+        std::cout << "threads[" << threads << "] MPMCQueue qps:" << mpmc_qps
+                  << " BlockingQueue qps:" << blocking_qps << std::endl;
+    }
+}
@@ -0,0 +1,134 @@
+#include <vector>
+#include <atomic>
+#include <numeric>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <algorithm>
+#include <gtest/gtest.h>
+
+#include <swift/base/parallel.h>
+
+class test_Parallel : public testing::Test
+{
+public:
+    test_Parallel () : pool_ (4) {}
+    ~test_Parallel () {}
+
+    virtual void SetUp (void)
+    {
+        pool_.Start ();
+    }
+
+    virtual void TearDown (void)
+    {
+        pool_.Join ();
+    }
+
+protected:
+    swift::ThreadPool pool_;
+};
+
+TEST_F (test_Parallel, For)
+{
+    std::vector<int> v (100000, 0);
+    swift::ParallelFor (pool_, size_t (0), v.size (), [&v] (size_t i) {
+        v[i] = static_cast<int>(i);
+    });
+    for (size_t i = 0; i < v.size (); ++i) {
+        ASSERT_EQ (v[i], static_cast<int>(i));
+    }
+
+    std::atomic<int> count (0);
+    swift::ParallelForRange (pool_, 10, 10, [&count] (int b, int e) { count += e - b; });
+    swift::ParallelForRange (pool_, 0, 1000, [&count] (int b, int e) {
+        ASSERT_TRUE (e - b <= 7);
+        count += e - b;
+    }, 7);
+    ASSERT_EQ (count, 1000);
+}
+
+TEST_F (test_Parallel, Nested)
+{
+    // every outer piece waits on an inner loop from inside a worker
+    std::atomic<int> count (0);
+    swift::ParallelFor (pool_, 0, 64, [this, &count] (int) {
+        swift::ParallelFor (pool_, 0, 100, [&count] (int) { ++count; }, 1);
+    }, 1);
+    ASSERT_EQ (count, 6400);
+}
+
+TEST_F (test_Parallel, Reduce)
+{
+    std::vector<uint64_t> v (100001);
+    std::iota (v.begin (), v.end (), 0);
+    uint64_t sum = swift::ParallelReduce (pool_, v.begin (), v.end (), uint64_t (0),
+        [] (std::vector<uint64_t>::iterator b, std::vector<uint64_t>::iterator e) {
+            return std::accumulate (b, e, uint64_t (0));
+        },
+        [] (uint64_t a, uint64_t b) { return a + b; });
+    ASSERT_EQ (sum, uint64_t (100000) * 100001 / 2);
+
+    // folded in order, so non commutative operations work
+    std::string s = swift::ParallelReduce (pool_, 0, 26, std::string (),
+        [] (int b, int e) {
+            std::string r;
+            for (int i = b; i < e; ++i) r += static_cast<char>('a' + i);
+            return r;
+        },
+        [] (const std::string& a, const std::string& b) { return a + b; }, 3);
+    ASSERT_EQ (s, "abcdefghijklmnopqrstuvwxyz");
+}
+
+TEST_F (test_Parallel, Transform)
+{
+    std::vector<int> in (50000);
+    std::iota (in.begin (), in.end (), 0);
+    std::vector<int> out (in.size ());
+    auto end = swift::ParallelTransform (pool_, in.begin (), in.end (), out.begin (),
+                                         [] (int x) { return x * 2; });
+    ASSERT_TRUE (end == out.end ());
+    for (size_t i = 0; i < in.size (); ++i) {
+        ASSERT_EQ (out[i], in[i] * 2);
+    }
+}
+
+TEST_F (test_Parallel, Sort)
+{
+    std::vector<uint32_t> v (200000);
+    std::mt19937 rng (42);
+    for (auto& x : v) {
+        x = rng ();
+    }
+    std::vector<uint32_t> expect (v);
+    std::sort (expect.begin (), expect.end ());
+
+    swift::ParallelSort (pool_, v.begin (), v.end ());
+    ASSERT_TRUE (v == expect);
+
+    swift::ParallelSort (pool_, v.begin (), v.end (), std::greater<uint32_t> (), 1000);
+    ASSERT_TRUE (std::is_sorted (v.begin (), v.end (), std::greater<uint32_t> ()));
+}
+
+TEST_F (test_Parallel, Exception)
+{
+    ASSERT_THROW (swift::ParallelFor (pool_, 0, 1000, [] (int i) {
+        if (500 == i) {
+            throw std::runtime_error ("failed");
+        }
+    }, 10), std::runtime_error);
+}
+
+TEST_F (test_Parallel, GroupLifetime)
+{
+    // the group goes away as soon as Wait () returns, while the worker that
+    // finished the last task may still be leaving Done ()
+    std::atomic<int> count (0);
+    for (int i = 0; i < 20000; ++i) {
+        std::unique_ptr<swift::TaskGroup> group (new swift::TaskGroup (pool_));
+        group->Run ([&count] () { ++count; });
+        group->Run ([&count] () { ++count; });
+        group->Wait ();
+    }
+    ASSERT_EQ (count, 40000);
+}
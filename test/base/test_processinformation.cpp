@@ -39,6 +39,11 @@ TEST_F (test_ProcessInformation, All)
     std::cout << "MaxOpenFiles:\t" << pf.GetMaxOpenFiles () << std::endl;
     std::cout << "Architecture:\t" << pf.GetArchitecture () << std::endl;
     std::cout << "NumaEnabled:\t" << pf.HasNumaEnabled () << std::endl;
+    ASSERT_TRUE (pf.GetNumberOfNumaNodes () > 0);
+    for (unsigned int node = 0; node < pf.GetNumberOfNumaNodes (); ++node) {
+        ASSERT_FALSE (pf.GetNumaNodeCpus (node).empty ());
+        std::cout << "NumaNode" << node << "Cpus:\t" << pf.GetNumaNodeCpus (node).size () << std::endl;
+    }
     std::cout << "LibcVersion:\t" << pf.GetLibcVersion () << std::endl;
     std::cout << "KernelVersion:\t" << pf.GetKernelVersion () << std::endl;
     std::cout << "CpuFrequncy:\t" << pf.GetCpuFrequncy () << std::endl;
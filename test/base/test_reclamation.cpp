@@ -0,0 +1,317 @@
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <swift/base/reclamation.h>
+
+namespace {
+
+std::atomic<int64_t> kLiveNodes (0);
+
+struct Node
+{
+    explicit Node (int64_t v) : value (v), magic (kMagic) { ++kLiveNodes; }
+    ~Node ()
+    {
+        magic = 0;
+        --kLiveNodes;
+    }
+
+    static const int64_t kMagic = 0x5a5a5a5a;
+    int64_t value;
+    int64_t magic;
+};
+
+const int64_t Node::kMagic;
+
+class test_Reclamation : public testing::Test
+{
+public:
+    test_Reclamation () {}
+    ~test_Reclamation () {}
+
+    virtual void SetUp (void)
+    {
+        kLiveNodes = 0;
+    }
+
+    virtual void TearDown (void)
+    {
+    }
+};
+} // anonymous namespace
+
+TEST_F (test_Reclamation, HazardPointerProtect)
+{
+    {
+        swift::HazardPointerDomain domain (1);
+        std::atomic<Node*> head (new Node (1));
+
+        swift::HazardPointerDomain::Holder holder (domain);
+        Node* node = holder.Protect (head);
+        EXPECT_EQ (1, node->value);
+
+        // retired but protected, so it survives every reclaim
+        head.store (new Node (2));
+        domain.Retire (node);
+        EXPECT_EQ (0u, domain.Reclaim ());
+        EXPECT_EQ (Node::kMagic, node->magic);
+        EXPECT_EQ (2, kLiveNodes.load ());
+
+        holder.Reset ();
+        EXPECT_EQ (1u, domain.Reclaim ());
+        EXPECT_EQ (1, kLiveNodes.load ());
+
+        // a node retired by an exited thread while protected here is left to
+        // the domain
+        node = holder.Protect (head);
+        std::thread t ([&domain, &head] () {
+            domain.Retire (head.exchange (new Node (3)));
+        });
+        t.join ();
+        EXPECT_EQ (0u, domain.Reclaim ());
+        EXPECT_EQ (2, kLiveNodes.load ());
+        holder.Reset ();
+        EXPECT_EQ (1u, domain.Reclaim ());
+        EXPECT_EQ (1, kLiveNodes.load ());
+
+        domain.Retire (head.exchange (nullptr));
+    }
+
+    // the domain frees what is left
+    EXPECT_EQ (0, kLiveNodes.load ());
+}
+
+TEST_F (test_Reclamation, EpochGuard)
+{
+    {
+        swift::EpochDomain domain (1);
+        std::atomic<Node*> head (new Node (1));
+
+        Node* node = nullptr;
+        std::atomic<bool> entered (false);
+        std::atomic<bool> leave (false);
+        std::thread reader ([&] () {
+            swift::EpochDomain::Guard guard (domain);
+            node = head.load ();
+            entered = true;
+            while (!leave.load ()) {
+                std::this_thread::yield ();
+            }
+            EXPECT_EQ (Node::kMagic, node->magic);
+        });
+        while (!entered.load ()) {
+            std::this_thread::yield ();
+        }
+
+        domain.Retire (head.exchange (new Node (2)));
+        for (int i = 0; i < 10; ++i) {
+            domain.Reclaim ();
+        }
+        // the reader pins the epoch
+        EXPECT_EQ (2, kLiveNodes.load ());
+
+        leave = true;
+        reader.join ();
+        domain.Reclaim ();
+        domain.Reclaim ();
+        EXPECT_EQ (1, kLiveNodes.load ());
+
+        {
+            // nested guards
+            swift::EpochDomain::Guard outer (domain);
+            swift::EpochDomain::Guard inner (domain);
+            EXPECT_EQ (2, head.load ()->value);
+        }
+        domain.Retire (head.exchange (nullptr));
+    }
+
+    EXPECT_EQ (0, kLiveNodes.load ());
+}
+
+namespace {
+
+std::atomic<int> kOrphansFreed (0);
+
+void DeleteOrphan (void* ptr)
+{
+    delete static_cast<Node*>(ptr);
+    ++kOrphansFreed;
+}
+
+// Short lived threads retire less than a batch each and exit, the batches of
+// one long lived thread must free what they left.
+template <typename Domain>
+void Churn (Domain& domain, size_t threshold)
+{
+    const int kThreads = 64;
+    kOrphansFreed = 0;
+    for (int i = 0; i < kThreads; ++i) {
+        std::thread t ([&domain] () {
+            domain.Retire (new Node (0), &DeleteOrphan);
+        });
+        t.join ();
+    }
+    EXPECT_EQ (0, kOrphansFreed.load ());
+
+    for (size_t i = 0; i < 3 * threshold; ++i) {
+        domain.Retire (new Node (1));
+    }
+    EXPECT_EQ (kThreads, kOrphansFreed.load ());
+}
+} // anonymous namespace
+
+TEST_F (test_Reclamation, HazardPointerThreadChurn)
+{
+    {
+        swift::HazardPointerDomain domain (4);
+        Churn (domain, 4);
+    }
+
+    EXPECT_EQ (0, kLiveNodes.load ());
+}
+
+TEST_F (test_Reclamation, EpochThreadChurn)
+{
+    {
+        swift::EpochDomain domain (4);
+        Churn (domain, 4);
+    }
+
+    EXPECT_EQ (0, kLiveNodes.load ());
+}
+
+namespace {
+
+// Readers follow a shared pointer while writers keep replacing and retiring
+// it, a reader must never see a freed node.
+template <typename Read, typename Replace>
+int64_t Stress (int readers, int writers, Read read, Replace replace)
+{
+    std::atomic<bool> stop (false);
+    std::atomic<int64_t> reads (0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < readers; ++i) {
+        // every reader runs its own copy of read
+        threads.push_back (std::thread ([&stop, &reads, read] () mutable {
+            int64_t n = 0;
+            while (!stop.load (std::memory_order_relaxed)) {
+                read ();
+                ++n;
+            }
+            reads += n;
+        }));
+    }
+    for (int i = 0; i < writers; ++i) {
+        threads.push_back (std::thread ([&stop, replace, i] () {
+            for (int64_t v = 0; !stop.load (std::memory_order_relaxed); ++v) {
+                replace (v);
+                if (0 != i) {
+                    std::this_thread::yield ();
+                }
+            }
+        }));
+    }
+
+    std::this_thread::sleep_for (std::chrono::milliseconds (200));
+    stop = true;
+    for (auto& t : threads) {
+        t.join ();
+    }
+
+    return reads.load ();
+}
+} // anonymous namespace
+
+TEST_F (test_Reclamation, HazardPointerStress)
+{
+    {
+        swift::HazardPointerDomain domain;
+        std::atomic<Node*> head (new Node (0));
+        Stress (4, 2, [&domain, &head] () {
+            swift::HazardPointerDomain::Holder holder (domain);
+            Node* node = holder.Protect (head);
+            ASSERT_EQ (Node::kMagic, node->magic);
+        }, [&domain, &head] (int64_t v) {
+            domain.Retire (head.exchange (new Node (v)));
+        });
+        domain.Retire (head.exchange (nullptr));
+    }
+
+    EXPECT_EQ (0, kLiveNodes.load ());
+}
+
+TEST_F (test_Reclamation, EpochStress)
+{
+    {
+        swift::EpochDomain domain;
+        std::atomic<Node*> head (new Node (0));
+        Stress (4, 2, [&domain, &head] () {
+            swift::EpochDomain::Guard guard (domain);
+            Node* node = head.load (std::memory_order_acquire);
+            ASSERT_EQ (Node::kMagic, node->magic);
+        }, [&domain, &head] (int64_t v) {
+            domain.Retire (head.exchange (new Node (v)));
+        });
+        domain.Retire (head.exchange (nullptr));
+    }
+
+    EXPECT_EQ (0, kLiveNodes.load ());
+}
+
+// Read throughput of 1 .. N readers dereferencing a pointer that a writer
+// replaces every 100us, with std::shared_ptr atomics, hazard pointers and
+// epochs.
+TEST_F (test_Reclamation, Benchmark)
+{
+    int max_threads = std::max (4u, std::thread::hardware_concurrency ());
+    printf ("%8s %20s %20s %20s\n", "readers", "shared_ptr atomic", "hazard pointer", "epoch");
+    for (int readers = 1; readers <= max_threads; readers *= 2) {
+        auto writer = [] () {
+            std::this_thread::sleep_for (std::chrono::microseconds (100));
+        };
+
+        std::shared_ptr<Node> shared (new Node (0));
+        int64_t shared_reads = Stress (readers, 1, [&shared] () {
+            std::shared_ptr<Node> node = std::atomic_load (&shared);
+            ASSERT_EQ (Node::kMagic, node->magic);
+        }, [&shared, &writer] (int64_t v) {
+            std::atomic_store (&shared, std::shared_ptr<Node> (new Node (v)));
+            writer ();
+        });
+
+        swift::HazardPointerDomain hazard;
+        std::atomic<Node*> hazard_head (new Node (0));
+        std::shared_ptr<swift::HazardPointerDomain::Holder> holder;
+        int64_t hazard_reads = Stress (readers, 1, [&hazard, &hazard_head, holder] () mutable {
+            if (!holder) {
+                holder.reset (new swift::HazardPointerDomain::Holder (hazard));
+            }
+            Node* node = holder->Protect (hazard_head);
+            ASSERT_EQ (Node::kMagic, node->magic);
+            holder->Reset ();
+        }, [&hazard, &hazard_head, &writer] (int64_t v) {
+            hazard.Retire (hazard_head.exchange (new Node (v)));
+            writer ();
+        });
+        hazard.Retire (hazard_head.exchange (nullptr));
+
+        swift::EpochDomain epoch;
+        std::atomic<Node*> epoch_head (new Node (0));
+        int64_t epoch_reads = Stress (readers, 1, [&epoch, &epoch_head] () {
+            swift::EpochDomain::Guard guard (epoch);
+            Node* node = epoch_head.load (std::memory_order_acquire);
+            ASSERT_EQ (Node::kMagic, node->magic);
+        }, [&epoch, &epoch_head, &writer] (int64_t v) {
+            epoch.Retire (epoch_head.exchange (new Node (v)));
+            writer ();
+        });
+        epoch.Retire (epoch_head.exchange (nullptr));
+
+        printf ("%8d %20.0f %20.0f %20.0f\n", readers,
+                shared_reads / 0.2, hazard_reads / 0.2, epoch_reads / 0.2);
+    }
+}
@@ -1,8 +1,11 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <thread>
+#include <chrono>
+#include <cstdio>
 #include <gtest/gtest.h>
 #include <swift/base/rwspinlock.h>
+#include <swift/base/distributedrwlock.h>
 
 namespace {
 
@@ -96,7 +99,7 @@ using namespace swift;
 const static int kMaxReaders = 50;
 static std::atomic<bool> kStopThread;
 
-typedef testing::Types<RWSpinLock
+typedef testing::Types<RWSpinLock, DistributedRWLock
 #ifdef RW_SPINLOCK_USE_X86_INTRINSIC_
     , RWTicketSpinLockT<32, true>,
     RWTicketSpinLockT<32, false>,
@@ -196,6 +199,66 @@ TYPED_TEST (test_RWSpinLock, ConcurrentTests)
     }
 }
 
+// Read throughput of 1 .. N threads taking the read lock in a loop, with an
+// occasional writer. RWSpinLock readers all update one word, the distributed
+// lock should scale with the number of cores.
+template <typename RWSpinLockType>
+static double ReadThroughput (int readers, int64_t* shared)
+{
+    RWSpinLockType lock;
+    std::atomic<bool> stop (false);
+    std::atomic<int64_t> total (0);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < readers; ++i) {
+        threads.push_back (std::thread ([&lock, &stop, &total, shared] () {
+            int64_t reads = 0;
+            int64_t sum = 0;
+            while (!stop.load (std::memory_order_relaxed)) {
+                typename RWSpinLockType::ReadHolder guard (&lock);
+                sum += *shared;
+                ++reads;
+            }
+            EXPECT_LE (0, sum);
+            total += reads;
+        }));
+    }
+    std::thread writer ([&lock, &stop, shared] () {
+        while (!stop.load (std::memory_order_relaxed)) {
+            {
+                typename RWSpinLockType::WriteHolder guard (&lock);
+                ++*shared;
+            }
+            std::this_thread::sleep_for (std::chrono::milliseconds (10));
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now ();
+    std::this_thread::sleep_for (std::chrono::milliseconds (200));
+    stop.store (true);
+    for (auto& t : threads) {
+        t.join ();
+    }
+    writer.join ();
+    double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+
+    return total.load () / seconds;
+}
+
+TEST (test_RWSpinLock, ReadScaling)
+{
+    int max_threads = std::max (4u, std::thread::hardware_concurrency ());
+    int64_t shared = 0;
+    printf ("%8s %20s %20s %20s\n", "readers", "RWSpinLock", "RWTicketSpinLock64", "DistributedRWLock");
+    for (int readers = 1; readers <= max_threads; readers *= 2) {
+        printf ("%8d %20.0f %20.0f %20.0f\n",
+                readers,
+                ReadThroughput<RWSpinLock> (readers, &shared),
+                ReadThroughput<RWTicketSpinLock64> (readers, &shared),
+                ReadThroughput<DistributedRWLock> (readers, &shared));
+    }
+}
+
 TEST (test_RWSpinLock, concurrent_holder_test) {
     srand (time (nullptr));
 
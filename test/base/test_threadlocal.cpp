@@ -2,6 +2,9 @@
 #include <iostream>
 #include <string>
 #include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
 #include <condition_variable>
 #include <swift/base/threadlocal.h>
 #include <swift/base/thisthread.h>
@@ -477,6 +480,159 @@ TEST(test_ThreadLocal, Scrape)
     }
 }
 
+namespace {
+std::atomic<int> scrape_unrefs (0);
+void ScrapeUnref (void* ptr)
+{
+    delete static_cast<int*>(ptr);
+    ++scrape_unrefs;
+}
+} // anonymous namespace
+
+TEST(test_ThreadLocal, ConcurrentScrape)
+{
+    // Workers keep swapping fresh values in and exit, while the main thread
+    // scrapes them out: every value is freed exactly once, either by the
+    // scraper or by the handler of the exiting thread or of the instance.
+    scrape_unrefs = 0;
+    std::atomic<int> scraped (0);
+    const int kThreads = 8;
+    const int kRounds = 4;
+    const int kValues = 2000;
+    {
+        swift::ThreadLocalPtr tls (ScrapeUnref);
+        std::atomic<bool> done (false);
+        std::thread scraper ([&tls, &done, &scraped] () {
+            while (!done.load ()) {
+                std::vector<void*> ptrs;
+                tls.Scrape (&ptrs, nullptr);
+                for (auto ptr : ptrs) {
+                    delete static_cast<int*>(ptr);
+                }
+                scraped += static_cast<int>(ptrs.size ());
+            }
+        });
+
+        for (int round = 0; round < kRounds; ++round) {
+            std::vector<std::thread> threads;
+            for (int t = 0; t < kThreads; ++t) {
+                threads.push_back (std::thread ([&tls] () {
+                    for (int i = 0; i < kValues; ++i) {
+                        void* old = tls.Swap (new int (i));
+                        if (nullptr != old) {
+                            ScrapeUnref (old);
+                        }
+                    }
+                }));
+            }
+            for (auto& t : threads) {
+                t.join ();
+            }
+        }
+
+        done = true;
+        scraper.join ();
+    }
+
+    EXPECT_EQ (kThreads * kRounds * kValues, scraped.load () + scrape_unrefs.load ());
+}
+
+namespace {
+void FoldSum (void* ptr, void* res)
+{
+    *static_cast<int64_t*>(res) += static_cast<std::atomic<int64_t>*>(ptr)->load ();
+}
+} // anonymous namespace
+
+TEST(test_ThreadLocal, Fold)
+{
+    // Writers keep counting in their own cells while the main thread folds
+    // them: the values stay in place and the sum never goes back.
+    const int kThreads = 4;
+    const int64_t kCount = 200000;
+    swift::ThreadLocalPtr tls;
+    std::vector<std::atomic<int64_t>*> cells;
+    for (int t = 0; t < kThreads; ++t) {
+        cells.push_back (new std::atomic<int64_t> (0));
+    }
+
+    std::atomic<int> started (0);
+    std::atomic<bool> stop (false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.push_back (std::thread ([&tls, &cells, &started, &stop, t] () {
+            tls.Reset (cells[t]);
+            ++started;
+            for (int64_t i = 0; i < kCount; ++i) {
+                cells[t]->fetch_add (1, std::memory_order_relaxed);
+            }
+            // stay alive until the last fold
+            while (!stop.load ()) {
+                std::this_thread::yield ();
+            }
+            EXPECT_EQ (cells[t], tls.Get ());
+        }));
+    }
+    while (started.load () < kThreads) {
+        std::this_thread::yield ();
+    }
+
+    int64_t last = 0;
+    while (last < kThreads * kCount) {
+        int64_t sum = 0;
+        EXPECT_TRUE (tls.Fold (FoldSum, &sum));
+        ASSERT_LE (last, sum);
+        last = sum;
+    }
+    EXPECT_EQ (kThreads * kCount, last);
+
+    stop = true;
+    for (auto& t : threads) {
+        t.join ();
+    }
+    for (auto cell : cells) {
+        delete cell;
+    }
+}
+
+namespace {
+std::atomic<bool> unref_entered (false);
+std::atomic<bool> reclaimed (false);
+std::atomic<int> late_unrefs (0);
+void SlowUnref (void* ptr)
+{
+    unref_entered = true;
+    std::this_thread::sleep_for (std::chrono::milliseconds (2));
+    if (reclaimed.load ()) {
+        ++late_unrefs;
+    }
+}
+} // anonymous namespace
+
+TEST(test_ThreadLocal, ReclaimWaitsForExitingThreads)
+{
+    // the destructor must not return while an exiting thread is still in
+    // the handler, which may use what the owner frees next
+    static int value = 0;
+    late_unrefs = 0;
+    for (int i = 0; i < 20; ++i) {
+        unref_entered = false;
+        reclaimed = false;
+        swift::ThreadLocalPtr* tls = new swift::ThreadLocalPtr (SlowUnref);
+        std::thread t ([tls] () {
+            tls->Reset (&value);
+        });
+        while (!unref_entered.load ()) {
+            std::this_thread::yield ();
+        }
+        delete tls;
+        reclaimed = true;
+        t.join ();
+    }
+
+    EXPECT_EQ (0, late_unrefs.load ());
+}
+
 class LocalData : swift::noncopyable
 {
 public:
@@ -1,9 +1,14 @@
 #include <chrono>
 #include <thread>
 #include <iostream>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <sched.h>
 #include <gtest/gtest.h>
 
 #include <swift/base/threadpool.h>
+#include <swift/base/processinformation.h>
 
 class test_ThreadPool : public testing::Test
 {
@@ -83,4 +88,85 @@ TEST_F (test_ThreadPool, All)
     ASSERT_TRUE (func_1 == nullptr);
 
     pool.Join ();
-}
\ No newline at end of file
+}
+
+namespace {
+
+// the cpus the calling thread may run on
+std::vector<int> CurrentCpus ()
+{
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO (&set);
+    if (0 == sched_getaffinity (0, sizeof(set), &set)) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET (cpu, &set)) {
+                cpus.push_back (cpu);
+            }
+        }
+    }
+    return cpus;
+}
+} // anonymous namespace
+
+TEST_F (test_ThreadPool, Affinity)
+{
+    swift::ProcessInformation info;
+    std::vector<int> all_cpus;
+    for (unsigned int i = 0; i < info.GetNumberOfNumaNodes (); ++i) {
+        const std::vector<int>& cpus = info.GetNumaNodeCpus (i);
+        all_cpus.insert (all_cpus.end (), cpus.begin (), cpus.end ());
+    }
+
+    std::atomic<int> count (0);
+    std::atomic<int> unpinned (0);
+    {
+        // every worker is pinned to exactly one cpu, and runs on it
+        swift::ThreadPool pool (4, swift::ThreadPool::AFFINITY_CORE);
+        pool.Start ();
+        ASSERT_EQ (pool.GetNodeCount (), 1);
+        for (int i = 0; i < 1000; ++i) {
+            pool.Schedule ([&count, &unpinned, &all_cpus]() {
+                std::vector<int> cpus = CurrentCpus ();
+                if (1 != cpus.size () || cpus[0] != sched_getcpu ()
+                    || std::find (all_cpus.begin (), all_cpus.end (), cpus[0]) == all_cpus.end ()) {
+                    ++unpinned;
+                }
+                ++count;
+            });
+        }
+        pool.Join ();
+    }
+    ASSERT_EQ (count, 1000);
+    ASSERT_EQ (unpinned, 0);
+
+    count = 0;
+    {
+        // every worker is pinned to the cpus of its node, whichever node's
+        // task it runs
+        swift::ThreadPool pool (4, swift::ThreadPool::AFFINITY_NUMA_NODE);
+        pool.Start ();
+        ASSERT_TRUE (pool.GetNodeCount () > 0);
+        ASSERT_TRUE (pool.GetCurrentNode () >= 0);
+        ASSERT_TRUE (pool.GetCurrentNode () < pool.GetNodeCount ());
+        auto task = [&count, &unpinned, &pool, &info]() {
+            std::vector<int> cpus = CurrentCpus ();
+            std::vector<int> node_cpus = info.GetNumaNodeCpus (pool.GetCurrentNode ());
+            std::sort (node_cpus.begin (), node_cpus.end ());
+            if (cpus != node_cpus
+                || std::find (cpus.begin (), cpus.end (), sched_getcpu ()) == cpus.end ()) {
+                ++unpinned;
+            }
+            ++count;
+        };
+        for (int i = 0; i < 1000; ++i) {
+            // every node gets work, idle nodes steal from the busy ones
+            pool.ScheduleOnNode (task, i);
+            pool.ScheduleOnNode (task, swift::ThreadPool::kAnyNode);
+        }
+        pool.Join ();
+        ASSERT_EQ (pool.TasksRemaining (), 0);
+    }
+    ASSERT_EQ (count, 2000);
+    ASSERT_EQ (unpinned, 0);
+}
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include <iostream>
+#include <swift/base/lru_cache.hpp>
+#include <swift/base/tinylfu_cache.hpp>
+
+class test_TinyLfuCache : public testing::Test
+{
+public:
+    test_TinyLfuCache() {}
+    ~test_TinyLfuCache() {}
+};
+
+TEST_F(test_TinyLfuCache, Sketch)
+{
+    swift::FrequencySketch sketch(64);
+    EXPECT_EQ(0, sketch.Frequency(1, 3));
+    for (int i = 0; i < 5; ++i) {
+        sketch.Increment(1, 3);
+    }
+    EXPECT_EQ(5, sketch.Frequency(1, 3));
+    for (int i = 0; i < 100; ++i) {
+        sketch.Increment(1, 3);
+    }
+    EXPECT_EQ(15, sketch.Frequency(1, 3));
+
+    // halved once 10 * width counters were added
+    for (uint64_t i = 0; i < 10 * 64; ++i) {
+        sketch.Increment(i * 2654435761u + 100, 7);
+    }
+    EXPECT_GE(8, sketch.Frequency(1, 3));
+}
+
+TEST_F(test_TinyLfuCache, GetSet)
+{
+    swift::TinyLfuCache<size_t, size_t> cache(3);
+    size_t value = 0;
+    EXPECT_FALSE(cache.Get(1, value));
+
+    cache.Set(1, 1);
+    ASSERT_TRUE(cache.Get(1, value));
+    EXPECT_EQ(1u, value);
+
+    cache.Set(1, 10);
+    ASSERT_TRUE(cache.Get(1, value));
+    EXPECT_EQ(10u, value);
+
+    for (size_t i = 2; i < 100; ++i) {
+        cache.Set(i, i);
+    }
+    EXPECT_EQ(3u, cache.Size());
+    // the frequently used key survives
+    ASSERT_TRUE(cache.Get(1, value));
+    EXPECT_EQ(10u, value);
+
+    swift::TinyLfuCache<size_t, size_t> tiny(1);
+    tiny.Set(1, 1);
+    tiny.Set(2, 2);
+    EXPECT_EQ(1u, tiny.Size());
+}
+
+namespace {
+
+// hot keys are read over and over, then a batch job scans many keys once,
+// then the hot keys are read again
+template<typename CacheType>
+double HotHitRateAfterScan(CacheType& cache)
+{
+    size_t value = 0;
+    for (int round = 0; round < 10; ++round) {
+        for (size_t key = 0; key < 800; ++key) {
+            if (!cache.Get(key, value)) {
+                cache.Set(key, key);
+            }
+        }
+    }
+
+    for (size_t key = 1000000; key < 1050000; ++key) {
+        if (!cache.Get(key, value)) {
+            cache.Set(key, key);
+        }
+    }
+
+    size_t hits = 0;
+    for (size_t key = 0; key < 800; ++key) {
+        if (cache.Get(key, value)) {
+            ++hits;
+        }
+    }
+    return hits / 800.0;
+}
+} // anonymous namespace
+
+TEST_F(test_TinyLfuCache, ScanResistance)
+{
+    swift::LruCache<size_t, size_t> lru_cache(1000);
+    swift::TinyLfuCache<size_t, size_t> tinylfu_cache(1000);
+    double lru = HotHitRateAfterScan(lru_cache);
+    double tinylfu = HotHitRateAfterScan(tinylfu_cache);
+    std::cout << "hot set hit rate after a scan: lru_cache " << lru
+              << " tinylfu_cache " << tinylfu << std::endl;
+
+    EXPECT_EQ(0.0, lru);
+    EXPECT_LT(0.95, tinylfu);
+}
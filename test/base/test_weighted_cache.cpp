@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <swift/base/weighted_cache.hpp>
+
+class test_WeightedCache : public testing::Test
+{
+public:
+    test_WeightedCache() {}
+    ~test_WeightedCache() {}
+};
+
+namespace {
+
+struct Recorder
+{
+    std::mutex mutex;
+    std::vector<std::pair<int, swift::EvictionReason> > evicted;
+
+    void operator()(const int& key, const std::string&, swift::EvictionReason reason)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        evicted.push_back(std::make_pair(key, reason));
+    }
+};
+} // anonymous namespace
+
+TEST_F(test_WeightedCache, Charge)
+{
+    Recorder recorder;
+    typedef swift::WeightedCache<int, std::string> CacheType;
+    CacheType cache(100, std::ref(recorder));
+
+    EXPECT_TRUE(cache.Set(1, "a", 40));
+    EXPECT_TRUE(cache.Set(2, "b", 40));
+    std::string value;
+    ASSERT_TRUE(cache.Get(1, value));
+    EXPECT_EQ("a", value);
+
+    // 2 is the least recently used, 50 more bytes need it gone
+    EXPECT_TRUE(cache.Set(3, "c", 50));
+    EXPECT_FALSE(cache.Get(2, value));
+    ASSERT_EQ(1u, recorder.evicted.size());
+    EXPECT_EQ(2, recorder.evicted[0].first);
+    EXPECT_EQ(swift::EVICTION_CAPACITY, recorder.evicted[0].second);
+
+    // too large for the whole cache
+    EXPECT_FALSE(cache.Set(4, "d", 101));
+
+    // replacing updates the charge
+    EXPECT_TRUE(cache.Set(1, "aa", 10));
+    EXPECT_EQ(swift::EVICTION_REPLACED, recorder.evicted.back().second);
+
+    CacheType::Stats stats = cache.GetStats();
+    EXPECT_EQ(2u, stats.entries);
+    EXPECT_EQ(60u, stats.bytes);
+    EXPECT_EQ(100u, stats.capacity);
+    EXPECT_EQ(1u, stats.hits);
+    EXPECT_EQ(1u, stats.misses);
+    EXPECT_EQ(1u, stats.evictions);
+
+    EXPECT_TRUE(cache.Erase(3));
+    EXPECT_FALSE(cache.Erase(3));
+    EXPECT_EQ(swift::EVICTION_ERASED, recorder.evicted.back().second);
+    cache.Clear();
+    EXPECT_EQ(0u, cache.GetStats().bytes);
+    EXPECT_EQ(0u, cache.GetStats().entries);
+}
+
+TEST_F(test_WeightedCache, OversizedUpdate)
+{
+    Recorder recorder;
+    typedef swift::WeightedCache<int, std::string> CacheType;
+    CacheType cache(100, std::ref(recorder));
+
+    EXPECT_TRUE(cache.Set(1, "a", 40));
+    EXPECT_TRUE(cache.Set(2, "b", 40));
+
+    // the new value does not fit, the old one must not be served instead
+    EXPECT_FALSE(cache.Set(1, "aa", 101));
+    std::string value;
+    EXPECT_FALSE(cache.Get(1, value));
+    ASSERT_EQ(1u, recorder.evicted.size());
+    EXPECT_EQ(1, recorder.evicted[0].first);
+    EXPECT_EQ(swift::EVICTION_REPLACED, recorder.evicted[0].second);
+
+    CacheType::Stats stats = cache.GetStats();
+    EXPECT_EQ(1u, stats.entries);
+    EXPECT_EQ(40u, stats.bytes);
+    ASSERT_TRUE(cache.Get(2, value));
+    EXPECT_EQ("b", value);
+}
+
+TEST_F(test_WeightedCache, Ttl)
+{
+    Recorder recorder;
+    swift::WeightedCache<int, std::string> cache(100, std::ref(recorder));
+
+    cache.Set(1, "short", 10, std::chrono::milliseconds(20));
+    cache.Set(2, "forever", 10);
+    std::string value;
+    EXPECT_TRUE(cache.Get(1, value));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    // lazy expiry on Get
+    EXPECT_FALSE(cache.Get(1, value));
+    EXPECT_TRUE(cache.Get(2, value));
+    ASSERT_EQ(1u, recorder.evicted.size());
+    EXPECT_EQ(swift::EVICTION_EXPIRED, recorder.evicted[0].second);
+
+    // expired entries are dropped before live ones to make room
+    cache.Set(3, "short", 40, std::chrono::milliseconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    cache.Set(4, "big", 80);
+    EXPECT_FALSE(cache.Get(3, value));
+    EXPECT_EQ(0u, cache.GetStats().evictions);
+    EXPECT_EQ(2u, cache.GetStats().expirations);
+    EXPECT_EQ(0u, cache.Expire());
+}
+
+TEST_F(test_WeightedCache, Sweeper)
+{
+    Recorder recorder;
+    swift::WeightedCache<int, std::string> cache(1000, std::ref(recorder));
+    for (int i = 0; i < 10; ++i) {
+        cache.Set(i, "v", 10, std::chrono::milliseconds(10));
+    }
+    cache.StartSweeper(std::chrono::milliseconds(5));
+
+    for (int i = 0; i < 200 && cache.GetStats().entries > 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    cache.StopSweeper();
+
+    EXPECT_EQ(0u, cache.GetStats().entries);
+    EXPECT_EQ(0u, cache.GetStats().bytes);
+    EXPECT_EQ(10u, cache.GetStats().expirations);
+    EXPECT_EQ(10u, recorder.evicted.size());
+}
@@ -0,0 +1,60 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thread>
+#include <memory>
+#include <gtest/gtest.h>
+#include <swift/net/httpclient/asynchttpclient.h>
+
+class test_AsyncHttpClient : public testing::Test
+{
+public:
+    test_AsyncHttpClient () : io_pool_ (2) {}
+    ~test_AsyncHttpClient () {}
+
+    virtual void SetUp (void)
+    {
+        io_pool_.Start ();
+    }
+
+    virtual void TearDown (void)
+    {
+        io_pool_.Join ();
+    }
+
+protected:
+    swift::ThreadPool io_pool_;
+};
+
+TEST_F (test_AsyncHttpClient, Get)
+{
+    // nothing listens on port 1: the request fails fast, still on io_pool_
+    swift::Request req;
+    req.SetUrl (std::string ("http://127.0.0.1:1/"));
+    swift::HttpClient client;
+    swift::AsyncHttpClient http (client, io_pool_);
+
+    std::thread::id caller = std::this_thread::get_id ();
+    std::thread::id worker;
+    std::shared_ptr<swift::Response> resp = swift::SyncWait (
+        [] (swift::AsyncHttpClient& http, const swift::Request* req,
+            std::thread::id& worker) -> swift::Task<std::shared_ptr<swift::Response> > {
+        std::shared_ptr<swift::Response> resp = co_await http.Get (req);
+        worker = std::this_thread::get_id ();
+        co_return resp;
+    } (http, &req, worker));
+
+    ASSERT_TRUE (nullptr != resp.get ());
+    ASSERT_NE (caller, worker);
+}
@@ -0,0 +1,157 @@
+#include <gtest/gtest.h>
+#include <swift/base/coroutine.h>
+
+// built by test/coroutine/CMakeLists.txt only when -std=c++20 is supported
+#ifndef SWIFT_HAS_COROUTINE
+#error "the coroutine tests need a compiler with C++20 coroutines"
+#endif
+
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <string>
+#include <stdexcept>
+
+class test_Coroutine : public testing::Test
+{
+public:
+    test_Coroutine () : pool_ (2) {}
+    ~test_Coroutine () {}
+
+    virtual void SetUp (void)
+    {
+        pool_.Start ();
+    }
+
+    virtual void TearDown (void)
+    {
+        pool_.Join ();
+    }
+
+protected:
+    swift::ThreadPool pool_;
+};
+
+namespace {
+
+swift::Task<int> Square (swift::ThreadPool& pool, int x)
+{
+    co_await swift::ScheduleOn (pool);
+    co_return x * x;
+}
+
+swift::Task<int> SumOfSquares (swift::ThreadPool& pool, int n)
+{
+    int sum = 0;
+    for (int i = 1; i <= n; ++i) {
+        sum += co_await Square (pool, i);
+    }
+    co_return sum;
+}
+
+swift::Task<void> Fail ()
+{
+    throw std::runtime_error ("failed");
+    co_return;
+}
+
+} // namespace
+
+TEST_F (test_Coroutine, Task)
+{
+    ASSERT_EQ (swift::SyncWait (SumOfSquares (pool_, 10)), 385);
+    ASSERT_THROW (swift::SyncWait (Fail ()), std::runtime_error);
+
+    std::thread::id caller = std::this_thread::get_id ();
+    std::thread::id worker = swift::SyncWait ([] (swift::ThreadPool& pool) -> swift::Task<std::thread::id> {
+        co_await swift::ScheduleOn (pool);
+        co_return std::this_thread::get_id ();
+    } (pool_));
+    ASSERT_NE (caller, worker);
+}
+
+TEST_F (test_Coroutine, Sleep)
+{
+    auto start = std::chrono::steady_clock::now ();
+    swift::SyncWait ([] (swift::ThreadPool& pool) -> swift::Task<void> {
+        co_await swift::SleepFor (pool, std::chrono::milliseconds (20));
+    } (pool_));
+    ASSERT_TRUE (std::chrono::steady_clock::now () - start >= std::chrono::milliseconds (20));
+}
+
+TEST_F (test_Coroutine, Offload)
+{
+    std::string s = swift::SyncWait ([] (swift::ThreadPool& pool) -> swift::Task<std::string> {
+        std::string r = co_await swift::Offload (pool, [] { return std::string ("blocking call"); });
+        co_return r;
+    } (pool_));
+    ASSERT_EQ (s, "blocking call");
+}
+
+TEST_F (test_Coroutine, BlockingQueue)
+{
+    swift::BlockingQueue<int> queue;
+    std::atomic<int> sum (0);
+    std::atomic<bool> done (false);
+
+    swift::Spawn (pool_, [] (swift::ThreadPool& pool, swift::BlockingQueue<int>& q,
+                             std::atomic<int>& sum, std::atomic<bool>& done) -> swift::Task<void> {
+        while (true) {
+            std::optional<int> x = co_await swift::TakeAsync<int> (q, pool);
+            if (!x) {
+                break;
+            }
+            sum += *x;
+        }
+        done = true;
+    } (pool_, queue, sum, done));
+
+    for (int i = 1; i <= 100; ++i) {
+        queue.Put (i);
+        if (0 == i % 10) {
+            std::this_thread::sleep_for (std::chrono::milliseconds (1));
+        }
+    }
+    queue.Close ();
+
+    while (!done) {
+        std::this_thread::sleep_for (std::chrono::milliseconds (1));
+    }
+    ASSERT_EQ (sum, 5050);
+}
+
+TEST_F (test_Coroutine, TakeLatency)
+{
+    // a waiting consumer is woken by the Put itself, not by a timer
+    typedef std::chrono::steady_clock Clock;
+    swift::BlockingQueue<Clock::time_point> queue;
+    std::atomic<int64_t> total_us (0);
+    std::atomic<int> count (0);
+    std::atomic<bool> done (false);
+
+    swift::Spawn (pool_, [] (swift::ThreadPool& pool, swift::BlockingQueue<Clock::time_point>& q,
+                             std::atomic<int64_t>& total_us, std::atomic<int>& count,
+                             std::atomic<bool>& done) -> swift::Task<void> {
+        while (true) {
+            std::optional<Clock::time_point> put = co_await swift::TakeAsync<Clock::time_point> (q, pool);
+            if (!put) {
+                break;
+            }
+            total_us += std::chrono::duration_cast<std::chrono::microseconds> (Clock::now () - *put).count ();
+            ++count;
+        }
+        done = true;
+    } (pool_, queue, total_us, count, done));
+
+    for (int i = 0; i < 20; ++i) {
+        std::this_thread::sleep_for (std::chrono::milliseconds (5));
+        queue.Put (Clock::now ());
+    }
+    queue.Close ();
+
+    while (!done) {
+        std::this_thread::sleep_for (std::chrono::milliseconds (1));
+    }
+    ASSERT_EQ (count, 20);
+    ASSERT_LT (total_us / 20, 1000);
+}
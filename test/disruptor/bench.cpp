@@ -0,0 +1,323 @@
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <swift/base/blockingqueue.h>
+#include <swift/disruptor/pipeline.hpp>
+
+// Disruptor benchmark: every topology is run for every ring size and wait
+// strategy, events are stamped with the time stamp counter when published
+// and the last handler records how long they took to get there. Producers
+// publish as fast as they can, so the latency includes the time spent
+// waiting behind a full ring.
+//
+// usage: disruptor_bench [iterations] [filter]
+//   filter only runs the benchmarks whose name contains it, e.g. "diamond"
+
+using namespace swift::disruptor;
+using namespace std;
+
+static inline uint64_t Rdtsc ()
+{
+#if defined(__GNUC__) && (defined(__i386) || defined(__x86_64__))
+    uint32_t lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return (static_cast<uint64_t>(hi) << 32) | lo;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (
+        std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+#endif
+}
+
+// ticks of Rdtsc per nanosecond
+static double TicksPerNs ()
+{
+    static double ticks_per_ns = 0;
+    if (0 == ticks_per_ns) {
+        auto start_time = std::chrono::steady_clock::now ();
+        uint64_t start = Rdtsc ();
+        std::this_thread::sleep_for (std::chrono::milliseconds (100));
+        uint64_t end = Rdtsc ();
+        double ns = std::chrono::duration<double, std::nano> (std::chrono::steady_clock::now () - start_time).count ();
+        ticks_per_ns = (end - start) / ns;
+    }
+
+    return ticks_per_ns;
+}
+
+// Log linear histogram, 16 sub buckets per power of 2, so percentiles are
+// within about 6% of the recorded value
+class LatencyHistogram
+{
+public:
+    LatencyHistogram () : buckets_ (kBuckets, 0), count_ (0), max_ (0) {}
+
+    void Record (uint64_t value)
+    {
+        ++buckets_[Index (value)];
+        ++count_;
+        if (value > max_) {
+            max_ = value;
+        }
+    }
+
+    void Merge (const LatencyHistogram& other)
+    {
+        for (size_t i = 0; i < buckets_.size (); ++i) {
+            buckets_[i] += other.buckets_[i];
+        }
+        count_ += other.count_;
+        if (other.max_ > max_) {
+            max_ = other.max_;
+        }
+    }
+
+    // upper bound of the bucket holding the p-th percentile
+    uint64_t Percentile (double p) const
+    {
+        uint64_t rank = static_cast<uint64_t>(count_ * p / 100.0);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets_.size (); ++i) {
+            seen += buckets_[i];
+            if (seen > rank) {
+                return std::min (UpperBound (i), max_);
+            }
+        }
+
+        return max_;
+    }
+
+    uint64_t Count () const { return count_; }
+    uint64_t Max () const { return max_; }
+
+private:
+    static const int kSubBits = 4;
+    static const size_t kBuckets = (64 - kSubBits + 1) << kSubBits;
+
+    static size_t Index (uint64_t value)
+    {
+        if (value < (1u << kSubBits)) {
+            return static_cast<size_t>(value);
+        }
+
+        int log = 63 - __builtin_clzll (value);
+        int shift = log - kSubBits;
+        return ((shift + 1) << kSubBits) + ((value >> shift) & ((1u << kSubBits) - 1));
+    }
+
+    static uint64_t UpperBound (size_t index)
+    {
+        if (index < (1u << kSubBits)) {
+            return index;
+        }
+
+        int shift = static_cast<int>(index >> kSubBits) - 1;
+        uint64_t sub = index & ((1u << kSubBits) - 1);
+        return (((1ull << kSubBits) | sub) << shift) + ((1ull << shift) - 1);
+    }
+
+private:
+    std::vector<uint64_t> buckets_;
+    uint64_t count_;
+    uint64_t max_;
+};
+
+static void Report (const std::string& name, uint64_t events, double seconds, const LatencyHistogram& latency)
+{
+    double ticks = TicksPerNs ();
+    printf ("%-42s %14.0f ops/sec  p50 %9.0f ns  p99 %9.0f ns  p99.9 %9.0f ns  max %11.0f ns\n",
+            name.c_str (),
+            events / seconds,
+            latency.Percentile (50) / ticks,
+            latency.Percentile (99) / ticks,
+            latency.Percentile (99.9) / ticks,
+            latency.Max () / ticks);
+    fflush (stdout);
+}
+
+struct Event
+{
+    uint64_t value;
+    uint64_t tsc;
+    uint64_t a;
+    uint64_t b;
+};
+
+struct Strategy
+{
+    const char* name;
+    WaitStrategySPtr strategy;
+};
+
+static std::vector<Strategy> Strategies ()
+{
+    std::vector<Strategy> strategies;
+    Strategy spin = { "spin", std::make_shared<BusySpinWaitStrategy> () };
+    Strategy yield = { "yield", std::make_shared<YieldingWaitStrategy> () };
+    Strategy block = { "block", std::make_shared<BlockingWaitStrategy> () };
+    Strategy park = { "park", std::make_shared<TimedParkWaitStrategy> (1000, 1000, 50 * 1000, 10 * 1000 * 1000) };
+    strategies.push_back (spin);
+    strategies.push_back (yield);
+    strategies.push_back (block);
+    strategies.push_back (park);
+    return strategies;
+}
+
+enum Topology
+{
+    ONE_TO_ONE,       // P -> C
+    PIPELINE,         // P -> C1 -> C2 -> C3
+    DIAMOND,          // P -> (C1, C2) -> C3
+    THREE_TO_ONE,     // (P1, P2, P3) -> C
+};
+
+static const char* TopologyName (Topology topology)
+{
+    switch (topology) {
+    case ONE_TO_ONE:
+        return "1P1C";
+    case PIPELINE:
+        return "1P3C-pipeline";
+    case DIAMOND:
+        return "1P3C-diamond";
+    default:
+        return "3P1C";
+    }
+}
+
+template<uint64_t Size>
+static void RunDisruptor (Topology topology, const Strategy& strategy, uint64_t iterations)
+{
+    int producers = THREE_TO_ONE == topology ? 3 : 1;
+    Disruptor<Event, Size> disruptor (producers > 1);
+    disruptor.set_wait_strategy (strategy.strategy);
+
+    LatencyHistogram latency;
+    uint64_t sink = 0;
+    auto step_a = [] (Event& e, int64_t, bool) { e.a = e.value + 1; };
+    auto step_b = [] (Event& e, int64_t, bool) { e.b = e.value + 2; };
+    auto last = [&latency, &sink] (Event& e, int64_t, bool) {
+        latency.Record (Rdtsc () - e.tsc);
+        sink += e.value + e.a + e.b;
+    };
+
+    switch (topology) {
+    case PIPELINE:
+        disruptor.handle_with (step_a).then (step_b).then (last);
+        break;
+    case DIAMOND:
+        disruptor.handle_with (step_a, step_b).then (last);
+        break;
+    default:
+        disruptor.handle_with (last);
+        break;
+    }
+    disruptor.start ();
+
+    auto start = std::chrono::steady_clock::now ();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.push_back (std::thread ([&disruptor, iterations, producers] () {
+            for (uint64_t i = 0; i < iterations / producers; ++i) {
+                disruptor.publish ([i] (Event& e, int64_t) {
+                    e.value = i;
+                    e.a = 0;
+                    e.b = 0;
+                    e.tsc = Rdtsc ();
+                });
+            }
+        }));
+    }
+    for (auto& t : threads) {
+        t.join ();
+    }
+    disruptor.stop ();
+    double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+
+    char name[128];
+    snprintf (name, sizeof(name), "disruptor %s ring %llu %s",
+              TopologyName (topology), static_cast<unsigned long long>(Size), strategy.name);
+    Report (name, latency.Count (), seconds, latency);
+}
+
+static void RunBlockingQueue (Topology topology, uint64_t iterations)
+{
+    int producers = THREE_TO_ONE == topology ? 3 : 1;
+    swift::BlockingQueue<Event> queue;
+
+    LatencyHistogram latency;
+    uint64_t sink = 0;
+    std::thread consumer ([&queue, &latency, &sink] () {
+        Event e;
+        while (queue.Take (e)) {
+            latency.Record (Rdtsc () - e.tsc);
+            sink += e.value;
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now ();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.push_back (std::thread ([&queue, iterations, producers] () {
+            for (uint64_t i = 0; i < iterations / producers; ++i) {
+                Event e = { i, Rdtsc (), 0, 0 };
+                queue.Put (e);
+            }
+        }));
+    }
+    for (auto& t : threads) {
+        t.join ();
+    }
+    queue.Close ();
+    consumer.join ();
+    double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+
+    Report (std::string ("blockingqueue ") + TopologyName (topology), latency.Count (), seconds, latency);
+}
+
+static bool Selected (const std::string& filter, const std::string& name)
+{
+    return filter.empty () || std::string::npos != name.find (filter);
+}
+
+template<uint64_t Size>
+static void SweepStrategies (const std::string& filter, Topology topology, uint64_t iterations)
+{
+    std::vector<Strategy> strategies = Strategies ();
+    for (size_t i = 0; i < strategies.size (); ++i) {
+        char name[128];
+        snprintf (name, sizeof(name), "disruptor %s ring %llu %s",
+                  TopologyName (topology), static_cast<unsigned long long>(Size), strategies[i].name);
+        if (Selected (filter, name)) {
+            RunDisruptor<Size> (topology, strategies[i], iterations);
+        }
+    }
+}
+
+int main (int argc, char** argv)
+{
+    uint64_t iterations = argc > 1 ? strtoull (argv[1], NULL, 10) : 1000L * 1000L * 10;
+    std::string filter = argc > 2 ? argv[2] : "";
+
+    printf ("%llu events per run, %.2f ticks per ns, %u cpus\n",
+            static_cast<unsigned long long>(iterations), TicksPerNs (), std::thread::hardware_concurrency ());
+
+    const Topology topologies[] = { ONE_TO_ONE, PIPELINE, DIAMOND, THREE_TO_ONE };
+    for (size_t t = 0; t < sizeof(topologies) / sizeof(topologies[0]); ++t) {
+        Topology topology = topologies[t];
+        SweepStrategies<256> (filter, topology, iterations);
+        SweepStrategies<4096> (filter, topology, iterations);
+        SweepStrategies<65536> (filter, topology, iterations);
+
+        if ((ONE_TO_ONE == topology || THREE_TO_ONE == topology) &&
+            Selected (filter, std::string ("blockingqueue ") + TopologyName (topology))) {
+            RunBlockingQueue (topology, iterations);
+        }
+    }
+
+    return 0;
+}
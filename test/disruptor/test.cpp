@@ -2,6 +2,8 @@
 #include <stdexcept>
 #include <thread>
 #include <map>
+#include <string>
+#include <cstdlib>
 #include <sys/time.h>
 #include <swift/disruptor/disruptor.hpp>
 
@@ -10,9 +12,28 @@
 using namespace swift::disruptor;
 using namespace std;
 
+// usage: disruptor_test [spin|yield|block|park] [iterations]
+static WaitStrategySPtr MakeWaitStrategy (const std::string& name)
+{
+    if (name == "spin") {
+        return std::make_shared<BusySpinWaitStrategy> ();
+    } else if (name == "yield") {
+        return std::make_shared<YieldingWaitStrategy> ();
+    } else if (name == "block") {
+        return std::make_shared<BlockingWaitStrategy> ();
+    }
+
+    // progressive backoff from 50us up to 10ms
+    return std::make_shared<TimedParkWaitStrategy> (1000, 1000, 50 * 1000, 10 * 1000 * 1000);
+}
+
 int main (int argc, char** argv)
 {
     uint64_t iterations = 1000L * 1000L * 100;
+    std::string strategy_name = argc > 1 ? argv[1] : "park";
+    if (argc > 2) {
+        iterations = strtoull (argv[2], NULL, 10);
+    }
 
     // data source / publisher
     auto source = std::make_shared<RingBuffer<uint64_t, RING_BUFFER_SIZE>> ();
@@ -31,6 +52,12 @@ int main (int argc, char** argv)
     c->follows (b);
     p->follows (c);
 
+    auto strategy = MakeWaitStrategy (strategy_name);
+    a->set_wait_strategy (strategy);
+    b->set_wait_strategy (strategy);
+    c->set_wait_strategy (strategy);
+    p->set_wait_strategy (strategy);
+
     // thread publisher
     auto pub_thread = [&] ()
     {
@@ -151,7 +178,7 @@ int main (int argc, char** argv)
     end = end_time.tv_sec + ((double)end_time.tv_usec / 1000000);
 
     std::cout.precision (15);
-    std::cout << "1P-3C-UNICAST performance: ";
+    std::cout << "1P-3C-UNICAST performance (" << strategy_name << "): ";
     std::cout << (iterations * 1.0) / (end - start) << " ops/secs" << std::endl;
 
     std::cout << "Source: " << cube->at (0) << "  2x: " << square->at (0) << " diff: " << diff->at (0) << std::endl;
@@ -0,0 +1,142 @@
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <swift/disruptor/byte_ring.hpp>
+
+using namespace swift::disruptor;
+using namespace std;
+
+// Record i of a producer is i % 300 bytes of (producer + i) followed by
+// the producer id and i, the consumer checks the content and the order.
+struct Trailer
+{
+    uint32_t producer;
+    uint64_t index;
+};
+
+static size_t RecordLength (uint64_t i)
+{
+    return i % 300 + sizeof(Trailer);
+}
+
+static void Fill (char* data, uint32_t producer, uint64_t i)
+{
+    size_t n = RecordLength (i) - sizeof(Trailer);
+    memset (data, static_cast<char>(producer + i), n);
+    Trailer t = { producer, i };
+    memcpy (data + n, &t, sizeof(t));
+}
+
+static bool Check (const char* data, size_t length, std::vector<uint64_t>& next)
+{
+    Trailer t;
+    if (length < sizeof(t)) {
+        return false;
+    }
+    memcpy (&t, data + length - sizeof(t), sizeof(t));
+    if (t.producer >= next.size () || t.index != next[t.producer] || length != RecordLength (t.index)) {
+        return false;
+    }
+    for (size_t k = 0; k + sizeof(t) < length; ++k) {
+        if (data[k] != static_cast<char>(t.producer + t.index)) {
+            return false;
+        }
+    }
+
+    ++next[t.producer];
+    return true;
+}
+
+static int Run (ByteRing::ProducerType type, uint32_t producers, uint64_t iterations)
+{
+    ByteRing ring (64 * 1024, type);
+    std::vector<std::thread> threads;
+    for (uint32_t p = 0; p < producers; ++p) {
+        threads.push_back (std::thread ([&ring, p, iterations] () {
+            for (uint64_t i = 0; i < iterations; ++i) {
+                // reserve more than needed, commit what was written
+                char* data = ring.reserve (RecordLength (i) + 64);
+                Fill (data, p, i);
+                ring.commit (data, RecordLength (i));
+            }
+        }));
+    }
+
+    int errors = 0;
+    uint64_t bytes = 0;
+    std::vector<uint64_t> next (producers, 0);
+    int devnull = open ("/dev/null", O_WRONLY);
+
+    struct timeval start_time, end_time;
+    gettimeofday (&start_time, NULL);
+    for (uint64_t received = 0; received < iterations * producers;) {
+        struct iovec iov[64];
+        size_t count = ring.peek (iov, 64);
+        if (0 == count) {
+            sched_yield ();
+            continue;
+        }
+
+        for (size_t k = 0; k < count; ++k) {
+            if (!Check (static_cast<const char*>(iov[k].iov_base), iov[k].iov_len, next)) {
+                ++errors;
+            }
+            bytes += iov[k].iov_len;
+        }
+
+        // hand the records to the kernel straight from the ring
+        if (writev (devnull, iov, static_cast<int>(count)) < 0) {
+            ++errors;
+        }
+        ring.release ();
+        received += count;
+    }
+    gettimeofday (&end_time, NULL);
+
+    for (auto& t : threads) {
+        t.join ();
+    }
+    close (devnull);
+
+    double start = start_time.tv_sec + ((double)start_time.tv_usec / 1000000);
+    double end = end_time.tv_sec + ((double)end_time.tv_usec / 1000000);
+    std::cout.precision (15);
+    std::cout << producers << (type == ByteRing::kSingleProducer ? "P-1C-SPSC" : "P-1C-MPSC") << " byte ring: "
+              << (iterations * producers) / (end - start) << " records/secs "
+              << bytes / (end - start) / (1024 * 1024) << " MB/secs, errors: " << errors << std::endl;
+
+    return errors;
+}
+
+// usage: disruptor_byte_ring_test [iterations]
+int main (int argc, char** argv)
+{
+    uint64_t iterations = argc > 1 ? strtoull (argv[1], NULL, 10) : 1000L * 1000L * 5;
+
+    // a wrapped record is contiguous through the mirror
+    ByteRing ring (4096);
+    size_t length = 0;
+    char* first = ring.reserve (4000);
+    ring.commit (first, 4000);
+    ring.peek (&length);
+    ring.release ();
+    char* wrapped = ring.reserve (200);
+    memset (wrapped, 'x', 200);
+    ring.commit (wrapped, 200);
+    const char* read = ring.peek (&length);
+    int errors = (read == wrapped && length == 200 && read[199] == 'x') ? 0 : 1;
+    ring.release ();
+
+    errors += Run (ByteRing::kSingleProducer, 1, iterations);
+    errors += Run (ByteRing::kMultiProducer, 1, iterations);
+    errors += Run (ByteRing::kMultiProducer, 3, iterations / 3);
+
+    return errors;
+}
@@ -0,0 +1,106 @@
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <string>
+#include <cstdlib>
+#include <sys/time.h>
+#include <swift/disruptor/disruptor.hpp>
+#include <swift/disruptor/dynamic_ringbuffer.hpp>
+
+using namespace swift::disruptor;
+using namespace std;
+
+struct Event
+{
+    explicit Event (uint64_t v = 0) : value (v) {}
+
+    uint64_t value;
+    char payload[56];
+};
+
+// 1P-1C over a runtime sized ring, on huge pages unless told otherwise
+// usage: disruptor_dynamic_ringbuffer_test [ring size] [iterations] [small]
+int main (int argc, char** argv)
+{
+    uint64_t size = argc > 1 ? strtoull (argv[1], NULL, 10) : 4 * 1024 * 1024;
+    uint64_t iterations = argc > 2 ? strtoull (argv[2], NULL, 10) : 1000L * 1000L * 100;
+
+    DynamicRingBuffer<Event>::Options opt;
+    opt.huge_pages = !(argc > 3 && std::string (argv[3]) == "small");
+    opt.lock = true;
+    DynamicRingBuffer<Event> ring (size, opt, [] () { return Event (kMaxInt64Value); });
+
+    // events are constructed up front
+    if (ring.at (0).value != static_cast<uint64_t>(kMaxInt64Value)) {
+        std::cerr << "event not constructed\n";
+        return 1;
+    }
+
+    auto p = std::make_shared<WriteCursor> ("write", ring.get_buffer_size ());
+    auto c = std::make_shared<ReadCursor> ("sum");
+    c->follows (p);
+    p->follows (c);
+
+    auto pub_thread = [&] ()
+    {
+        auto pos = p->begin ();
+        auto end = p->end ();
+        for (uint64_t i = 0; i < iterations;) {
+            if (pos >= end) {
+                end = p->wait_for (end);
+            }
+
+            do {
+                ring.at (pos).value = i;
+                ++pos;
+                ++i;
+            } while (pos < end && i < iterations);
+
+            p->publish (pos - 1);
+        }
+        p->set_eof ();
+    };
+
+    uint64_t sum = 0;
+    auto sum_thread = [&] ()
+    {
+        try {
+            auto pos = c->begin ();
+            auto end = c->end ();
+            while (true) {
+                if (pos == end) {
+                    c->publish (pos - 1);
+                    end = c->wait_for (end);
+                }
+
+                sum += ring.at (pos).value;
+                ++pos;
+            }
+        }
+        catch (Eof&) {
+        }
+    };
+
+    struct timeval start_time, end_time;
+    gettimeofday (&start_time, NULL);
+
+    std::thread pt (pub_thread);
+    std::thread ct (sum_thread);
+    pt.join ();
+    ct.join ();
+
+    gettimeofday (&end_time, NULL);
+
+    double start, end;
+    start = start_time.tv_sec + ((double)start_time.tv_usec / 1000000);
+    end = end_time.tv_sec + ((double)end_time.tv_usec / 1000000);
+
+    uint64_t expected = iterations * (iterations - 1) / 2;
+    std::cout.precision (15);
+    std::cout << "1P-1C-DYNAMIC performance (" << ring.get_buffer_size () << " slots"
+              << (opt.huge_pages ? ", huge pages" : "") << (ring.locked () ? ", locked" : "") << "): ";
+    std::cout << (iterations * 1.0) / (end - start) << " ops/secs" << std::endl;
+    std::cout << "sum: " << sum << " expected: " << expected << std::endl;
+
+    return sum == expected ? 0 : 1;
+}
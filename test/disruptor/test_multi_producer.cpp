@@ -0,0 +1,99 @@
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <sys/time.h>
+#include <swift/disruptor/disruptor.hpp>
+
+#define RING_BUFFER_SIZE 1024
+#define BATCH_SIZE 16
+
+using namespace swift::disruptor;
+using namespace std;
+
+// usage: disruptor_multi_producer_test [producers] [iterations per producer]
+int main (int argc, char** argv)
+{
+    int producers = argc > 1 ? atoi (argv[1]) : 3;
+    uint64_t iterations = argc > 2 ? strtoull (argv[2], NULL, 10) : 1000L * 1000L * 10;
+
+    auto source = std::make_shared<RingBuffer<uint64_t, RING_BUFFER_SIZE>> ();
+    auto p = std::make_shared<MultiWriteCursor> ("write", RING_BUFFER_SIZE);
+    auto c = std::make_shared<ReadCursor> ("sum");
+
+    c->follows (p);
+    p->follows (c);
+
+    // each producer writes 1 .. iterations, claiming in batches
+    auto pub_thread = [&] ()
+    {
+        try {
+            for (uint64_t i = 1; i <= iterations;) {
+                size_t slots = std::min<uint64_t> (BATCH_SIZE, iterations - i + 1);
+                auto first = p->claim (slots);
+                for (size_t n = 0; n < slots; ++n, ++i) {
+                    source->at (first + n) = i;
+                }
+                p->publish (first, first + slots - 1);
+            }
+        }
+        catch (std::exception& e) {
+            std::cerr << "publisher caught: " << e.what () << "\n";
+        }
+    };
+
+    uint64_t sum = 0;
+    uint64_t count = 0;
+    uint64_t total = iterations * producers;
+    auto sum_thread = [&] ()
+    {
+        try {
+            auto pos = c->begin ();
+            auto end = c->end ();
+            while (count < total) {
+                if (pos == end) {
+                    c->publish (pos - 1);
+                    end = c->wait_for (end);
+                }
+
+                sum += source->at (pos);
+                ++count;
+                ++pos;
+            }
+            c->publish (pos - 1);
+        }
+        catch (std::exception& e) {
+            std::cerr << "sum caught: " << e.what () << "\n";
+        }
+    };
+
+    struct timeval start_time, end_time;
+    gettimeofday (&start_time, NULL);
+
+    std::thread ct (sum_thread);
+    std::vector<std::thread> pts;
+    for (int i = 0; i < producers; ++i) {
+        pts.push_back (std::thread (pub_thread));
+    }
+
+    for (auto& t : pts) {
+        t.join ();
+    }
+    ct.join ();
+
+    gettimeofday (&end_time, NULL);
+
+    double start, end;
+    start = start_time.tv_sec + ((double)start_time.tv_usec / 1000000);
+    end = end_time.tv_sec + ((double)end_time.tv_usec / 1000000);
+
+    uint64_t expected = producers * (iterations * (iterations + 1) / 2);
+    std::cout.precision (15);
+    std::cout << producers << "P-1C-SEQUENCER performance: ";
+    std::cout << (total * 1.0) / (end - start) << " ops/secs" << std::endl;
+    std::cout << "sum: " << sum << " expected: " << expected << std::endl;
+
+    return sum == expected ? 0 : 1;
+}
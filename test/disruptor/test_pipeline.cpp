@@ -0,0 +1,97 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <cstdlib>
+#include <sys/time.h>
+#include <swift/disruptor/pipeline.hpp>
+
+#define RING_BUFFER_SIZE 1024
+
+using namespace swift::disruptor;
+using namespace std;
+
+struct Event
+{
+    uint64_t value;
+    uint64_t square;
+    uint64_t cube;
+};
+
+// the diamond of test.cpp built with the pipeline DSL, plus a handler
+// failure that must reach the publisher
+// usage: disruptor_pipeline_test [iterations]
+int main (int argc, char** argv)
+{
+    uint64_t iterations = argc > 1 ? strtoull (argv[1], NULL, 10) : 1000L * 1000L * 10;
+    uint64_t expected = 0;
+    uint64_t diff = 0;
+    int failures = 0;
+
+    {
+        Disruptor<Event, RING_BUFFER_SIZE> pipeline;
+        pipeline.handle_with ([] (Event& e, int64_t, bool) { e.square = e.value * e.value; },
+                              [] (Event& e, int64_t, bool) { e.cube = e.value * e.value * e.value; })
+                .then ([&diff] (Event& e, int64_t, bool) { diff += e.cube - e.square; });
+        pipeline.start ();
+
+        struct timeval start_time, end_time;
+        gettimeofday (&start_time, NULL);
+
+        for (uint64_t i = 0; i < iterations; ++i) {
+            pipeline.publish ([i] (Event& e, int64_t) { e.value = i; });
+            expected += i * i * i - i * i;
+        }
+        pipeline.stop ();
+
+        gettimeofday (&end_time, NULL);
+        double start = start_time.tv_sec + ((double)start_time.tv_usec / 1000000);
+        double end = end_time.tv_sec + ((double)end_time.tv_usec / 1000000);
+
+        std::cout.precision (15);
+        std::cout << "1P-3C-PIPELINE performance: ";
+        std::cout << (iterations * 1.0) / (end - start) << " ops/secs" << std::endl;
+
+        auto metrics = pipeline.metrics ();
+        for (auto& m : metrics) {
+            std::cout << "stage " << m.name << " processed: " << m.processed
+                      << " avg batch: " << (m.batches ? m.processed / m.batches : 0)
+                      << " lag: " << m.lag << std::endl;
+            if (m.processed != static_cast<int64_t>(iterations) || m.lag != 0) {
+                ++failures;
+            }
+        }
+
+        std::cout << "diff: " << diff << " expected: " << expected << std::endl;
+        if (diff != expected) {
+            ++failures;
+        }
+    }
+
+    {
+        Disruptor<Event, RING_BUFFER_SIZE> pipeline;
+        pipeline.handle_with ([] (Event& e, int64_t, bool) {
+            if (e.value == 100) {
+                throw std::runtime_error ("bad event");
+            }
+        }).then ([] (Event&, int64_t, bool) {});
+        pipeline.start ();
+
+        bool caught = false;
+        try {
+            for (uint64_t i = 0; i < iterations; ++i) {
+                pipeline.publish ([i] (Event& e, int64_t) { e.value = i; });
+            }
+            pipeline.stop ();
+        }
+        catch (std::runtime_error& e) {
+            caught = true;
+            std::cout << "handler failure: " << e.what () << std::endl;
+        }
+
+        if (!caught) {
+            ++failures;
+        }
+    }
+
+    return failures;
+}